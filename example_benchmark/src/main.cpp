@@ -0,0 +1,42 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofApp.h"
+#include "ofAppNoWindow.h"
+#include "ofSSLAllocator.h"
+
+
+int main(int argc, char* argv[])
+{
+    bool noWindow = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+
+        if (argument == "--no-window")
+        {
+            noWindow = true;
+        }
+        else if (argument == "--pooled-allocator")
+        {
+            // Must be installed before anything uses OpenSSL.
+            ofSSLAllocator::install();
+        }
+    }
+
+    // Run without a window and exit when finished, e.g. in CI.
+    if (noWindow)
+    {
+        ofAppNoWindow window;
+        ofSetupOpenGL(&window, 400, 100, OF_WINDOW);
+        return ofRunApp(std::make_shared<ofApp>(true));
+    }
+
+    ofSetupOpenGL(800, 600, OF_WINDOW);
+    return ofRunApp(std::make_shared<ofApp>());
+}
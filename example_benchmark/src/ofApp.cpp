@@ -0,0 +1,1524 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofApp.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+#include "Poco/Net/SecureServerSocket.h"
+#include "Poco/Net/SecureStreamSocket.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/X509Certificate.h"
+#include "ofSSLManager.h"
+
+
+namespace
+{
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+/// \brief A loopback server that completes handshakes and echoes one byte.
+///
+/// Each connection is accepted with the Context returned by a getter, so that
+/// a getter returning per-thread Contexts (e.g. the default Server Context
+/// with sharding enabled) is measured as a real server would use it.
+class LoopbackServer
+{
+public:
+    LoopbackServer(Poco::Net::Context::Ptr pContext, std::size_t threadCount = 1):
+        LoopbackServer([pContext]() { return pContext; }, threadCount)
+    {
+    }
+
+    LoopbackServer(std::function<Poco::Net::Context::Ptr()> getContext,
+                   std::size_t threadCount = 1):
+        _getContext(getContext),
+        _socket(Poco::Net::SocketAddress("127.0.0.1", 0), 256),
+        _running(true)
+    {
+        // Threads that lose the race to accept a connection must not block.
+        _socket.setBlocking(false);
+
+        for (std::size_t i = 0; i < threadCount; ++i)
+            _threads.emplace_back([this]() { _run(); });
+    }
+
+    ~LoopbackServer()
+    {
+        _running = false;
+
+        for (auto& thread: _threads)
+            thread.join();
+    }
+
+    Poco::Net::SocketAddress address() const
+    {
+        return _socket.address();
+    }
+
+private:
+    void _run()
+    {
+        while (_running)
+        {
+            if (!_socket.poll(Poco::Timespan(0, 100000), Poco::Net::Socket::SELECT_READ))
+                continue;
+
+            Poco::Net::StreamSocket accepted;
+
+            try
+            {
+                accepted = _socket.acceptConnection();
+            }
+            catch (const Poco::Exception&)
+            {
+                // Another thread accepted the connection.
+                continue;
+            }
+
+            try
+            {
+                Poco::Net::SecureStreamSocket socket = Poco::Net::SecureStreamSocket::attach(accepted, _getContext());
+
+                char c = 0;
+
+                if (socket.receiveBytes(&c, 1) == 1)
+                    socket.sendBytes(&c, 1);
+
+                socket.close();
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogError("LoopbackServer") << exc.displayText();
+            }
+        }
+    }
+
+    std::function<Poco::Net::Context::Ptr()> _getContext;
+    Poco::Net::ServerSocket _socket;
+    std::atomic<bool> _running;
+    std::vector<std::thread> _threads;
+
+};
+
+
+/// \brief A server that echoes bytes until each client disconnects.
+///
+/// Each connection is served by its own thread, so that clients can keep
+/// idle connections open, as they do with a connection pool.
+class EchoServer
+{
+public:
+    EchoServer(Poco::Net::Context::Ptr pContext):
+        _pContext(pContext),
+        _socket(Poco::Net::SocketAddress("127.0.0.1", 0), 256),
+        _running(true)
+    {
+        _thread = std::thread([this]() { _run(); });
+    }
+
+    ~EchoServer()
+    {
+        _running = false;
+        _thread.join();
+
+        for (auto& thread: _connections)
+            thread.join();
+    }
+
+    Poco::Net::SocketAddress address() const
+    {
+        return _socket.address();
+    }
+
+private:
+    void _run()
+    {
+        while (_running)
+        {
+            if (!_socket.poll(Poco::Timespan(0, 100000), Poco::Net::Socket::SELECT_READ))
+                continue;
+
+            try
+            {
+                Poco::Net::StreamSocket accepted = _socket.acceptConnection();
+                _connections.emplace_back([this, accepted]() { _serve(accepted); });
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogError("EchoServer") << exc.displayText();
+            }
+        }
+    }
+
+    void _serve(Poco::Net::StreamSocket accepted)
+    {
+        try
+        {
+            Poco::Net::SecureStreamSocket socket = Poco::Net::SecureStreamSocket::attach(accepted, _pContext);
+
+            char buffer[256];
+
+            while (_running)
+            {
+                if (!socket.poll(Poco::Timespan(0, 100000), Poco::Net::Socket::SELECT_READ))
+                    continue;
+
+                int n = socket.receiveBytes(buffer, sizeof(buffer));
+
+                if (n <= 0)
+                    break;
+
+                socket.sendBytes(buffer, n);
+            }
+
+            socket.close();
+        }
+        catch (const Poco::Exception& exc)
+        {
+            ofLogVerbose("EchoServer") << exc.displayText();
+        }
+    }
+
+    Poco::Net::Context::Ptr _pContext;
+    Poco::Net::ServerSocket _socket;
+    std::atomic<bool> _running;
+    std::thread _thread;
+    std::vector<std::thread> _connections;
+
+};
+
+
+struct HandshakeResult
+{
+    std::size_t count = 0;
+    std::size_t reused = 0;
+    double seconds = 0;
+
+    /// \brief The latency of each handshake in microseconds.
+    std::vector<double> latencies;
+};
+
+
+/// \brief Connect count times, optionally resuming the previous session.
+///
+/// A byte is echoed on each connection so that TLS 1.3 session tickets sent
+/// after the handshake are received before the session is saved.
+HandshakeResult runHandshakes(const Poco::Net::SocketAddress& address,
+                              Poco::Net::Context::Ptr pContext,
+                              std::size_t count,
+                              Poco::Net::Session::Ptr pSession)
+{
+    HandshakeResult result;
+
+    auto start = Clock::now();
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto connectionStart = Clock::now();
+
+        Poco::Net::SecureStreamSocket socket(address, "localhost", pContext, pSession);
+
+        char c = 'x';
+        socket.sendBytes(&c, 1);
+        socket.receiveBytes(&c, 1);
+
+        result.latencies.push_back(secondsSince(connectionStart) * 1000000);
+
+        if (socket.sessionWasReused())
+            ++result.reused;
+
+        if (!pSession.isNull())
+            pSession = socket.currentSession();
+
+        socket.close();
+        ++result.count;
+    }
+
+    result.seconds = secondsSince(start);
+    return result;
+}
+
+
+/// \brief Get a resumable session from the server at the given address.
+Poco::Net::Session::Ptr firstSession(const Poco::Net::SocketAddress& address,
+                                     Poco::Net::Context::Ptr pContext)
+{
+    Poco::Net::SecureStreamSocket socket(address, "localhost", pContext);
+    char c = 'x';
+    socket.sendBytes(&c, 1);
+    socket.receiveBytes(&c, 1);
+    Poco::Net::Session::Ptr pSession = socket.currentSession();
+    socket.close();
+    return pSession;
+}
+
+
+/// \brief Connect count times from each of threadCount threads.
+HandshakeResult runHandshakes(const Poco::Net::SocketAddress& address,
+                              Poco::Net::Context::Ptr pContext,
+                              std::size_t count,
+                              std::size_t threadCount,
+                              bool resume)
+{
+    std::vector<HandshakeResult> threadResults(threadCount);
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+
+    for (std::size_t i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            try
+            {
+                Poco::Net::Session::Ptr pSession;
+
+                if (resume)
+                    pSession = firstSession(address, pContext);
+
+                threadResults[i] = runHandshakes(address, pContext, count, pSession);
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogError("runHandshakes") << exc.displayText();
+            }
+        });
+    }
+
+    for (auto& thread: threads)
+        thread.join();
+
+    HandshakeResult result;
+    result.seconds = secondsSince(start);
+
+    for (const auto& threadResult: threadResults)
+    {
+        result.count += threadResult.count;
+        result.reused += threadResult.reused;
+        result.latencies.insert(result.latencies.end(),
+                                threadResult.latencies.begin(),
+                                threadResult.latencies.end());
+    }
+
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+
+/// \returns the given percentile of sorted values.
+double percentile(const std::vector<double>& values, double p)
+{
+    if (values.empty())
+        return 0;
+
+    std::size_t index = static_cast<std::size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+
+std::string format(const std::string& name, double value, int precision, const std::string& unit)
+{
+    std::stringstream ss;
+    ss << std::left << std::setw(36) << name;
+    ss << std::right << std::setw(12) << std::fixed << std::setprecision(precision);
+    ss << value << " " << unit;
+    return ss.str();
+}
+
+
+/// \returns the resident set size in bytes, or 0 if it is unknown.
+std::size_t residentSetSize()
+{
+#if defined(__linux__)
+    std::ifstream stream("/proc/self/statm");
+    std::size_t size = 0;
+    std::size_t resident = 0;
+
+    if (stream >> size >> resident)
+        return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+
+    return 0;
+}
+
+
+}
+
+
+ofApp::ofApp(bool exitWhenFinished): exitWhenFinished(exitWhenFinished)
+{
+}
+
+
+void ofApp::setup()
+{
+    for (KeyType keyType: { RSA_2048, ECDSA_P256 })
+    {
+        if (!std::filesystem::exists(privateKeyFile(keyType)) || !std::filesystem::exists(certificateFile(keyType)))
+            createSelfSignedCertificate(privateKeyFile(keyType), certificateFile(keyType), keyType);
+    }
+
+    useKeyType(RSA_2048);
+
+    // The default Client Context trusts the self-signed loopback certificates.
+    for (KeyType keyType: { RSA_2048, ECDSA_P256 })
+    {
+        Poco::Net::X509Certificate certificate(certificateFile(keyType));
+        ofSSLManager::getDefaultClientContext()->addCertificateAuthority(certificate);
+    }
+
+    std::size_t maximumThreadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t threadCount = 1; threadCount <= maximumThreadCount; threadCount *= 2)
+        threadCounts.push_back(threadCount);
+
+    json["openssl"] = OPENSSL_VERSION_TEXT;
+    json["hardwareConcurrency"] = maximumThreadCount;
+    json["aesAcceleration"] = ofSSLManager::hasAESAcceleration();
+    json["kernelTLS"] = ofSSLKernelTLS::isAvailable();
+    json["performanceProfile"] = ofSSLManager::to_string(ofSSLManager::getDetectedPerformanceProfile());
+    json["allocator"] = ofSSLAllocator::isInstalled() ? "pooled" : "system";
+    json["results"] = ofJson::array();
+
+    benchmarkContexts();
+    benchmarkTrustStores();
+    benchmarkHandshakes();
+    benchmarkGetters();
+    benchmarkServerNames();
+    benchmarkBulkTransfer();
+    benchmarkKernelTLS();
+    benchmarkAllocations();
+    benchmarkIdleConnections();
+    benchmarkConnectionPool();
+    benchmarkBatchVerification();
+
+    // Leave the default Server Context as it was.
+    useKeyType(RSA_2048);
+
+    ofSSLMetricsSnapshot metrics = ofSSLManager::getMetricsSnapshot();
+
+    json["metrics"] = {
+        { "fullHandshakes", metrics.fullHandshakes },
+        { "resumedHandshakes", metrics.resumedHandshakes },
+        { "failedHandshakes", metrics.failedHandshakes },
+        { "fullHandshakeP99Microseconds", metrics.fullHandshakeLatency.percentile(0.99).count() },
+        { "resumedHandshakeP99Microseconds", metrics.resumedHandshakeLatency.percentile(0.99).count() },
+        { "contextBuilds", metrics.contextBuilds },
+        { "contextBuildMeanMicroseconds", metrics.contextBuildLatency.mean().count() }
+    };
+
+    for (const auto& result: results)
+        ofLogNotice("ofApp::setup") << result;
+
+    ofSavePrettyJson("benchmark.json", json);
+    ofLogNotice("ofApp::setup") << "Results saved to " << ofToDataPath("benchmark.json", true);
+
+    if (exitWhenFinished)
+        ofExit();
+}
+
+
+void ofApp::draw()
+{
+    ofBackgroundGradient(ofColor::white, ofColor::black);
+
+    float y = 30;
+
+    for (const auto& result: results)
+    {
+        ofDrawBitmapStringHighlight(result, ofPoint(30, y));
+        y += 20;
+    }
+}
+
+
+void ofApp::benchmarkContexts()
+{
+    const std::size_t count = 50;
+
+    // Load the trust store before measuring, as the default Contexts share it.
+    ofSSLManager::getTrustStore();
+
+    auto measure = [&](const std::string& name,
+                       const std::string& keyType,
+                       std::function<Poco::Net::Context::Ptr()> create)
+    {
+        auto start = Clock::now();
+
+        for (std::size_t i = 0; i < count; ++i)
+            create();
+
+        double milliseconds = secondsSince(start) * 1000 / count;
+
+        record(format("Context (" + name + ")", milliseconds, 3, "ms"), {
+            { "benchmark", "context" },
+            { "name", name },
+            { "keyType", keyType },
+            { "milliseconds", milliseconds }
+        });
+    };
+
+    measure("client, shared trust store", "", []() {
+        Poco::Net::Context::Ptr pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "");
+        ofSSLManager::getTrustStore()->attach(pContext);
+        return pContext;
+    });
+
+    for (KeyType keyType: { RSA_2048, ECDSA_P256 })
+    {
+        measure("server, " + to_string(keyType), to_string(keyType), [keyType]() {
+            return Poco::Net::Context::Ptr(new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                                  privateKeyFile(keyType),
+                                                                  certificateFile(keyType),
+                                                                  ""));
+        });
+    }
+}
+
+
+void ofApp::benchmarkTrustStores()
+{
+    const std::size_t count = 20;
+
+    // Use the CA bundle in the data folder or the addon's shared data folder.
+    std::filesystem::path pemFile = ofToDataPath(ofSSLManager::DEFAULT_CA_LOCATION, true);
+
+    if (!std::filesystem::exists(pemFile))
+        pemFile = ofToDataPath("../../../shared/data/" + ofSSLManager::DEFAULT_CA_LOCATION, true);
+
+    std::filesystem::path binaryFile = std::filesystem::path(pemFile).replace_extension(".bin");
+    std::filesystem::path directory = ofToDataPath("benchmark/certs", true);
+
+    auto measure = [&](const std::string& name, std::function<std::size_t(ofSSLTrustStore&)> load)
+    {
+        double seconds = 0;
+        std::size_t available = 0;
+        std::size_t parsed = 0;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto start = Clock::now();
+
+            ofSSLTrustStore::Ptr pTrustStore = new ofSSLTrustStore();
+            available = load(*pTrustStore);
+
+            Poco::Net::Context::Ptr pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "");
+            pTrustStore->attach(pContext);
+
+            seconds += secondsSince(start);
+            parsed = pTrustStore->getParsedCount();
+        }
+
+        double milliseconds = seconds * 1000 / count;
+
+        record(format("CA load (" + name + ")", milliseconds, 3, "ms"), {
+            { "benchmark", "trustStore" },
+            { "name", name },
+            { "milliseconds", milliseconds },
+            { "certificates", available },
+            { "certificatesParsed", parsed }
+        });
+    };
+
+    measure("PEM", [&](ofSSLTrustStore& store) {
+        return store.loadPEM(pemFile.string());
+    });
+
+    if (std::filesystem::exists(binaryFile))
+    {
+        measure("binary", [&](ofSSLTrustStore& store) {
+            return store.loadBinary(binaryFile.string());
+        });
+    }
+    else
+    {
+        ofLogWarning("ofApp::benchmarkTrustStores") << "Run shared/data/ssl.sh to create " << binaryFile.string();
+    }
+
+    if (ofSSLTrustStore::isDirectoryCurrent(pemFile.string(), directory.string())
+     || ofSSLTrustStore::createDirectory(pemFile.string(), directory.string()) > 0)
+    {
+        measure("directory", [&](ofSSLTrustStore& store) {
+            return store.loadDirectory(directory.string());
+        });
+    }
+}
+
+
+void ofApp::benchmarkHandshakes()
+{
+    const std::size_t count = 400;
+
+    Poco::Net::Context::Ptr clientContext = ofSSLManager::getDefaultClientContext();
+
+    auto report = [&](const std::string& name,
+                      const std::string& keyType,
+                      std::size_t threadCount,
+                      bool resume,
+                      const HandshakeResult& result)
+    {
+        double handshakesPerSecond = result.count / result.seconds;
+
+        std::stringstream ss;
+        ss << name << " " << keyType << " x" << threadCount;
+
+        std::stringstream line;
+        line << format(ss.str(), handshakesPerSecond, 1, "handshakes/s");
+        line << " p50 " << std::setprecision(0) << percentile(result.latencies, 0.5);
+        line << " p99 " << percentile(result.latencies, 0.99) << " us";
+        line << " (" << result.reused << "/" << result.count << " resumed)";
+
+        record(line.str(), {
+            { "benchmark", "handshake" },
+            { "name", name },
+            { "keyType", keyType },
+            { "threads", threadCount },
+            { "resume", resume },
+            { "handshakes", result.count },
+            { "resumed", result.reused },
+            { "handshakesPerSecond", handshakesPerSecond },
+            { "p50Microseconds", percentile(result.latencies, 0.50) },
+            { "p90Microseconds", percentile(result.latencies, 0.90) },
+            { "p99Microseconds", percentile(result.latencies, 0.99) },
+            { "maxMicroseconds", percentile(result.latencies, 1.00) }
+        });
+    };
+
+    for (KeyType keyType: { RSA_2048, ECDSA_P256 })
+    {
+        useKeyType(keyType);
+
+        LoopbackServer server(ofSSLManager::getDefaultServerContext(), threadCounts.back());
+
+        for (std::size_t threadCount: threadCounts)
+        {
+            for (bool resume: { false, true })
+            {
+                HandshakeResult result = runHandshakes(server.address(),
+                                                       clientContext,
+                                                       std::max<std::size_t>(1, count / threadCount),
+                                                       threadCount,
+                                                       resume);
+
+                report(resume ? "Resumed" : "Full", to_string(keyType), threadCount, resume, result);
+            }
+        }
+    }
+
+    // Full handshakes with the default Server Context sharded across the
+    // server threads, so that concurrent handshakes do not contend on a
+    // single SSL_CTX.
+    useKeyType(ECDSA_P256);
+    ofSSLManager::setServerContextShardCount(threadCounts.back());
+
+    {
+        LoopbackServer server(&ofSSLManager::getDefaultServerContext, threadCounts.back());
+
+        for (std::size_t threadCount: threadCounts)
+        {
+            HandshakeResult result = runHandshakes(server.address(),
+                                                   clientContext,
+                                                   std::max<std::size_t>(1, count / threadCount),
+                                                   threadCount,
+                                                   false);
+
+            report("Full sharded", to_string(ECDSA_P256), threadCount, false, result);
+        }
+    }
+
+    ofSSLManager::setServerContextShardCount(1);
+
+    useKeyType(RSA_2048);
+
+    // A second server context that shares only the session ticket keys with
+    // the default server context, as another worker process would.
+    Poco::Net::Context::Ptr workerContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                                   privateKeyFile(RSA_2048),
+                                                                   certificateFile(RSA_2048),
+                                                                   "",
+                                                                   Poco::Net::Context::VERIFY_NONE);
+    workerContext->enableSessionCache(false, ofSSLManager::SESSION_ID_CONTEXT);
+    ofSSLManager::getServerSessionTicketKeys().attach(workerContext);
+
+    LoopbackServer server(ofSSLManager::getDefaultServerContext());
+    LoopbackServer worker(workerContext);
+
+    HandshakeResult result = runHandshakes(worker.address(),
+                                           clientContext,
+                                           count,
+                                           firstSession(server.address(), clientContext));
+
+    std::sort(result.latencies.begin(), result.latencies.end());
+
+    report("Resumed on another worker", to_string(RSA_2048), 1, true, result);
+}
+
+
+void ofApp::benchmarkGetters()
+{
+    const std::chrono::milliseconds duration(500);
+
+    // Initialize the default Client Context before measuring.
+    ofSSLManager::getDefaultClientContext();
+
+    auto measure = [&](const std::string& name,
+                       std::size_t threadCount,
+                       std::function<Poco::Net::Context::Ptr()> get)
+    {
+        std::atomic<bool> running(true);
+        std::atomic<uint64_t> calls(0);
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([&]() {
+                uint64_t count = 0;
+
+                while (running.load(std::memory_order_relaxed))
+                {
+                    Poco::Net::Context::Ptr pContext = get();
+                    ++count;
+                }
+
+                calls += count;
+            });
+        }
+
+        std::this_thread::sleep_for(duration);
+        running = false;
+
+        for (auto& thread: threads)
+            thread.join();
+
+        double callsPerSecond = calls / std::chrono::duration<double>(duration).count();
+
+        record(format(name + " x" + std::to_string(threadCount), callsPerSecond / 1000000, 1, "M calls/s"), {
+            { "benchmark", "getter" },
+            { "name", name },
+            { "threads", threadCount },
+            { "callsPerSecond", callsPerSecond }
+        });
+    };
+
+    for (std::size_t threadCount: threadCounts)
+    {
+        measure("ofSSLManager getter", threadCount, []() {
+            return ofSSLManager::getDefaultClientContext();
+        });
+
+        measure("Poco SSLManager getter", threadCount, []() {
+            return Poco::Net::SSLManager::instance().defaultClientContext();
+        });
+    }
+}
+
+
+void ofApp::benchmarkServerNames()
+{
+    const std::size_t hostCount = 1000;
+    const std::size_t lookupCount = 1000000;
+    const std::size_t selectionCount = 100;
+
+    // Create a host directory for each host name, plus a wildcard.
+    std::filesystem::path directory = ofToDataPath("benchmark/hosts", true);
+
+    for (std::size_t i = 0; i <= hostCount; ++i)
+    {
+        std::string name = i < hostCount ? "host" + std::to_string(i) + ".example.com" : "_.example.org";
+        std::filesystem::path hostDirectory = directory / name;
+
+        if (std::filesystem::exists(hostDirectory))
+            continue;
+
+        std::filesystem::create_directories(hostDirectory);
+        std::filesystem::copy_file(privateKeyFile(RSA_2048), hostDirectory / ofSSLCertificateStore::PRIVATE_KEY_FILE);
+        std::filesystem::copy_file(certificateFile(RSA_2048), hostDirectory / ofSSLCertificateStore::CERTIFICATE_FILE);
+    }
+
+    auto report = [&](const std::string& name, double seconds, std::size_t count)
+    {
+        double nanoseconds = seconds * 1000000000 / count;
+
+        record(format(name, nanoseconds, 1, "ns"), {
+            { "benchmark", "serverName" },
+            { "name", name },
+            { "hosts", hostCount },
+            { "nanoseconds", nanoseconds }
+        });
+    };
+
+    ofSSLCertificateStore store;
+
+    auto start = Clock::now();
+    store.setDirectory(directory.string());
+    report("SNI index", secondsSince(start), 1);
+
+    std::vector<std::string> hostNames;
+
+    for (std::size_t i = 0; i < selectionCount; ++i)
+        hostNames.push_back("host" + std::to_string(i * (hostCount / selectionCount)) + ".example.com");
+
+    std::size_t found = 0;
+
+    start = Clock::now();
+
+    for (std::size_t i = 0; i < lookupCount; ++i)
+        found += store.find(hostNames[i % hostNames.size()]).size();
+
+    report("SNI lookup (exact)", secondsSince(start), lookupCount);
+
+    start = Clock::now();
+
+    for (std::size_t i = 0; i < lookupCount; ++i)
+        found += store.find("www.example.org").size();
+
+    report("SNI lookup (wildcard)", secondsSince(start), lookupCount);
+
+    ofLogVerbose("ofApp::benchmarkServerNames") << found;
+
+    start = Clock::now();
+
+    for (const auto& hostName: hostNames)
+        store.getContext(hostName);
+
+    report("SNI selection (cold)", secondsSince(start), hostNames.size());
+
+    start = Clock::now();
+
+    for (std::size_t i = 0; i < lookupCount; ++i)
+        store.getContext(hostNames[i % hostNames.size()]);
+
+    report("SNI selection (warm)", secondsSince(start), lookupCount);
+}
+
+
+void ofApp::benchmarkBulkTransfer()
+{
+    const std::size_t megabytes = 256;
+    const std::size_t total = megabytes * 1024 * 1024;
+    const std::size_t bufferSize = 16384;
+
+    for (auto profile: { ofSSLManager::PROFILE_AES, ofSSLManager::PROFILE_CHACHA20 })
+    {
+        Poco::Net::Context::Ptr serverContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                                       privateKeyFile(ECDSA_P256),
+                                                                       certificateFile(ECDSA_P256),
+                                                                       "",
+                                                                       Poco::Net::Context::VERIFY_NONE);
+
+        Poco::Net::Context::Ptr clientContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
+                                                                       "",
+                                                                       Poco::Net::Context::VERIFY_NONE);
+
+        ofSSLManager::applyPerformanceProfile(serverContext, profile);
+        ofSSLManager::applyPerformanceProfile(clientContext, profile);
+
+        Poco::Net::SecureServerSocket serverSocket(Poco::Net::SocketAddress("127.0.0.1", 0), 1, serverContext);
+
+        std::thread receiver([&]() {
+            try
+            {
+                if (!serverSocket.poll(Poco::Timespan(10, 0), Poco::Net::Socket::SELECT_READ))
+                    return;
+
+                Poco::Net::SecureStreamSocket socket(serverSocket.acceptConnection());
+                socket.completeHandshake();
+
+                std::vector<char> buffer(bufferSize);
+                std::size_t received = 0;
+
+                while (received < total)
+                {
+                    int n = socket.receiveBytes(buffer.data(), static_cast<int>(buffer.size()));
+
+                    if (n <= 0)
+                        break;
+
+                    received += n;
+                }
+
+                char c = 'x';
+                socket.sendBytes(&c, 1);
+                socket.close();
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogError("ofApp::benchmarkBulkTransfer") << exc.displayText();
+            }
+        });
+
+        double megabytesPerSecond = 0;
+
+        try
+        {
+            Poco::Net::SecureStreamSocket socket(serverSocket.address(), "localhost", clientContext);
+            socket.completeHandshake();
+
+            std::vector<char> buffer(bufferSize, 'x');
+
+            auto start = Clock::now();
+
+            for (std::size_t sent = 0; sent < total; )
+                sent += socket.sendBytes(buffer.data(), static_cast<int>(std::min(buffer.size(), total - sent)));
+
+            // Wait until the receiver has decrypted everything.
+            char c = 0;
+            socket.receiveBytes(&c, 1);
+
+            megabytesPerSecond = megabytes / secondsSince(start);
+
+            socket.close();
+        }
+        catch (const Poco::Exception& exc)
+        {
+            ofLogError("ofApp::benchmarkBulkTransfer") << exc.displayText();
+        }
+
+        receiver.join();
+
+        std::string name = ofSSLManager::to_string(profile);
+
+        record(format("Bulk transfer (" + name + ")", megabytesPerSecond, 1, "MB/s"), {
+            { "benchmark", "bulkTransfer" },
+            { "name", name },
+            { "megabytes", megabytes },
+            { "megabytesPerSecond", megabytesPerSecond }
+        });
+    }
+}
+
+
+void ofApp::benchmarkKernelTLS()
+{
+    const std::size_t megabytes = 256;
+    const std::size_t total = megabytes * 1024 * 1024;
+    const std::size_t bufferSize = 65536;
+
+    std::string file = ofToDataPath("benchmark/bulk.bin", true);
+
+    if (!std::filesystem::exists(file) || std::filesystem::file_size(file) != total)
+    {
+        std::ofstream stream(file, std::ios::binary);
+        std::vector<char> buffer(bufferSize, 'x');
+
+        for (std::size_t written = 0; written < total; written += buffer.size())
+            stream.write(buffer.data(), buffer.size());
+    }
+
+    for (bool kernelTLS: { false, true })
+    {
+        // AES-GCM is supported by every kernel with the tls module.
+        Poco::Net::Context::Ptr serverContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                                       privateKeyFile(ECDSA_P256),
+                                                                       certificateFile(ECDSA_P256),
+                                                                       "",
+                                                                       Poco::Net::Context::VERIFY_NONE);
+
+        Poco::Net::Context::Ptr clientContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
+                                                                       "",
+                                                                       Poco::Net::Context::VERIFY_NONE);
+
+        ofSSLManager::applyPerformanceProfile(serverContext, ofSSLManager::PROFILE_AES);
+        ofSSLManager::applyPerformanceProfile(clientContext, ofSSLManager::PROFILE_AES);
+
+        if (kernelTLS)
+            ofSSLKernelTLS::enable(serverContext);
+
+        Poco::Net::SecureServerSocket serverSocket(Poco::Net::SocketAddress("127.0.0.1", 0), 1, serverContext);
+
+        std::atomic<bool> offloaded(false);
+
+        std::thread sender([&]() {
+            try
+            {
+                if (!serverSocket.poll(Poco::Timespan(10, 0), Poco::Net::Socket::SELECT_READ))
+                    return;
+
+                Poco::Net::SecureStreamSocket socket(serverSocket.acceptConnection());
+                socket.completeHandshake();
+
+                offloaded = ofSSLKernelTLS::isSendOffloaded(socket);
+
+                ofSSLKernelTLS::sendFile(socket, file);
+
+                char c = 0;
+                socket.receiveBytes(&c, 1);
+                socket.close();
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogError("ofApp::benchmarkKernelTLS") << exc.displayText();
+            }
+        });
+
+        double megabytesPerSecond = 0;
+
+        try
+        {
+            Poco::Net::SecureStreamSocket socket(serverSocket.address(), "localhost", clientContext);
+            socket.completeHandshake();
+
+            std::vector<char> buffer(bufferSize);
+            std::size_t received = 0;
+
+            auto start = Clock::now();
+
+            while (received < total)
+            {
+                int n = socket.receiveBytes(buffer.data(), static_cast<int>(buffer.size()));
+
+                if (n <= 0)
+                    break;
+
+                received += n;
+            }
+
+            megabytesPerSecond = received / (1024.0 * 1024.0) / secondsSince(start);
+
+            char c = 'x';
+            socket.sendBytes(&c, 1);
+            socket.close();
+        }
+        catch (const Poco::Exception& exc)
+        {
+            ofLogError("ofApp::benchmarkKernelTLS") << exc.displayText();
+        }
+
+        sender.join();
+
+        std::string name = kernelTLS ? (offloaded ? "kTLS" : "kTLS unavailable") : "userspace";
+
+        record(format("File transfer (" + name + ")", megabytesPerSecond, 1, "MB/s"), {
+            { "benchmark", "kernelTLS" },
+            { "name", name },
+            { "kernelTLS", kernelTLS },
+            { "offloaded", offloaded.load() },
+            { "megabytes", megabytes },
+            { "megabytesPerSecond", megabytesPerSecond }
+        });
+    }
+}
+
+
+void ofApp::benchmarkAllocations()
+{
+    const std::size_t count = 4000;
+    const std::size_t threadCount = threadCounts.back();
+
+    useKeyType(ECDSA_P256);
+
+    Poco::Net::Context::Ptr clientContext = ofSSLManager::getDefaultClientContext();
+
+    ofSSLAllocator::resetPeaks();
+
+    HandshakeResult result;
+
+    {
+        // Every connection allocates and frees OpenSSL's per-connection state
+        // and record buffers on the server and client threads.
+        LoopbackServer server(ofSSLManager::getDefaultServerContext(), threadCount);
+
+        result = runHandshakes(server.address(),
+                               clientContext,
+                               std::max<std::size_t>(1, count / threadCount),
+                               threadCount,
+                               false);
+    }
+
+    double connectionsPerSecond = result.count / result.seconds;
+    std::size_t residentBytes = residentSetSize();
+    std::string allocator = ofSSLAllocator::isInstalled() ? "pooled" : "system";
+
+    std::stringstream line;
+    line << format("Connections (" + allocator + " allocator)", connectionsPerSecond, 1, "connections/s");
+    line << " RSS " << residentBytes / (1024 * 1024) << " MB";
+
+    ofJson usage = ofJson::object();
+
+    for (int i = 0; i < ofSSLAllocator::CATEGORY_COUNT; ++i)
+    {
+        auto category = static_cast<ofSSLAllocator::Category>(i);
+        ofSSLAllocator::Usage categoryUsage = ofSSLAllocator::getUsage(category);
+
+        usage[ofSSLAllocator::to_string(category)] = {
+            { "bytesInUse", categoryUsage.bytesInUse },
+            { "peakBytesInUse", categoryUsage.peakBytesInUse },
+            { "allocations", categoryUsage.allocations }
+        };
+    }
+
+    record(line.str(), {
+        { "benchmark", "allocations" },
+        { "allocator", allocator },
+        { "threads", threadCount },
+        { "connections", result.count },
+        { "connectionsPerSecond", connectionsPerSecond },
+        { "residentBytes", residentBytes },
+        { "pooledBytes", ofSSLAllocator::getPooledBytes() },
+        { "usage", usage }
+    });
+}
+
+
+void ofApp::benchmarkIdleConnections()
+{
+    std::size_t count = 10000;
+
+#if !defined(_WIN32)
+    // Each loopback connection uses two file descriptors.
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+
+        std::size_t maximum = limit.rlim_cur > 512 ? (limit.rlim_cur - 256) / 2 : 0;
+
+        if (maximum < count)
+        {
+            ofLogWarning("ofApp::benchmarkIdleConnections") << "Limited to " << maximum << " connections by the open file limit.";
+            count = maximum;
+        }
+    }
+#endif
+
+    if (count == 0)
+        return;
+
+    // The low memory mode runs first, so that the other run cannot reuse
+    // memory it freed.
+    for (bool lowMemory: { true, false })
+    {
+        Poco::Net::Context::Ptr serverContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                                       privateKeyFile(ECDSA_P256),
+                                                                       certificateFile(ECDSA_P256),
+                                                                       "",
+                                                                       Poco::Net::Context::VERIFY_NONE);
+
+        Poco::Net::Context::Ptr clientContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
+                                                                       "",
+                                                                       Poco::Net::Context::VERIFY_NONE);
+
+        if (lowMemory)
+        {
+            ofSSLManager::applyLowMemoryMode(serverContext, ofSSLManager::DEFAULT_LOW_MEMORY_FRAGMENT_LENGTH);
+            ofSSLManager::applyLowMemoryMode(clientContext, ofSSLManager::DEFAULT_LOW_MEMORY_FRAGMENT_LENGTH);
+        }
+
+        std::size_t residentBefore = residentSetSize();
+        std::size_t residentAfter = 0;
+        std::size_t opened = 0;
+
+        {
+            Poco::Net::SecureServerSocket serverSocket(Poco::Net::SocketAddress("127.0.0.1", 0), 1024, serverContext);
+
+            std::vector<Poco::Net::SecureStreamSocket> accepted;
+            std::vector<Poco::Net::SecureStreamSocket> connected;
+            accepted.reserve(count);
+            connected.reserve(count);
+
+            std::thread acceptor([&]() {
+                try
+                {
+                    while (accepted.size() < count && serverSocket.poll(Poco::Timespan(10, 0), Poco::Net::Socket::SELECT_READ))
+                    {
+                        Poco::Net::SecureStreamSocket socket(serverSocket.acceptConnection());
+                        socket.completeHandshake();
+
+                        char c = 0;
+
+                        if (socket.receiveBytes(&c, 1) == 1)
+                            socket.sendBytes(&c, 1);
+
+                        accepted.push_back(socket);
+                    }
+                }
+                catch (const Poco::Exception& exc)
+                {
+                    ofLogError("ofApp::benchmarkIdleConnections") << exc.displayText();
+                }
+            });
+
+            try
+            {
+                // A byte is echoed on each connection, so that it is idle
+                // once the handshake and the session tickets are processed.
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    Poco::Net::SecureStreamSocket socket(serverSocket.address(), "localhost", clientContext);
+                    socket.completeHandshake();
+
+                    char c = 'x';
+                    socket.sendBytes(&c, 1);
+                    socket.receiveBytes(&c, 1);
+
+                    connected.push_back(socket);
+                }
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogError("ofApp::benchmarkIdleConnections") << exc.displayText();
+            }
+
+            acceptor.join();
+
+            opened = std::min(accepted.size(), connected.size());
+            residentAfter = residentSetSize();
+        }
+
+        // Both ends of each connection are in this process.
+        double bytesPerConnection = opened > 0 && residentAfter > residentBefore ? double(residentAfter - residentBefore) / opened : 0;
+
+        std::string name = lowMemory ? "low memory" : "default";
+
+        std::stringstream line;
+        line << format("Idle connections (" + name + ")", bytesPerConnection / 1024, 1, "KB/connection");
+        line << " x" << opened;
+
+        record(line.str(), {
+            { "benchmark", "idleConnections" },
+            { "name", name },
+            { "lowMemory", lowMemory },
+            { "connections", opened },
+            { "residentBytesBefore", residentBefore },
+            { "residentBytesAfter", residentAfter },
+            { "bytesPerConnection", bytesPerConnection }
+        });
+    }
+}
+
+
+void ofApp::benchmarkConnectionPool()
+{
+    const std::size_t count = 2000;
+
+    EchoServer server(ofSSLManager::getDefaultServerContext());
+    uint16_t port = server.address().port();
+
+    ofSSLConnectionPool& pool = ofSSLManager::getClientConnectionPool();
+
+    for (bool pooled: { false, true })
+    {
+        std::vector<double> latencies;
+
+        pool.clear();
+        pool.resetCounters();
+
+        if (pooled)
+        {
+            pool.prewarm("localhost", port);
+
+            // Let the pool make its first connections.
+            auto deadline = Clock::now() + std::chrono::seconds(5);
+
+            while (pool.size("localhost", port) < pool.getMinimumSize() && Clock::now() < deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        try
+        {
+            Poco::Net::SocketAddress address("localhost", port);
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                auto requestStart = Clock::now();
+                char c = 'x';
+
+                if (pooled)
+                {
+                    Poco::Net::SecureStreamSocket socket = pool.acquire("localhost", port);
+                    socket.sendBytes(&c, 1);
+                    socket.receiveBytes(&c, 1);
+                    pool.release("localhost", port, socket);
+                }
+                else
+                {
+                    // A new connection per request, resuming the session.
+                    Poco::Net::SecureStreamSocket socket(address,
+                                                         "localhost",
+                                                         ofSSLManager::getDefaultClientContext(),
+                                                         ofSSLManager::getClientSession("localhost", port));
+                    socket.sendBytes(&c, 1);
+                    socket.receiveBytes(&c, 1);
+                    ofSSLManager::setClientSession("localhost", port, socket.currentSession());
+                    socket.close();
+                }
+
+                latencies.push_back(secondsSince(requestStart) * 1000000);
+            }
+        }
+        catch (const Poco::Exception& exc)
+        {
+            ofLogError("ofApp::benchmarkConnectionPool") << exc.displayText();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+
+        double p50 = percentile(latencies, 0.50);
+        double p99 = percentile(latencies, 0.99);
+
+        std::string name = pooled ? "pooled" : "new connection";
+
+        std::stringstream line;
+        line << format("Request latency (" + name + ")", p50, 1, "us p50");
+        line << " " << std::fixed << std::setprecision(1) << p99 << " us p99";
+
+        record(line.str(), {
+            { "benchmark", "connectionPool" },
+            { "name", name },
+            { "pooled", pooled },
+            { "requests", latencies.size() },
+            { "p50Microseconds", p50 },
+            { "p99Microseconds", p99 },
+            { "poolHits", pool.getHits() },
+            { "poolMisses", pool.getMisses() }
+        });
+    }
+
+    // Closing the pooled connections lets the server threads finish.
+    pool.clear();
+}
+
+
+void ofApp::benchmarkBatchVerification()
+{
+    const std::size_t count = 10000;
+
+    // Verify the CA bundle's own certificates, as a nightly audit would.
+    std::filesystem::path pemFile = ofToDataPath(ofSSLManager::DEFAULT_CA_LOCATION, true);
+
+    if (!std::filesystem::exists(pemFile))
+        pemFile = ofToDataPath("../../../shared/data/" + ofSSLManager::DEFAULT_CA_LOCATION, true);
+
+    std::string bundle = ofBufferFromFile(pemFile.string()).getText();
+
+    const std::string end = "-----END CERTIFICATE-----";
+    std::vector<std::string> bundleCertificates;
+    std::size_t position = 0;
+
+    for (;;)
+    {
+        std::size_t begin = bundle.find("-----BEGIN CERTIFICATE-----", position);
+
+        if (begin == std::string::npos)
+            break;
+
+        position = bundle.find(end, begin);
+
+        if (position == std::string::npos)
+            break;
+
+        position += end.size();
+        bundleCertificates.push_back(bundle.substr(begin, position - begin));
+    }
+
+    // Add an untrusted certificate so that failures are measured too.
+    bundleCertificates.push_back(ofBufferFromFile(certificateFile(RSA_2048)).getText());
+
+    if (bundleCertificates.size() < 2)
+    {
+        ofLogWarning("ofApp::benchmarkBatchVerification") << "No certificates in " << pemFile.string();
+        return;
+    }
+
+    std::vector<std::string> certificates;
+
+    for (std::size_t i = 0; i < count; ++i)
+        certificates.push_back(bundleCertificates[i % bundleCertificates.size()]);
+
+    // The trust store is shared with the default Client Context, which
+    // trusts the loopback certificates, so use a store with the bundle only.
+    ofSSLTrustStore::Ptr pTrustStore = new ofSSLTrustStore();
+    pTrustStore->loadPEM(pemFile.string());
+
+    ofSSLCertificateVerifier verifier;
+    verifier.setTrustStore(pTrustStore);
+
+    // Decode the bundle's certificates before measuring.
+    verifier.verify(bundleCertificates);
+
+    {
+        // The one at a time baseline: a Poco certificate and a formatted
+        // description of each, without verification.
+        auto start = Clock::now();
+        std::size_t characters = 0;
+
+        for (const auto& certificate: certificates)
+        {
+            std::istringstream input(certificate);
+            Poco::Net::X509Certificate x509(input);
+            characters += x509.subjectName().size() + x509.issuerName().size() + x509.commonName().size();
+            characters += Poco::DateTimeFormatter::format(x509.expiresOn(), "%dd %H:%M:%S.%i").size();
+        }
+
+        double certificatesPerSecond = count / secondsSince(start);
+
+        record(format("Certificates (Poco, 1 thread)", certificatesPerSecond, 0, "certificates/s"), {
+            { "benchmark", "batchVerification" },
+            { "name", "poco" },
+            { "threads", 1 },
+            { "certificates", count },
+            { "certificatesPerSecond", certificatesPerSecond },
+            { "characters", characters }
+        });
+    }
+
+    for (std::size_t threadCount: threadCounts)
+    {
+        verifier.setThreadCount(threadCount);
+        verifier.resetCounters();
+
+        auto start = Clock::now();
+        std::vector<ofSSLCertificateVerifier::Result> verified = verifier.verify(certificates);
+        double certificatesPerSecond = verified.size() / secondsSince(start);
+
+        record(format("Certificates verified (" + std::to_string(threadCount) + " threads)", certificatesPerSecond, 0, "certificates/s"), {
+            { "benchmark", "batchVerification" },
+            { "name", "verifier" },
+            { "threads", threadCount },
+            { "certificates", verified.size() },
+            { "certificatesPerSecond", certificatesPerSecond },
+            { "verified", verifier.getVerified() },
+            { "failed", verifier.getFailed() },
+            { "unreadable", verifier.getUnreadable() }
+        });
+    }
+}
+
+
+void ofApp::record(const std::string& line, const ofJson& result)
+{
+    results.push_back(line);
+    json["results"].push_back(result);
+}
+
+
+std::string ofApp::to_string(KeyType keyType)
+{
+    switch (keyType)
+    {
+        case RSA_2048:
+            return "RSA-2048";
+        case ECDSA_P256:
+            return "ECDSA-P256";
+    }
+
+    return "UNKNOWN";
+}
+
+
+std::string ofApp::privateKeyFile(KeyType keyType)
+{
+    return ofToDataPath("benchmark/" + to_string(keyType) + "/privateKey.pem", true);
+}
+
+
+std::string ofApp::certificateFile(KeyType keyType)
+{
+    return ofToDataPath("benchmark/" + to_string(keyType) + "/certificate.pem", true);
+}
+
+
+void ofApp::useKeyType(KeyType keyType)
+{
+    std::filesystem::path defaultPrivateKeyFile = ofToDataPath(ofSSLManager::DEFAULT_PRIVATE_KEY_FILE, true);
+    std::filesystem::path defaultCertificateFile = ofToDataPath(ofSSLManager::DEFAULT_CERTIFICATE_FILE, true);
+
+    std::filesystem::create_directories(defaultPrivateKeyFile.parent_path());
+    std::filesystem::copy_file(privateKeyFile(keyType), defaultPrivateKeyFile, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::copy_file(certificateFile(keyType), defaultCertificateFile, std::filesystem::copy_options::overwrite_existing);
+
+    ofSSLManager::reloadServerContext();
+}
+
+
+void ofApp::createSelfSignedCertificate(const std::string& privateKeyFile,
+                                        const std::string& certificateFile,
+                                        KeyType keyType)
+{
+    std::filesystem::create_directories(std::filesystem::path(privateKeyFile).parent_path());
+    std::filesystem::create_directories(std::filesystem::path(certificateFile).parent_path());
+
+    EVP_PKEY* pKey = nullptr;
+    EVP_PKEY_CTX* pKeyContext = nullptr;
+
+    if (keyType == ECDSA_P256)
+    {
+        pKeyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+        EVP_PKEY_keygen_init(pKeyContext);
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pKeyContext, NID_X9_62_prime256v1);
+    }
+    else
+    {
+        pKeyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        EVP_PKEY_keygen_init(pKeyContext);
+        EVP_PKEY_CTX_set_rsa_keygen_bits(pKeyContext, 2048);
+    }
+
+    EVP_PKEY_keygen(pKeyContext, &pKey);
+    EVP_PKEY_CTX_free(pKeyContext);
+
+    X509* pCertificate = X509_new();
+    X509_set_version(pCertificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(pCertificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(pCertificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(pCertificate), 60 * 60 * 24 * 365);
+    X509_set_pubkey(pCertificate, pKey);
+
+    X509_NAME* pName = X509_get_subject_name(pCertificate);
+    X509_NAME_add_entry_by_txt(pName, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(pCertificate, pName);
+    X509_sign(pCertificate, pKey, EVP_sha256());
+
+    FILE* pFile = std::fopen(privateKeyFile.c_str(), "wb");
+
+    if (pFile != nullptr)
+    {
+        PEM_write_PrivateKey(pFile, pKey, nullptr, nullptr, 0, nullptr, nullptr);
+        std::fclose(pFile);
+    }
+
+    pFile = std::fopen(certificateFile.c_str(), "wb");
+
+    if (pFile != nullptr)
+    {
+        PEM_write_X509(pFile, pCertificate);
+        std::fclose(pFile);
+    }
+
+    X509_free(pCertificate);
+    EVP_PKEY_free(pKey);
+
+    ofLogNotice("ofApp::createSelfSignedCertificate") << "Created " << certificateFile;
+}
@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include "ofMain.h"
+#include "Poco/Net/Context.h"
+
+
+/// \brief A benchmark suite for ofxSSLManager.
+///
+/// The suite runs once in setup().  Results are displayed, logged and saved
+/// as JSON to bin/data/benchmark.json so that they can be tracked over time.
+/// Run with `--no-window` to exit when the suite is finished, e.g. in CI.
+class ofApp: public ofBaseApp
+{
+public:
+    /// \brief The key types used by the loopback server.
+    enum KeyType
+    {
+        RSA_2048,
+        ECDSA_P256
+    };
+
+    /// \brief Create the benchmark app.
+    /// \param exitWhenFinished True to exit after the suite has run.
+    ofApp(bool exitWhenFinished = false);
+
+    void setup() override;
+    void draw() override;
+
+    /// \brief Measure client and server Context construction.
+    void benchmarkContexts();
+
+    /// \brief Measure cold-start trust store loading from each CA format.
+    void benchmarkTrustStores();
+
+    /// \brief Measure full and resumed handshakes across key types and threads.
+    void benchmarkHandshakes();
+
+    /// \brief Measure default context getter throughput across threads.
+    void benchmarkGetters();
+
+    /// \brief Measure SNI lookups and cold and warm certificate selection.
+    void benchmarkServerNames();
+
+    /// \brief Measure bulk transfer throughput for each performance profile.
+    void benchmarkBulkTransfer();
+
+    /// \brief Measure file serving throughput with and without kernel TLS.
+    void benchmarkKernelTLS();
+
+    /// \brief Measure connection throughput and memory with the current allocator.
+    void benchmarkAllocations();
+
+    /// \brief Measure the memory used by idle connections with and without
+    ///        the low memory mode.
+    void benchmarkIdleConnections();
+
+    /// \brief Measure request latency with and without the connection pool.
+    void benchmarkConnectionPool();
+
+    /// \brief Measure batch certificate verification throughput across threads.
+    void benchmarkBatchVerification();
+
+    /// \brief Add a result.
+    /// \param line The result to display.
+    /// \param result The machine-readable result.
+    void record(const std::string& line, const ofJson& result);
+
+    /// \returns the name of a key type.
+    static std::string to_string(KeyType keyType);
+
+    /// \returns the private key file for a key type.
+    static std::string privateKeyFile(KeyType keyType);
+
+    /// \returns the certificate file for a key type.
+    static std::string certificateFile(KeyType keyType);
+
+    /// \brief Create a self-signed certificate for the loopback server.
+    static void createSelfSignedCertificate(const std::string& privateKeyFile,
+                                            const std::string& certificateFile,
+                                            KeyType keyType);
+
+    /// \brief Make the default Server Context use a key type.
+    ///
+    /// The key type's key and certificate are copied to the default server
+    /// files and the default Server Context is reloaded.
+    static void useKeyType(KeyType keyType);
+
+    /// \brief The client thread counts to measure.
+    std::vector<std::size_t> threadCounts;
+
+    /// \brief True to exit after the suite has run.
+    bool exitWhenFinished = false;
+
+    /// \brief The results to display.
+    std::vector<std::string> results;
+
+    /// \brief The machine-readable results.
+    ofJson json;
+
+};
@@ -0,0 +1,768 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofApp.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <openssl/evp.h>
+#include <openssl/ocsp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include "Poco/StreamCopier.h"
+#include "Poco/Net/HTTPRequestHandler.h"
+#include "Poco/Net/HTTPRequestHandlerFactory.h"
+#include "Poco/Net/HTTPServer.h"
+#include "Poco/Net/HTTPServerParams.h"
+#include "Poco/Net/HTTPServerRequest.h"
+#include "Poco/Net/HTTPServerResponse.h"
+#include "Poco/Net/SecureStreamSocket.h"
+#include "Poco/Net/ServerSocket.h"
+#include "ofSSLManager.h"
+
+
+namespace
+{
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+/// \brief A loopback server that completes handshakes and closes each
+///        connection.
+class LoopbackServer
+{
+public:
+    /// \brief Accept connections with the default Server Context.
+    LoopbackServer():
+        LoopbackServer(nullptr)
+    {
+    }
+
+    /// \brief Accept connections with a Context.
+    LoopbackServer(Poco::Net::Context::Ptr pContext):
+        _pContext(pContext),
+        _socket(Poco::Net::SocketAddress("127.0.0.1", 0)),
+        _running(true),
+        _thread([this]() { _run(); })
+    {
+    }
+
+    ~LoopbackServer()
+    {
+        _running = false;
+        _thread.join();
+    }
+
+    Poco::Net::SocketAddress address() const
+    {
+        return _socket.address();
+    }
+
+private:
+    void _run()
+    {
+        while (_running)
+        {
+            if (!_socket.poll(Poco::Timespan(0, 100000), Poco::Net::Socket::SELECT_READ))
+                continue;
+
+            try
+            {
+                Poco::Net::Context::Ptr pContext = _pContext.isNull() ? ofSSLManager::getDefaultServerContext() : _pContext;
+                Poco::Net::SecureStreamSocket socket = Poco::Net::SecureStreamSocket::attach(_socket.acceptConnection(), pContext);
+                socket.completeHandshake();
+                socket.close();
+            }
+            catch (const Poco::Exception&)
+            {
+                // Clients reject the certificate in some checks.
+            }
+        }
+    }
+
+    Poco::Net::Context::Ptr _pContext;
+    Poco::Net::ServerSocket _socket;
+    std::atomic<bool> _running;
+    std::thread _thread;
+
+};
+
+
+/// \brief A stand-in for a policy service that decides verification errors.
+///
+/// Each request is answered by the service's own thread after a delay, as a
+/// request to a local daemon would be.  Requests still waiting when the
+/// service is destroyed are never answered.
+class PolicyService
+{
+public:
+    PolicyService(std::chrono::milliseconds delay, bool allow):
+        _delay(delay),
+        _allow(allow),
+        _thread([this]() { _run(); })
+    {
+    }
+
+    ~PolicyService()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stopping = true;
+            _condition.notify_all();
+        }
+
+        _thread.join();
+    }
+
+    std::future<bool> onSSLClientVerificationErrorAsync(const Poco::Net::VerificationErrorArgs&)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _requests.push_back({ Clock::now() + _delay, std::promise<bool>() });
+        _condition.notify_all();
+        ++_requestCount;
+        return _requests.back().decision.get_future();
+    }
+
+    /// \returns the number of requests received.
+    std::size_t requestCount()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _requestCount;
+    }
+
+private:
+    struct Request
+    {
+        Clock::time_point due;
+        std::promise<bool> decision;
+    };
+
+    void _run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (!_stopping)
+        {
+            if (_requests.empty())
+            {
+                _condition.wait(lock);
+                continue;
+            }
+
+            // Requests are due in order, as they all have the same delay.
+            if (_condition.wait_until(lock, _requests.front().due) == std::cv_status::no_timeout)
+                continue;
+
+            _requests.front().decision.set_value(_allow);
+            _requests.erase(_requests.begin());
+        }
+    }
+
+    std::chrono::milliseconds _delay;
+    bool _allow = false;
+    std::vector<Request> _requests;
+    std::size_t _requestCount = 0;
+    bool _stopping = false;
+    std::condition_variable _condition;
+    std::mutex _mutex;
+    std::thread _thread;
+
+};
+
+
+/// \brief An OCSP responder for a certificate authority.
+///
+/// Every certificate asked about is reported as good, in a response signed
+/// by the certificate authority.  The responder can be made unavailable, in
+/// which case it answers with an error, as an overloaded responder would.
+class OCSPResponder
+{
+public:
+    OCSPResponder(X509* pCertificate, EVP_PKEY* pKey):
+        _socket(Poco::Net::SocketAddress("127.0.0.1", 0)),
+        _server(new HandlerFactory(*this), _socket, new Poco::Net::HTTPServerParams)
+    {
+        X509_up_ref(pCertificate);
+        EVP_PKEY_up_ref(pKey);
+        _pCertificate = pCertificate;
+        _pKey = pKey;
+        _server.start();
+    }
+
+    ~OCSPResponder()
+    {
+        _server.stop();
+        X509_free(_pCertificate);
+        EVP_PKEY_free(_pKey);
+    }
+
+    /// \returns the URL of the responder.
+    std::string url() const
+    {
+        return "http://" + _socket.address().toString() + "/";
+    }
+
+    /// \brief Set whether requests are answered with a response.
+    void setAvailable(bool available)
+    {
+        _available = available;
+    }
+
+    /// \brief Set the time until responses expire.
+    void setValidity(std::chrono::seconds validity)
+    {
+        _validity = validity.count();
+    }
+
+    /// \returns the number of requests received.
+    std::size_t requestCount() const
+    {
+        return _requestCount;
+    }
+
+private:
+    class Handler: public Poco::Net::HTTPRequestHandler
+    {
+    public:
+        Handler(OCSPResponder& responder): _responder(responder)
+        {
+        }
+
+        void handleRequest(Poco::Net::HTTPServerRequest& request,
+                           Poco::Net::HTTPServerResponse& response) override
+        {
+            std::string body;
+            Poco::StreamCopier::copyToString(request.stream(), body);
+
+            ++_responder._requestCount;
+
+            if (!_responder._available)
+            {
+                response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+                response.send();
+                return;
+            }
+
+            std::string data = _responder._respond(body);
+
+            response.setContentType("application/ocsp-response");
+            response.setContentLength(static_cast<std::streamsize>(data.size()));
+            response.send().write(data.data(), static_cast<std::streamsize>(data.size()));
+        }
+
+    private:
+        OCSPResponder& _responder;
+
+    };
+
+    class HandlerFactory: public Poco::Net::HTTPRequestHandlerFactory
+    {
+    public:
+        HandlerFactory(OCSPResponder& responder): _responder(responder)
+        {
+        }
+
+        Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest&) override
+        {
+            return new Handler(_responder);
+        }
+
+    private:
+        OCSPResponder& _responder;
+
+    };
+
+    /// \returns the DER encoded response to a DER encoded request.
+    std::string _respond(const std::string& body) const
+    {
+        const unsigned char* pData = reinterpret_cast<const unsigned char*>(body.data());
+        OCSP_REQUEST* pRequest = d2i_OCSP_REQUEST(nullptr, &pData, static_cast<long>(body.size()));
+        OCSP_RESPONSE* pResponse = nullptr;
+
+        if (pRequest == nullptr)
+        {
+            pResponse = OCSP_response_create(OCSP_RESPONSE_STATUS_MALFORMEDREQUEST, nullptr);
+        }
+        else
+        {
+            OCSP_BASICRESP* pBasic = OCSP_BASICRESP_new();
+            ASN1_TIME* pThisUpdate = X509_gmtime_adj(nullptr, 0);
+            ASN1_TIME* pNextUpdate = X509_gmtime_adj(nullptr, _validity);
+
+            for (int i = 0; i < OCSP_request_onereq_count(pRequest); ++i)
+            {
+                OCSP_CERTID* pID = OCSP_onereq_get0_id(OCSP_request_onereq_get0(pRequest, i));
+                OCSP_basic_add1_status(pBasic, pID, V_OCSP_CERTSTATUS_GOOD, 0, nullptr, pThisUpdate, pNextUpdate);
+            }
+
+            OCSP_basic_sign(pBasic, _pCertificate, _pKey, EVP_sha256(), nullptr, 0);
+            pResponse = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, pBasic);
+
+            ASN1_TIME_free(pNextUpdate);
+            ASN1_TIME_free(pThisUpdate);
+            OCSP_BASICRESP_free(pBasic);
+            OCSP_REQUEST_free(pRequest);
+        }
+
+        std::string data;
+        int length = i2d_OCSP_RESPONSE(pResponse, nullptr);
+
+        if (length > 0)
+        {
+            data.resize(static_cast<std::size_t>(length));
+            unsigned char* pOut = reinterpret_cast<unsigned char*>(&data[0]);
+            i2d_OCSP_RESPONSE(pResponse, &pOut);
+        }
+
+        OCSP_RESPONSE_free(pResponse);
+
+        return data;
+    }
+
+    X509* _pCertificate = nullptr;
+    EVP_PKEY* _pKey = nullptr;
+    std::atomic<bool> _available { true };
+    std::atomic<long> _validity { 60 * 60 };
+    std::atomic<std::size_t> _requestCount { 0 };
+    Poco::Net::ServerSocket _socket;
+    Poco::Net::HTTPServer _server;
+
+};
+
+
+/// \brief Connect to a server with the default Client Context.
+/// \returns true if the handshake succeeded.
+bool handshake(const Poco::Net::SocketAddress& address)
+{
+    try
+    {
+        Poco::Net::SecureStreamSocket socket(address, "localhost", ofSSLManager::getDefaultClientContext());
+        socket.completeHandshake();
+        return true;
+    }
+    catch (const Poco::Exception&)
+    {
+        return false;
+    }
+}
+
+
+/// \brief Record the stapled OCSP response a client receives.
+int onOCSPStatus(SSL* ssl, void* arg)
+{
+    const unsigned char* pData = nullptr;
+    *static_cast<long*>(arg) = SSL_get_tlsext_status_ocsp_resp(ssl, &pData);
+    return 1;
+}
+
+
+/// \brief Connect to a server and ask for a stapled OCSP response.
+/// \returns the length of the stapled response, or -1 if none was stapled.
+long stapledResponseLength(const Poco::Net::SocketAddress& address)
+{
+    long length = -1;
+
+    Poco::Net::Context::Ptr pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
+                                                              "",
+                                                              "",
+                                                              "",
+                                                              Poco::Net::Context::VERIFY_NONE);
+
+    SSL_CTX* pSSLContext = pContext->sslContext();
+    SSL_CTX_set_tlsext_status_type(pSSLContext, TLSEXT_STATUSTYPE_ocsp);
+    SSL_CTX_set_tlsext_status_cb(pSSLContext, &onOCSPStatus);
+    SSL_CTX_set_tlsext_status_arg(pSSLContext, &length);
+
+    try
+    {
+        Poco::Net::SecureStreamSocket socket(address, "localhost", pContext);
+        socket.completeHandshake();
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ofLogError("stapledResponseLength") << exc.displayText();
+    }
+
+    return length;
+}
+
+
+/// \brief Create an EC P-256 key.
+/// \returns the key, to be freed with EVP_PKEY_free().
+EVP_PKEY* createKey()
+{
+    EVP_PKEY* pKey = nullptr;
+    EVP_PKEY_CTX* pKeyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY_keygen_init(pKeyContext);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pKeyContext, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(pKeyContext, &pKey);
+    EVP_PKEY_CTX_free(pKeyContext);
+    return pKey;
+}
+
+
+/// \brief Create a certificate.
+/// \param pKey The key of the certificate.
+/// \param commonName The common name of the subject.
+/// \param authority True to create a certificate authority.
+/// \param pIssuer The certificate of the issuer, or nullptr to self-sign.
+/// \param pIssuerKey The key of the issuer, or nullptr to self-sign.
+/// \returns the certificate, to be freed with X509_free().
+X509* createCertificate(EVP_PKEY* pKey,
+                        const std::string& commonName,
+                        bool authority = false,
+                        X509* pIssuer = nullptr,
+                        EVP_PKEY* pIssuerKey = nullptr)
+{
+    static std::atomic<long> serialNumber(1);
+
+    X509* pCertificate = X509_new();
+    X509_set_version(pCertificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(pCertificate), serialNumber++);
+    X509_gmtime_adj(X509_getm_notBefore(pCertificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(pCertificate), 60 * 60 * 24 * 365);
+    X509_set_pubkey(pCertificate, pKey);
+
+    X509_NAME* pName = X509_get_subject_name(pCertificate);
+    X509_NAME_add_entry_by_txt(pName, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(commonName.c_str()), -1, -1, 0);
+    X509_set_issuer_name(pCertificate, pIssuer != nullptr ? X509_get_subject_name(pIssuer) : pName);
+
+    if (authority)
+    {
+        X509_EXTENSION* pExtension = X509V3_EXT_conf_nid(nullptr, nullptr, NID_basic_constraints, "critical,CA:TRUE");
+        X509_add_ext(pCertificate, pExtension, -1);
+        X509_EXTENSION_free(pExtension);
+    }
+
+    X509_sign(pCertificate, pIssuerKey != nullptr ? pIssuerKey : pKey, EVP_sha256());
+
+    return pCertificate;
+}
+
+
+/// \brief Save a key and its certificate as PEM files.
+void save(const std::string& privateKeyFile,
+          const std::string& certificateFile,
+          EVP_PKEY* pKey,
+          X509* pCertificate)
+{
+    std::filesystem::create_directories(std::filesystem::path(privateKeyFile).parent_path());
+    std::filesystem::create_directories(std::filesystem::path(certificateFile).parent_path());
+
+    FILE* pFile = std::fopen(privateKeyFile.c_str(), "wb");
+
+    if (pFile != nullptr)
+    {
+        PEM_write_PrivateKey(pFile, pKey, nullptr, nullptr, 0, nullptr, nullptr);
+        std::fclose(pFile);
+    }
+
+    pFile = std::fopen(certificateFile.c_str(), "wb");
+
+    if (pFile != nullptr)
+    {
+        PEM_write_X509(pFile, pCertificate);
+        std::fclose(pFile);
+    }
+}
+
+
+/// \brief Wait until a condition is true.
+/// \returns true if the condition became true before the timeout.
+bool waitUntil(std::function<bool()> condition, std::chrono::milliseconds timeout)
+{
+    Clock::time_point end = Clock::now() + timeout;
+
+    while (!condition())
+    {
+        if (Clock::now() > end)
+            return false;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+
+}
+
+
+ofApp::ofApp(bool exitWhenFinished): exitWhenFinished(exitWhenFinished)
+{
+}
+
+
+void ofApp::setup()
+{
+    std::string privateKeyFile = ofToDataPath(ofSSLManager::DEFAULT_PRIVATE_KEY_FILE, true);
+    std::string certificateFile = ofToDataPath(ofSSLManager::DEFAULT_CERTIFICATE_FILE, true);
+
+    if (!std::filesystem::exists(privateKeyFile) || !std::filesystem::exists(certificateFile))
+        createSelfSignedCertificate(privateKeyFile, certificateFile);
+
+    testAsyncVerification();
+    testOCSPStapling();
+
+    ofLogNotice("ofApp::setup") << results.size() - failureCount << " of " << results.size() << " checks passed.";
+
+    if (exitWhenFinished)
+        ofExit(failureCount == 0 ? 0 : 1);
+}
+
+
+void ofApp::draw()
+{
+    ofBackgroundGradient(ofColor::white, ofColor::black);
+
+    float y = 30;
+
+    for (const auto& result: results)
+    {
+        ofDrawBitmapStringHighlight(result, ofPoint(30, y));
+        y += 20;
+    }
+}
+
+
+void ofApp::testAsyncVerification()
+{
+    // The loopback certificate is self-signed, so every handshake reports a
+    // verification error that only the policy service can allow.
+    LoopbackServer server;
+
+    // Late decisions are only used through the verification cache.
+    ofSSLManager::getVerificationCache().setMaximumSize(ofSSLVerificationCache::DEFAULT_MAXIMUM_SIZE);
+
+    const std::chrono::milliseconds timeout(200);
+
+    {
+        PolicyService service(std::chrono::milliseconds(10), true);
+        ofSSLManager::registerAsyncClientEvents(&service, timeout);
+
+        uint64_t timeoutCount = ofSSLManager::getAsyncVerificationTimeoutCount();
+
+        check("A fast decision is used", handshake(server.address()));
+        check("A fast decision does not time out", ofSSLManager::getAsyncVerificationTimeoutCount() == timeoutCount);
+
+        std::size_t requestCount = service.requestCount();
+
+        check("A fast decision is cached", handshake(server.address()) && service.requestCount() == requestCount);
+
+        ofSSLManager::unregisterAsyncClientEvents(&service);
+    }
+
+    {
+        PolicyService service(std::chrono::milliseconds(500), true);
+        ofSSLManager::registerAsyncClientEvents(&service, timeout);
+
+        uint64_t timeoutCount = ofSSLManager::getAsyncVerificationTimeoutCount();
+        std::size_t cacheSize = ofSSLManager::getVerificationCache().size();
+
+        check("A slow decision uses the default", !handshake(server.address()));
+        check("A slow decision times out", ofSSLManager::getAsyncVerificationTimeoutCount() == timeoutCount + 1);
+
+        // No handshake asks for the decision while it is late.
+        check("A late decision is cached when it arrives", waitUntil([&]() {
+            return ofSSLManager::getVerificationCache().size() > cacheSize;
+        }, std::chrono::seconds(2)));
+
+        std::size_t requestCount = service.requestCount();
+
+        check("A late decision is used", handshake(server.address()) && service.requestCount() == requestCount);
+
+        ofSSLManager::unregisterAsyncClientEvents(&service);
+    }
+
+    {
+        // The service never answers.
+        PolicyService service(std::chrono::hours(1), false);
+        ofSSLManager::registerAsyncClientEvents(&service, std::chrono::milliseconds(0), true);
+
+        Clock::time_point start = Clock::now();
+
+        check("A timeout uses the default", handshake(server.address()));
+        check("A timeout of 0 does not wait", Clock::now() - start < timeout);
+
+        std::size_t requestCount = service.requestCount();
+
+        check("A pending decision is not requested again", handshake(server.address()) && service.requestCount() == requestCount);
+
+        ofSSLManager::unregisterAsyncClientEvents(&service);
+    }
+
+    {
+        PolicyService service(std::chrono::milliseconds(10), true);
+        PolicyService other(std::chrono::milliseconds(10), true);
+        ofSSLManager::registerAsyncClientEvents(&service, timeout);
+
+        ofSSLManager::unregisterAsyncClientEvents(&other);
+        check("Unregistering another listener keeps the handler", handshake(server.address()));
+
+        ofSSLManager::unregisterAsyncClientEvents(&service);
+        check("Unregistering the listener removes the handler", !handshake(server.address()));
+    }
+
+    ofSSLManager::getVerificationCache().setMaximumSize(0);
+}
+
+
+void ofApp::testOCSPStapling()
+{
+    std::string directory = ofToDataPath("ocsp", true);
+    std::string cacheDirectory = directory + "/cache";
+
+    std::filesystem::remove_all(directory);
+
+    // A test CA issues the server certificate and signs the responses.
+    EVP_PKEY* pAuthorityKey = createKey();
+    X509* pAuthority = createCertificate(pAuthorityKey, "ofxSSLManager Test CA", true);
+    EVP_PKEY* pKey = createKey();
+    X509* pCertificate = createCertificate(pKey, "localhost", false, pAuthority, pAuthorityKey);
+
+    save(directory + "/ca.key", directory + "/ca.pem", pAuthorityKey, pAuthority);
+    save(directory + "/privateKey.pem", directory + "/certificate.pem", pKey, pCertificate);
+
+    OCSPResponder responder(pAuthority, pAuthorityKey);
+
+    X509_free(pCertificate);
+    EVP_PKEY_free(pKey);
+    X509_free(pAuthority);
+    EVP_PKEY_free(pAuthorityKey);
+
+    // The issuer is found in the trusted certificates of the Context.
+    auto createContext = [&]() -> Poco::Net::Context::Ptr {
+        return new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                      directory + "/privateKey.pem",
+                                      directory + "/certificate.pem",
+                                      directory + "/ca.pem",
+                                      Poco::Net::Context::VERIFY_NONE);
+    };
+
+    {
+        ofSSLOCSPStapler stapler;
+        stapler.setResponderURL(responder.url());
+        stapler.setCacheDirectory(cacheDirectory);
+
+        Poco::Net::Context::Ptr pContext = createContext();
+
+        check("A certificate with an issuer is attached", stapler.attach(pContext));
+        check("A response is fetched and verified", waitUntil([&]() {
+            return stapler.getFreshCount() == 1;
+        }, std::chrono::seconds(5)));
+
+        LoopbackServer server(pContext);
+
+        check("The response is stapled", stapledResponseLength(server.address()) > 0 && stapler.getStapled() == 1);
+        check("The response is saved", std::filesystem::exists(cacheDirectory) && !std::filesystem::is_empty(cacheDirectory));
+    }
+
+    responder.setAvailable(false);
+
+    {
+        // A restarted server staples the saved response.
+        ofSSLOCSPStapler stapler;
+        stapler.setResponderURL(responder.url());
+        stapler.setCacheDirectory(cacheDirectory);
+
+        Poco::Net::Context::Ptr pContext = createContext();
+        std::size_t requestCount = responder.requestCount();
+
+        stapler.attach(pContext);
+
+        LoopbackServer server(pContext);
+
+        check("A saved response is loaded", stapler.getFreshCount() == 1 && stapler.getFetches() == 0);
+        check("A saved response is stapled", stapledResponseLength(server.address()) > 0 && stapler.getStapled() == 1);
+        check("A saved response is not fetched again", responder.requestCount() == requestCount);
+    }
+
+    {
+        ofSSLOCSPStapler stapler;
+        stapler.setResponderURL(responder.url());
+        stapler.setRetryInterval(std::chrono::seconds(1));
+
+        Poco::Net::Context::Ptr pContext = createContext();
+        stapler.attach(pContext);
+
+        check("A failed fetch is retried", waitUntil([&]() {
+            return stapler.getFetchFailures() >= 2;
+        }, std::chrono::seconds(5)));
+        check("A certificate without a response is stale", stapler.getStaleCount() == 1);
+
+        LoopbackServer server(pContext);
+
+        check("Nothing is stapled without a response", stapledResponseLength(server.address()) < 0 && stapler.getNotStapled() == 1);
+    }
+
+    responder.setAvailable(true);
+    responder.setValidity(std::chrono::seconds(3));
+
+    {
+        ofSSLOCSPStapler stapler;
+        stapler.setResponderURL(responder.url());
+        stapler.setRetryInterval(std::chrono::seconds(1));
+
+        Poco::Net::Context::Ptr pContext = createContext();
+        stapler.attach(pContext);
+
+        check("A short-lived response is fetched", waitUntil([&]() {
+            return stapler.getFreshCount() == 1;
+        }, std::chrono::seconds(5)));
+
+        // The response can't be refreshed before it expires.
+        responder.setAvailable(false);
+
+        check("An expired response is stale", waitUntil([&]() {
+            return stapler.getStaleCount() == 1;
+        }, std::chrono::seconds(10)));
+
+        LoopbackServer server(pContext);
+
+        check("An expired response is not stapled", stapledResponseLength(server.address()) < 0);
+    }
+}
+
+
+void ofApp::check(const std::string& name, bool passed)
+{
+    results.push_back((passed ? "PASS " : "FAIL ") + name);
+
+    if (passed)
+    {
+        ofLogNotice("ofApp::check") << results.back();
+    }
+    else
+    {
+        ofLogError("ofApp::check") << results.back();
+        ++failureCount;
+    }
+}
+
+
+void ofApp::createSelfSignedCertificate(const std::string& privateKeyFile,
+                                        const std::string& certificateFile)
+{
+    EVP_PKEY* pKey = createKey();
+    X509* pCertificate = createCertificate(pKey, "localhost");
+
+    save(privateKeyFile, certificateFile, pKey, pCertificate);
+
+    X509_free(pCertificate);
+    EVP_PKEY_free(pKey);
+
+    ofLogNotice("ofApp::createSelfSignedCertificate") << "Created " << certificateFile;
+}
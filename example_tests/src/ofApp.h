@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include "ofMain.h"
+
+
+/// \brief Automated checks for ofxSSLManager.
+///
+/// The checks run once in setup() against loopback servers and stand-in
+/// services.  Results are displayed and logged.  Run with `--no-window` to
+/// exit when the checks are finished, e.g. in CI.  The exit code is 1 if any
+/// check failed.
+class ofApp: public ofBaseApp
+{
+public:
+    /// \brief Create the test app.
+    /// \param exitWhenFinished True to exit after the checks have run.
+    ofApp(bool exitWhenFinished = false);
+
+    void setup() override;
+    void draw() override;
+
+    /// \brief Check asynchronous verification with a stand-in policy service
+    ///        that answers quickly, slowly or not at all.
+    void testAsyncVerification();
+
+    /// \brief Check fetching, verifying, stapling, saving and expiring OCSP
+    ///        responses from an in-process responder for a test CA.
+    void testOCSPStapling();
+
+    /// \brief Record the result of a check.
+    /// \param name The name of the check.
+    /// \param passed True if the check passed.
+    void check(const std::string& name, bool passed);
+
+    /// \brief Create a self-signed certificate for the loopback server.
+    static void createSelfSignedCertificate(const std::string& privateKeyFile,
+                                            const std::string& certificateFile);
+
+    /// \brief True to exit after the checks have run.
+    bool exitWhenFinished = false;
+
+    /// \brief The results to display.
+    std::vector<std::string> results;
+
+    /// \brief The number of failed checks.
+    std::size_t failureCount = 0;
+
+};
@@ -5,9 +5,68 @@ THIS_NAME=$(basename "${BASH_SOURCE[0]%.*}")
 INSTALL_PATH=${THIS_PATH}/${THIS_NAME}
 mkdir -p ${INSTALL_PATH}
 
+# Write an unsigned 32-bit little endian integer to stdout.
+function write_uint32()
+{
+  local value=$1
+  printf "\\x$(printf %02x $((value & 0xFF)))"
+  printf "\\x$(printf %02x $(((value >> 8) & 0xFF)))"
+  printf "\\x$(printf %02x $(((value >> 16) & 0xFF)))"
+  printf "\\x$(printf %02x $(((value >> 24) & 0xFF)))"
+}
+
+# Convert a PEM CA bundle into an indexed binary bundle of DER certificates.
+# See ofSSLTrustStore::loadBinary() for the format.
+function build_binary_bundle()
+{
+  local pem_file=$1
+  local bin_file=$2
+  local work_path=$(mktemp -d)
+
+  # Split the bundle into one certificate per file.
+  awk -v dir="${work_path}" '
+    /-----BEGIN CERTIFICATE-----/ { n++; file = sprintf("%s/%05d.pem", dir, n) }
+    file { print > file }
+    /-----END CERTIFICATE-----/ { close(file); file = "" }
+  ' "${pem_file}"
+
+  for pem in "${work_path}"/*.pem; do
+    local der=${pem%.pem}.der
+    local hash=$(openssl x509 -in "${pem}" -noout -subject_hash)
+    openssl x509 -in "${pem}" -outform DER -out "${der}"
+    echo "$((16#${hash})) $(wc -c < "${der}") ${der}" >> "${work_path}/index"
+  done
+
+  sort -n -k1,1 "${work_path}/index" > "${work_path}/sorted"
+
+  local count=$(wc -l < "${work_path}/sorted")
+  local offset=$((12 + count * 12))
+
+  {
+    printf "OFCA"
+    write_uint32 1
+    write_uint32 ${count}
+
+    while read -r hash length der; do
+      write_uint32 ${hash}
+      write_uint32 ${offset}
+      write_uint32 ${length}
+      offset=$((offset + length))
+    done < "${work_path}/sorted"
+
+    while read -r hash length der; do
+      cat "${der}"
+    done < "${work_path}/sorted"
+  } > "${bin_file}"
+
+  rm -rf "${work_path}"
+}
+
 echo "Installing ${THIS_NAME} data ..."
 
 pushd ${INSTALL_PATH}/ > /dev/null
 curl --progress -LO --time-cond cacert.pem https://curl.haxx.se/ca/cacert.pem
 echo "✅ ${INSTALL_PATH}/cacert.pem"
+build_binary_bundle cacert.pem cacert.bin
+echo "✅ ${INSTALL_PATH}/cacert.bin"
 popd > /dev/null
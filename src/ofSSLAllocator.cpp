@@ -0,0 +1,586 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLAllocator.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <openssl/crypto.h>
+#include "ofLog.h"
+
+
+const std::size_t ofSSLAllocator::MAXIMUM_POOLED_SIZE = 32768;
+
+
+namespace
+{
+
+
+/// \brief The size classes, four per power of two above 128 bytes.
+const std::array<uint32_t, 40> SIZE_CLASSES = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192,
+    10240, 12288, 14336, 16384, 20480, 24576, 28672, 32768
+};
+
+
+const std::size_t CLASS_COUNT = SIZE_CLASSES.size();
+
+
+/// \brief The size class of allocations made by the system allocator.
+const uint16_t SYSTEM_CLASS = 0xffff;
+
+
+/// \brief The minimum size of the slabs pooled blocks are carved from.
+const std::size_t SLAB_SIZE = 65536;
+
+
+/// \brief The number of bytes each thread caches for a size class.
+const std::size_t THREAD_CACHE_SIZE = 32768;
+
+
+/// \brief The change in bytes in use a thread counts before publishing it.
+const int64_t ACCOUNTING_BATCH_SIZE = 65536;
+
+
+/// \brief The header in front of every allocation.
+///
+/// The header is 16 bytes, so allocations keep the alignment of malloc().
+struct alignas(16) Header
+{
+    uint64_t size;
+    uint16_t sizeClass;
+    uint8_t category;
+};
+
+
+static_assert(sizeof(Header) == 16, "The header must keep allocations aligned.");
+
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+
+/// \brief The blocks of a size class shared by all threads.
+struct Pool
+{
+    std::mutex mutex;
+    FreeBlock* head = nullptr;
+};
+
+
+/// \brief The blocks and the unpublished counts of a thread.
+struct ThreadCache
+{
+    FreeBlock* heads[CLASS_COUNT];
+    std::size_t counts[CLASS_COUNT];
+    int64_t bytesInUse[ofSSLAllocator::CATEGORY_COUNT];
+    uint64_t allocations[ofSSLAllocator::CATEGORY_COUNT];
+};
+
+
+struct alignas(64) CategoryCounters
+{
+    std::atomic<int64_t> bytesInUse;
+    std::atomic<int64_t> peakBytesInUse;
+    std::atomic<uint64_t> allocations;
+};
+
+
+std::atomic<bool> installed(false);
+std::atomic<uint64_t> pooledBytes(0);
+CategoryCounters counters[ofSSLAllocator::CATEGORY_COUNT];
+
+
+/// \brief The shared pools.
+///
+/// OpenSSL frees memory from atexit handlers and thread destructors, so the
+/// pools are never destroyed.
+Pool* pools()
+{
+    static Pool* pools = new Pool[CLASS_COUNT];
+    return pools;
+}
+
+
+std::size_t blockSize(std::size_t sizeClass)
+{
+    return sizeof(Header) + SIZE_CLASSES[sizeClass];
+}
+
+
+/// \brief The number of blocks a thread caches for a size class.
+std::size_t cacheLimit(std::size_t sizeClass)
+{
+    return std::max<std::size_t>(4, THREAD_CACHE_SIZE / blockSize(sizeClass));
+}
+
+
+uint16_t sizeClassFor(std::size_t size)
+{
+    return static_cast<uint16_t>(std::lower_bound(SIZE_CLASSES.begin(), SIZE_CLASSES.end(), size) - SIZE_CLASSES.begin());
+}
+
+
+/// \returns true iff path contains the directory name, e.g. "/ssl/".
+bool hasDirectory(const char* path, const char* name)
+{
+    std::size_t length = std::strlen(name);
+
+    for (const char* match = std::strstr(path, name); match != nullptr; match = std::strstr(match + 1, name))
+    {
+        bool start = match == path || match[-1] == '/' || match[-1] == '\\';
+        bool end = match[length] == '/' || match[length] == '\\';
+
+        if (start && end)
+            return true;
+    }
+
+    return false;
+}
+
+
+uint8_t categoryFor(const char* file)
+{
+    // The file is a string literal, so the category is cached per thread by
+    // its address.
+    struct CachedCategory
+    {
+        const char* file;
+        uint8_t category;
+    };
+
+    thread_local CachedCategory cached[256] = {};
+
+    if (file == nullptr)
+        return ofSSLAllocator::CATEGORY_OTHER;
+
+    CachedCategory& entry = cached[(reinterpret_cast<std::uintptr_t>(file) >> 4) & 0xff];
+
+    if (entry.file == file)
+        return entry.category;
+
+    uint8_t category = ofSSLAllocator::CATEGORY_OTHER;
+
+    if (*file == '\0')
+        category = ofSSLAllocator::CATEGORY_OTHER;
+    else if (hasDirectory(file, "x509") || hasDirectory(file, "asn1") || hasDirectory(file, "pem"))
+        category = ofSSLAllocator::CATEGORY_X509;
+    else if (hasDirectory(file, "ssl"))
+        category = ofSSLAllocator::CATEGORY_SSL;
+    else if (hasDirectory(file, "crypto") || hasDirectory(file, "providers"))
+        category = ofSSLAllocator::CATEGORY_CRYPTO;
+
+    entry.file = file;
+    entry.category = category;
+    return category;
+}
+
+
+void publish(uint8_t category, int64_t bytes, uint64_t allocations)
+{
+    CategoryCounters& counter = counters[category];
+
+    int64_t bytesInUse = counter.bytesInUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = counter.peakBytesInUse.load(std::memory_order_relaxed);
+
+    while (bytesInUse > peak && !counter.peakBytesInUse.compare_exchange_weak(peak, bytesInUse, std::memory_order_relaxed))
+    {
+    }
+
+    counter.allocations.fetch_add(allocations, std::memory_order_relaxed);
+}
+
+
+/// \brief Count an allocation or a free.
+///
+/// Threads count locally and publish their counts in batches, so that the
+/// shared counters are not contended.
+void record(ThreadCache* cache, uint8_t category, int64_t bytes, uint64_t allocations)
+{
+    if (cache == nullptr)
+    {
+        publish(category, bytes, allocations);
+        return;
+    }
+
+    cache->bytesInUse[category] += bytes;
+    cache->allocations[category] += allocations;
+
+    if (cache->bytesInUse[category] >= ACCOUNTING_BATCH_SIZE || cache->bytesInUse[category] <= -ACCOUNTING_BATCH_SIZE)
+    {
+        publish(category, cache->bytesInUse[category], cache->allocations[category]);
+        cache->bytesInUse[category] = 0;
+        cache->allocations[category] = 0;
+    }
+}
+
+
+/// \brief Move blocks from a thread cache to the shared pool.
+void flush(ThreadCache& cache, std::size_t sizeClass, std::size_t count)
+{
+    FreeBlock* first = cache.heads[sizeClass];
+    FreeBlock* last = first;
+
+    for (std::size_t i = 1; i < count; ++i)
+        last = last->next;
+
+    cache.heads[sizeClass] = last->next;
+    cache.counts[sizeClass] -= count;
+
+    Pool& pool = pools()[sizeClass];
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    last->next = pool.head;
+    pool.head = first;
+}
+
+
+/// \brief Take blocks from the shared pool, carving a new slab if it is empty.
+/// \returns a list of at most count blocks.
+FreeBlock* take(std::size_t sizeClass, std::size_t count)
+{
+    Pool& pool = pools()[sizeClass];
+    std::unique_lock<std::mutex> lock(pool.mutex);
+
+    if (pool.head == nullptr)
+    {
+        std::size_t size = blockSize(sizeClass);
+        std::size_t blocks = std::max<std::size_t>(8, SLAB_SIZE / size);
+
+        unsigned char* slab = static_cast<unsigned char*>(std::malloc(blocks * size));
+
+        if (slab == nullptr)
+            return nullptr;
+
+        pooledBytes.fetch_add(blocks * size, std::memory_order_relaxed);
+
+        for (std::size_t i = blocks; i > 0; --i)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * size);
+            block->next = pool.head;
+            pool.head = block;
+        }
+    }
+
+    FreeBlock* first = pool.head;
+    FreeBlock* last = first;
+
+    for (std::size_t i = 1; i < count && last->next != nullptr; ++i)
+        last = last->next;
+
+    pool.head = last->next;
+    last->next = nullptr;
+
+    return first;
+}
+
+
+void releaseThreadCache(ThreadCache* cache);
+
+
+/// \brief Returns the blocks cached by a thread when it exits.
+struct ThreadCacheOwner
+{
+    ThreadCache* cache = nullptr;
+
+    ~ThreadCacheOwner();
+};
+
+
+thread_local ThreadCache* threadCache = nullptr;
+thread_local bool threadExited = false;
+thread_local ThreadCacheOwner threadCacheOwner;
+
+
+ThreadCacheOwner::~ThreadCacheOwner()
+{
+    // Later frees on this thread go to the shared pools.
+    threadExited = true;
+    threadCache = nullptr;
+    releaseThreadCache(cache);
+}
+
+
+void releaseThreadCache(ThreadCache* cache)
+{
+    if (cache == nullptr)
+        return;
+
+    for (std::size_t i = 0; i < CLASS_COUNT; ++i)
+    {
+        if (cache->counts[i] > 0)
+            flush(*cache, i, cache->counts[i]);
+    }
+
+    for (uint8_t i = 0; i < ofSSLAllocator::CATEGORY_COUNT; ++i)
+        publish(i, cache->bytesInUse[i], cache->allocations[i]);
+
+    std::free(cache);
+}
+
+
+/// \returns the cache of the calling thread, or nullptr if it has exited.
+ThreadCache* getThreadCache()
+{
+    if (threadCache == nullptr && !threadExited)
+    {
+        threadCache = static_cast<ThreadCache*>(std::calloc(1, sizeof(ThreadCache)));
+        threadCacheOwner.cache = threadCache;
+    }
+
+    return threadCache;
+}
+
+
+void* allocate(std::size_t size, const char* file, int)
+{
+    if (size == 0)
+        return nullptr;
+
+    ThreadCache* cache = getThreadCache();
+    Header* header = nullptr;
+    uint16_t sizeClass = SYSTEM_CLASS;
+
+    if (size > ofSSLAllocator::MAXIMUM_POOLED_SIZE)
+    {
+        header = static_cast<Header*>(std::malloc(sizeof(Header) + size));
+    }
+    else
+    {
+        sizeClass = sizeClassFor(size);
+
+        FreeBlock* block = nullptr;
+
+        if (cache == nullptr)
+        {
+            block = take(sizeClass, 1);
+        }
+        else
+        {
+            if (cache->heads[sizeClass] == nullptr)
+            {
+                std::size_t count = std::max<std::size_t>(1, cacheLimit(sizeClass) / 2);
+                cache->heads[sizeClass] = take(sizeClass, count);
+
+                for (FreeBlock* b = cache->heads[sizeClass]; b != nullptr; b = b->next)
+                    ++cache->counts[sizeClass];
+            }
+
+            block = cache->heads[sizeClass];
+
+            if (block != nullptr)
+            {
+                cache->heads[sizeClass] = block->next;
+                --cache->counts[sizeClass];
+            }
+        }
+
+        header = reinterpret_cast<Header*>(block);
+    }
+
+    if (header == nullptr)
+        return nullptr;
+
+    header->size = size;
+    header->sizeClass = sizeClass;
+    header->category = categoryFor(file);
+
+    record(cache, header->category, static_cast<int64_t>(size), 1);
+
+    return header + 1;
+}
+
+
+void deallocate(void* pointer, const char*, int)
+{
+    if (pointer == nullptr)
+        return;
+
+    Header* header = static_cast<Header*>(pointer) - 1;
+    ThreadCache* cache = getThreadCache();
+
+    record(cache, header->category, -static_cast<int64_t>(header->size), 0);
+
+    std::size_t sizeClass = header->sizeClass;
+
+    if (sizeClass == SYSTEM_CLASS)
+    {
+        std::free(header);
+        return;
+    }
+
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+
+    if (cache == nullptr)
+    {
+        Pool& pool = pools()[sizeClass];
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        block->next = pool.head;
+        pool.head = block;
+        return;
+    }
+
+    block->next = cache->heads[sizeClass];
+    cache->heads[sizeClass] = block;
+
+    std::size_t limit = cacheLimit(sizeClass);
+
+    if (++cache->counts[sizeClass] > limit)
+        flush(*cache, sizeClass, limit / 2);
+}
+
+
+void* reallocate(void* pointer, std::size_t size, const char* file, int line)
+{
+    if (pointer == nullptr)
+        return allocate(size, file, line);
+
+    if (size == 0)
+    {
+        deallocate(pointer, file, line);
+        return nullptr;
+    }
+
+    Header* header = static_cast<Header*>(pointer) - 1;
+
+    if (header->sizeClass != SYSTEM_CLASS && size <= SIZE_CLASSES[header->sizeClass])
+    {
+        // The block is large enough.
+        record(getThreadCache(), header->category, static_cast<int64_t>(size) - static_cast<int64_t>(header->size), 0);
+        header->size = size;
+        return pointer;
+    }
+
+    if (header->sizeClass == SYSTEM_CLASS && size > ofSSLAllocator::MAXIMUM_POOLED_SIZE)
+    {
+        uint8_t category = header->category;
+        uint64_t oldSize = header->size;
+
+        Header* resized = static_cast<Header*>(std::realloc(header, sizeof(Header) + size));
+
+        if (resized == nullptr)
+            return nullptr;
+
+        record(getThreadCache(), category, static_cast<int64_t>(size) - static_cast<int64_t>(oldSize), 0);
+        resized->size = size;
+        return resized + 1;
+    }
+
+    void* resized = allocate(size, file, line);
+
+    if (resized == nullptr)
+        return nullptr;
+
+    std::memcpy(resized, pointer, std::min<std::size_t>(size, header->size));
+    deallocate(pointer, file, line);
+    return resized;
+}
+
+
+}
+
+
+bool ofSSLAllocator::install()
+{
+    static std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (installed)
+        return true;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (CRYPTO_set_mem_functions(&allocate, &reallocate, &deallocate) != 1)
+    {
+        ofLogWarning("ofSSLAllocator::install") << "OpenSSL has already allocated memory, install the allocator at the start of main().";
+        return false;
+    }
+
+    installed = true;
+    return true;
+#else
+    ofLogWarning("ofSSLAllocator::install") << "The pooled allocator requires OpenSSL 1.1.0 or newer.";
+    return false;
+#endif
+}
+
+
+bool ofSSLAllocator::isInstalled()
+{
+    return installed;
+}
+
+
+ofSSLAllocator::Usage ofSSLAllocator::getUsage(Category category)
+{
+    Usage usage;
+
+    if (category < 0 || category >= CATEGORY_COUNT)
+        return usage;
+
+    // Unpublished frees can make the shared count briefly negative.
+    usage.bytesInUse = static_cast<uint64_t>(std::max<int64_t>(0, counters[category].bytesInUse.load(std::memory_order_relaxed)));
+    usage.peakBytesInUse = static_cast<uint64_t>(counters[category].peakBytesInUse.load(std::memory_order_relaxed));
+    usage.allocations = counters[category].allocations.load(std::memory_order_relaxed);
+    return usage;
+}
+
+
+ofSSLAllocator::Usage ofSSLAllocator::getTotalUsage()
+{
+    // The sum of the peaks is an upper bound of the total peak.
+    Usage total;
+
+    for (int i = 0; i < CATEGORY_COUNT; ++i)
+    {
+        Usage usage = getUsage(static_cast<Category>(i));
+        total.bytesInUse += usage.bytesInUse;
+        total.peakBytesInUse += usage.peakBytesInUse;
+        total.allocations += usage.allocations;
+    }
+
+    return total;
+}
+
+
+uint64_t ofSSLAllocator::getPooledBytes()
+{
+    return pooledBytes;
+}
+
+
+void ofSSLAllocator::resetPeaks()
+{
+    for (auto& counter: counters)
+        counter.peakBytesInUse = counter.bytesInUse.load();
+}
+
+
+std::string ofSSLAllocator::to_string(Category category)
+{
+    switch (category)
+    {
+        case CATEGORY_SSL:
+            return "ssl";
+        case CATEGORY_X509:
+            return "x509";
+        case CATEGORY_CRYPTO:
+            return "crypto";
+        case CATEGORY_OTHER:
+        case CATEGORY_COUNT:
+            break;
+    }
+
+    return "other";
+}
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+
+
+/// \brief An optional pooled allocator for OpenSSL with memory accounting.
+///
+/// OpenSSL makes many small allocations for each connection and record.
+/// Once installed, allocations of up to MAXIMUM_POOLED_SIZE bytes are served
+/// from size-class pools with a cache per thread, so that most allocations
+/// and frees do not take a lock or call the system allocator.  Larger
+/// allocations use the system allocator.  The bytes in use and the peak are
+/// counted by category, based on the OpenSSL source file that allocated.
+/// Each thread publishes its counts in batches, so the counts can lag by up
+/// to 64 KB per thread and category.
+///
+/// OpenSSL only accepts memory functions before its first allocation, so
+/// install the allocator at the start of main(), before openFrameworks or
+/// any library uses OpenSSL:
+///
+/// ~~~{.cpp}
+///     int main()
+///     {
+///         ofSSLAllocator::install();
+///         ofSetupOpenGL(1024, 768, OF_WINDOW);
+///         return ofRunApp(std::make_shared<ofApp>());
+///     }
+/// ~~~
+///
+/// Alternatively, define OF_SSL_POOLED_ALLOCATOR to install it when
+/// ofSSLManager is first used, which works if OpenSSL has not been used yet.
+///
+/// Pooled memory is reused but never returned to the system, so the memory
+/// held by the pools is the peak of the memory used by pooled allocations.
+///
+/// All methods are thread-safe.
+class ofSSLAllocator
+{
+public:
+    /// \brief The allocation categories.
+    enum Category
+    {
+        /// \brief Connections, sessions and records (OpenSSL's ssl/).
+        CATEGORY_SSL,
+        /// \brief Certificates and their encodings (x509, asn1 and pem).
+        CATEGORY_X509,
+        /// \brief Keys, ciphers, digests and everything else in crypto/.
+        CATEGORY_CRYPTO,
+        /// \brief Allocations of unknown origin.
+        CATEGORY_OTHER,
+        /// \brief The number of categories.
+        CATEGORY_COUNT
+    };
+
+    /// \brief The memory used by a category.
+    struct Usage
+    {
+        /// \brief The number of bytes allocated and not freed.
+        uint64_t bytesInUse = 0;
+
+        /// \brief The largest number of bytes in use.
+        uint64_t peakBytesInUse = 0;
+
+        /// \brief The number of allocations made.
+        uint64_t allocations = 0;
+    };
+
+    /// \brief The largest allocation served from the pools.
+    static const std::size_t MAXIMUM_POOLED_SIZE;
+
+    /// \brief Install the pooled allocator as OpenSSL's memory functions.
+    /// \returns true iff the allocator is installed.  This fails if OpenSSL
+    ///          has already allocated memory or is older than 1.1.0.
+    static bool install();
+
+    /// \returns true iff the pooled allocator is installed.
+    static bool isInstalled();
+
+    /// \param category The category.
+    /// \returns the memory used by a category.
+    static Usage getUsage(Category category);
+
+    /// \returns the memory used by all categories.
+    static Usage getTotalUsage();
+
+    /// \returns the number of bytes held by the pools, in use or not.
+    static uint64_t getPooledBytes();
+
+    /// \brief Reset the peaks to the bytes currently in use.
+    static void resetPeaks();
+
+    /// \param category The category.
+    /// \returns the name of a category.
+    static std::string to_string(Category category);
+
+};
@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLAntiReplayWindow.h"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+
+const std::size_t ofSSLAntiReplayWindow::DEFAULT_MAXIMUM_SIZE = 65536;
+const std::chrono::seconds ofSSLAntiReplayWindow::DEFAULT_WINDOW = std::chrono::seconds(30);
+
+
+ofSSLAntiReplayWindow::ofSSLAntiReplayWindow(std::size_t maximumSize,
+                                             std::chrono::seconds window):
+    _maximumSize(maximumSize),
+    _window(window),
+    _accepted(0),
+    _replays(0),
+    _overflows(0)
+{
+}
+
+
+bool ofSSLAntiReplayWindow::accept(const std::string& key)
+{
+    // Without a secret a replay can't be detected.
+    if (key.empty())
+    {
+        ++_replays;
+        return false;
+    }
+
+    Clock::time_point now = Clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _purge(now);
+
+    if (_index.find(key) != _index.end())
+    {
+        ++_replays;
+        return false;
+    }
+
+    // Forgetting a secret early would let its replays through.
+    if (_entries.size() >= _maximumSize)
+    {
+        ++_overflows;
+        return false;
+    }
+
+    _entries.push_back({ key, now + _window });
+    _index.insert(key);
+    ++_accepted;
+    return true;
+}
+
+
+void ofSSLAntiReplayWindow::clear()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+}
+
+
+std::size_t ofSSLAntiReplayWindow::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+
+void ofSSLAntiReplayWindow::setMaximumSize(std::size_t maximumSize)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _maximumSize = maximumSize;
+}
+
+
+std::size_t ofSSLAntiReplayWindow::getMaximumSize() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _maximumSize;
+}
+
+
+void ofSSLAntiReplayWindow::setWindow(std::chrono::seconds window)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _window = window;
+}
+
+
+std::chrono::seconds ofSSLAntiReplayWindow::getWindow() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _window;
+}
+
+
+uint64_t ofSSLAntiReplayWindow::getAccepted() const
+{
+    return _accepted;
+}
+
+
+uint64_t ofSSLAntiReplayWindow::getReplays() const
+{
+    return _replays;
+}
+
+
+uint64_t ofSSLAntiReplayWindow::getOverflows() const
+{
+    return _overflows;
+}
+
+
+void ofSSLAntiReplayWindow::resetCounters()
+{
+    _accepted = 0;
+    _replays = 0;
+    _overflows = 0;
+}
+
+
+std::string ofSSLAntiReplayWindow::makeKey(const SSL* ssl)
+{
+    SSL_SESSION* pSession = ssl != nullptr ? SSL_get_session(ssl) : nullptr;
+
+    if (pSession == nullptr)
+        return "";
+
+    // In TLS 1.3 each session ticket carries a distinct resumption secret,
+    // so the secret identifies the ticket a client hello was sent with.
+    unsigned char secret[SSL_MAX_MASTER_KEY_LENGTH];
+    std::size_t secretLength = SSL_SESSION_get_master_key(pSession, secret, sizeof(secret));
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+
+    bool digested = secretLength > 0 && EVP_Digest(secret, secretLength, digest, &length, EVP_sha256(), nullptr) == 1;
+
+    OPENSSL_cleanse(secret, sizeof(secret));
+
+    if (!digested)
+        return "";
+
+    static const char* hex = "0123456789abcdef";
+
+    std::string key;
+
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        key += hex[digest[i] >> 4];
+        key += hex[digest[i] & 0x0f];
+    }
+
+    return key;
+}
+
+
+void ofSSLAntiReplayWindow::_purge(Clock::time_point now)
+{
+    while (!_entries.empty() && _entries.front().expires <= now)
+    {
+        _index.erase(_entries.front().key);
+        _entries.pop_front();
+    }
+}
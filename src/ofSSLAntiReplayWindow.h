@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <openssl/ssl.h>
+
+
+/// \brief A bounded record of the resumption secrets used for early data.
+///
+/// TLS 1.3 early (0-RTT) data is sent before the server has proven that the
+/// client hello is fresh, so an attacker can replay a recorded client hello
+/// and its early data.  OpenSSL rejects early data when the age of the
+/// session ticket reported by the client is more than 10 seconds off, which
+/// bounds the time a recorded client hello can be replayed.  This window
+/// records the resumption secret of each connection that sends early data
+/// and accepts early data only the first time a secret is seen, so that a
+/// replay within that time falls back to a full round trip.
+///
+/// Secrets are remembered for the window, which must be longer than the
+/// time OpenSSL accepts a replayed client hello (about 20 seconds).  When
+/// the window holds the maximum number of secrets, early data is rejected
+/// until older secrets expire.
+///
+/// The window only detects replays to this process.  Replays to other
+/// processes or hosts that share the session ticket keys are not detected.
+///
+/// All methods are thread-safe.
+class ofSSLAntiReplayWindow
+{
+public:
+    /// \brief The default maximum number of remembered secrets.
+    static const std::size_t DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The default time a secret is remembered.
+    static const std::chrono::seconds DEFAULT_WINDOW;
+
+    /// \brief Create an anti-replay window.
+    /// \param maximumSize The maximum number of remembered secrets.
+    /// \param window The time a secret is remembered.
+    ofSSLAntiReplayWindow(std::size_t maximumSize = DEFAULT_MAXIMUM_SIZE,
+                          std::chrono::seconds window = DEFAULT_WINDOW);
+
+    /// \brief Decide whether early data may be accepted.
+    /// \param key The key made by makeKey().
+    /// \returns true iff the key has not been seen within the window and
+    ///          there is room to remember it.
+    bool accept(const std::string& key);
+
+    /// \brief Forget all secrets.
+    ///
+    /// \warning Early data replayed after this call is accepted again.
+    void clear();
+
+    /// \returns the number of remembered secrets, including expired
+    ///          secrets that have not yet been removed.
+    std::size_t size() const;
+
+    /// \brief Set the maximum number of remembered secrets.
+    /// \param maximumSize The maximum number of remembered secrets.
+    void setMaximumSize(std::size_t maximumSize);
+
+    /// \returns the maximum number of remembered secrets.
+    std::size_t getMaximumSize() const;
+
+    /// \brief Set the time a secret is remembered.
+    ///
+    /// The new window applies to secrets remembered after this call.
+    ///
+    /// \param window The window.
+    void setWindow(std::chrono::seconds window);
+
+    /// \returns the time a secret is remembered.
+    std::chrono::seconds getWindow() const;
+
+    /// \returns the number of decisions that accepted early data.
+    uint64_t getAccepted() const;
+
+    /// \returns the number of decisions that rejected a replay or a
+    ///          connection without a resumption secret.
+    uint64_t getReplays() const;
+
+    /// \returns the number of decisions that rejected early data because
+    ///          the window was full.
+    uint64_t getOverflows() const;
+
+    /// \brief Reset the accepted, replay and overflow counters.
+    void resetCounters();
+
+    /// \brief Make a key from a resumed connection.
+    /// \param ssl The server connection, during the handshake.
+    /// \returns A key made from the SHA-256 digest of the resumption secret,
+    ///          or an empty string if the connection has no secret.
+    static std::string makeKey(const SSL* ssl);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        std::string key;
+        Clock::time_point expires;
+    };
+
+    /// \brief Remove the expired secrets.
+    /// \note The mutex must be held by the caller.
+    void _purge(Clock::time_point now);
+
+    /// \brief The remembered secrets, oldest first.
+    std::deque<Entry> _entries;
+
+    /// \brief An index of the remembered secrets.
+    std::unordered_set<std::string> _index;
+
+    /// \brief The maximum number of remembered secrets.
+    std::size_t _maximumSize = DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The time a secret is remembered.
+    std::chrono::seconds _window = DEFAULT_WINDOW;
+
+    std::atomic<uint64_t> _accepted;
+    std::atomic<uint64_t> _replays;
+    std::atomic<uint64_t> _overflows;
+
+    /// \brief The mutex protecting the entries and settings.
+    mutable std::mutex _mutex;
+
+};
@@ -0,0 +1,391 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLCertificateStore.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <vector>
+#include "ofLog.h"
+
+
+const std::size_t ofSSLCertificateStore::DEFAULT_MAXIMUM_SIZE = 256;
+const std::string ofSSLCertificateStore::PRIVATE_KEY_FILE = "privateKey.pem";
+const std::string ofSSLCertificateStore::CERTIFICATE_FILE = "certificate.pem";
+const std::string ofSSLCertificateStore::WILDCARD_LABEL = "_";
+
+
+ofSSLCertificateStore::ofSSLCertificateStore(std::size_t maximumSize):
+    _maximumSize(maximumSize),
+    _factory([](const std::string& privateKeyFile, const std::string& certificateFile) {
+        return Poco::Net::Context::Ptr(new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                              privateKeyFile,
+                                                              certificateFile,
+                                                              ""));
+    }),
+    _hits(0),
+    _misses(0),
+    _evictions(0),
+    _unknownNames(0),
+    _loadFailures(0)
+{
+}
+
+
+std::size_t ofSSLCertificateStore::setDirectory(const std::string& path)
+{
+    std::unordered_map<std::string, std::string> hosts;
+    std::unordered_map<std::string, std::string> wildcardHosts;
+
+    if (!path.empty())
+    {
+        std::error_code error;
+
+        for (const auto& entry: std::filesystem::directory_iterator(path, error))
+        {
+            if (!entry.is_directory(error))
+                continue;
+
+            std::string name = entry.path().filename().string();
+            std::string hostName = normalize(name);
+
+            if (hostName.compare(0, WILDCARD_LABEL.size() + 1, WILDCARD_LABEL + ".") == 0)
+                wildcardHosts[hostName.substr(WILDCARD_LABEL.size() + 1)] = name;
+            else
+                hosts[hostName] = name;
+        }
+
+        if (error)
+        {
+            ofLogError("ofSSLCertificateStore::setDirectory") << "Unable to read " << path << ": " << error.message();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _directory = path;
+    _hosts.swap(hosts);
+    _wildcardHosts.swap(wildcardHosts);
+    _index.clear();
+    _entries.clear();
+    ++_generation;
+    return _hosts.size() + _wildcardHosts.size();
+}
+
+
+std::string ofSSLCertificateStore::getDirectory() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _directory;
+}
+
+
+std::size_t ofSSLCertificateStore::rescan()
+{
+    return setDirectory(getDirectory());
+}
+
+
+void ofSSLCertificateStore::setContextFactory(ContextFactory factory)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _factory = factory;
+    _index.clear();
+    _entries.clear();
+    ++_generation;
+}
+
+
+void ofSSLCertificateStore::attach(Poco::Net::Context::Ptr pContext)
+{
+    SSL_CTX* pSSLContext = pContext->sslContext();
+    SSL_CTX_set_tlsext_servername_callback(pSSLContext, &ofSSLCertificateStore::_serverNameCallback);
+    SSL_CTX_set_tlsext_servername_arg(pSSLContext, this);
+}
+
+
+Poco::Net::Context::Ptr ofSSLCertificateStore::getContext(const std::string& hostName)
+{
+    std::string host = normalize(hostName);
+    std::string name;
+    std::string directory;
+    ContextFactory factory;
+    uint64_t generation = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        name = _find(host);
+
+        if (name.empty())
+        {
+            ++_unknownNames;
+            return nullptr;
+        }
+
+        auto iter = _index.find(name);
+
+        if (iter != _index.end())
+        {
+            // Move the entry to the front of the list.
+            _entries.splice(_entries.begin(), _entries, iter->second);
+            ++_hits;
+            return _entries.front().pContext;
+        }
+
+        directory = _directory;
+        factory = _factory;
+        generation = _generation;
+    }
+
+    ++_misses;
+
+    // Load without holding the lock so that other host names can be served
+    // meanwhile.
+    std::filesystem::path path = std::filesystem::path(directory) / name;
+
+    Poco::Net::Context::Ptr pContext;
+
+    try
+    {
+        pContext = factory((path / PRIVATE_KEY_FILE).string(),
+                           (path / CERTIFICATE_FILE).string());
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ++_loadFailures;
+        ofLogError("ofSSLCertificateStore::getContext") << "Unable to load the certificate for " << name << ": " << exc.displayText();
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Do not keep a Context loaded from a directory that was rescanned.
+    if (generation != _generation)
+        return pContext;
+
+    auto iter = _index.find(name);
+
+    // Another thread loaded the same host meanwhile.
+    if (iter != _index.end())
+    {
+        _entries.splice(_entries.begin(), _entries, iter->second);
+        return _entries.front().pContext;
+    }
+
+    // Failures are kept too, so that a broken host directory is not loaded
+    // again on every handshake.  They are retried after rescan().
+    Entry entry;
+    entry.name = name;
+    entry.pContext = pContext;
+
+    _entries.push_front(entry);
+    _index[_entries.front().name] = _entries.begin();
+
+    _trim();
+
+    return pContext;
+}
+
+
+std::size_t ofSSLCertificateStore::preload()
+{
+    std::vector<std::string> hostNames;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        for (const auto& host: _hosts)
+            hostNames.push_back(host.first);
+
+        for (const auto& host: _wildcardHosts)
+            hostNames.push_back(WILDCARD_LABEL + "." + host.first);
+
+        hostNames.resize(std::min(hostNames.size(), _maximumSize));
+    }
+
+    std::size_t count = 0;
+
+    for (const auto& hostName: hostNames)
+    {
+        if (!getContext(hostName).isNull())
+            ++count;
+    }
+
+    return count;
+}
+
+
+std::string ofSSLCertificateStore::find(const std::string& hostName) const
+{
+    std::string host = normalize(hostName);
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _find(host);
+}
+
+
+std::size_t ofSSLCertificateStore::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _hosts.size() + _wildcardHosts.size();
+}
+
+
+std::size_t ofSSLCertificateStore::getLoadedCount() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+
+void ofSSLCertificateStore::clear()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _index.clear();
+    _entries.clear();
+    ++_generation;
+}
+
+
+void ofSSLCertificateStore::setMaximumSize(std::size_t maximumSize)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _maximumSize = maximumSize;
+    _trim();
+}
+
+
+std::size_t ofSSLCertificateStore::getMaximumSize() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _maximumSize;
+}
+
+
+uint64_t ofSSLCertificateStore::getHits() const
+{
+    return _hits;
+}
+
+
+uint64_t ofSSLCertificateStore::getMisses() const
+{
+    return _misses;
+}
+
+
+uint64_t ofSSLCertificateStore::getEvictions() const
+{
+    return _evictions;
+}
+
+
+uint64_t ofSSLCertificateStore::getUnknownNames() const
+{
+    return _unknownNames;
+}
+
+
+uint64_t ofSSLCertificateStore::getLoadFailures() const
+{
+    return _loadFailures;
+}
+
+
+void ofSSLCertificateStore::resetCounters()
+{
+    _hits = 0;
+    _misses = 0;
+    _evictions = 0;
+    _unknownNames = 0;
+    _loadFailures = 0;
+}
+
+
+std::string ofSSLCertificateStore::normalize(const std::string& hostName)
+{
+    std::string host = hostName;
+
+    if (!host.empty() && host.back() == '.')
+        host.pop_back();
+
+    std::transform(host.begin(), host.end(), host.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    return host;
+}
+
+
+std::string ofSSLCertificateStore::_find(const std::string& hostName) const
+{
+    auto iter = _hosts.find(hostName);
+
+    if (iter != _hosts.end())
+        return iter->second;
+
+    // A wildcard matches exactly one label.
+    std::size_t dot = hostName.find('.');
+
+    if (dot != std::string::npos && dot > 0)
+    {
+        iter = _wildcardHosts.find(hostName.substr(dot + 1));
+
+        if (iter != _wildcardHosts.end())
+            return iter->second;
+    }
+
+    return "";
+}
+
+
+void ofSSLCertificateStore::_trim()
+{
+    while (_entries.size() > _maximumSize)
+    {
+        _index.erase(_entries.back().name);
+        _entries.pop_back();
+        ++_evictions;
+    }
+}
+
+
+int ofSSLCertificateStore::_serverNameCallback(SSL* ssl, int*, void* arg)
+{
+    const char* serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+    if (serverName == nullptr)
+        return SSL_TLSEXT_ERR_OK;
+
+    ofSSLCertificateStore* store = static_cast<ofSSLCertificateStore*>(arg);
+
+    Poco::Net::Context::Ptr pContext = store->getContext(serverName);
+
+    if (pContext.isNull())
+        return SSL_TLSEXT_ERR_OK;
+
+    // The SSL only keeps the SSL_CTX alive, but Poco's callbacks use the
+    // Context stored in it, so the Context is kept until the SSL is freed
+    // in case it is evicted meanwhile.  The callback runs again for a
+    // second client hello.
+    delete static_cast<Poco::Net::Context::Ptr*>(SSL_get_ex_data(ssl, _contextIndex()));
+    SSL_set_ex_data(ssl, _contextIndex(), new Poco::Net::Context::Ptr(pContext));
+    SSL_set_SSL_CTX(ssl, pContext->sslContext());
+
+    return SSL_TLSEXT_ERR_OK;
+}
+
+
+int ofSSLCertificateStore::_contextIndex()
+{
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &ofSSLCertificateStore::_freeContext);
+    return index;
+}
+
+
+void ofSSLCertificateStore::_freeContext(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+{
+    delete static_cast<Poco::Net::Context::Ptr*>(ptr);
+}
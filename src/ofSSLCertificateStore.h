@@ -0,0 +1,228 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <openssl/ssl.h>
+#include "Poco/Net/Context.h"
+
+
+/// \brief A directory of server certificates selected by SNI host name.
+///
+/// A server that terminates TLS for many host names needs a certificate and
+/// private key for each of them.  An ofSSLCertificateStore indexes a
+/// directory with one subdirectory per host name:
+///
+/// ~~~
+///     hosts/
+///         example.com/certificate.pem
+///         example.com/privateKey.pem
+///         _.example.com/certificate.pem     (*.example.com)
+///         _.example.com/privateKey.pem
+///         ...
+/// ~~~
+///
+/// A subdirectory whose first label is `_` holds a wildcard certificate
+/// that matches exactly one label in place of the `_`, so `_.example.com`
+/// matches `www.example.com` but not `example.com` or `a.b.example.com`.
+/// (`*` is not portable in file names.)
+///
+/// When the store is attached to a server Context, the host name sent by the
+/// client (SNI) selects the Context used for the handshake.  Only the host
+/// names are indexed.  Certificates and private keys are loaded the first
+/// time their host name is requested, and at most getMaximumSize() loaded
+/// Contexts are kept, least recently used first out, so memory does not grow
+/// with the number of host names.  Clients that send no host name or an
+/// unknown host name use the Context the store is attached to.
+///
+/// A host name that is not loaded yet is loaded during the handshake, in
+/// the thread accepting the connection: its private key is read and
+/// decrypted, which may fire Poco::Net::SSLManager::PrivateKeyPassphraseRequired.
+/// Call preload() (e.g. at startup) so that first handshakes don't wait.
+///
+/// All methods are thread-safe.
+class ofSSLCertificateStore
+{
+public:
+    /// \brief A function that creates a server Context from a key and certificate.
+    typedef std::function<Poco::Net::Context::Ptr(const std::string& privateKeyFile,
+                                                  const std::string& certificateFile)> ContextFactory;
+
+    /// \brief The default maximum number of loaded Contexts.
+    static const std::size_t DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The name of the private key file in each host directory.
+    static const std::string PRIVATE_KEY_FILE;
+
+    /// \brief The name of the certificate file in each host directory.
+    static const std::string CERTIFICATE_FILE;
+
+    /// \brief The first label of a wildcard host directory.
+    static const std::string WILDCARD_LABEL;
+
+    /// \brief Create an empty certificate store.
+    /// \param maximumSize The maximum number of loaded Contexts.
+    ofSSLCertificateStore(std::size_t maximumSize = DEFAULT_MAXIMUM_SIZE);
+
+    /// \brief Index the host directories in the given directory.
+    ///
+    /// Loaded Contexts are discarded.  An empty path clears the index.
+    ///
+    /// \param path The directory containing one directory per host name.
+    /// \returns The number of host names indexed.
+    std::size_t setDirectory(const std::string& path);
+
+    /// \returns the indexed directory or an empty string if none.
+    std::string getDirectory() const;
+
+    /// \brief Index the directory again, e.g. after adding host names.
+    ///
+    /// Loaded Contexts are discarded, so changed certificates are reloaded.
+    ///
+    /// \returns The number of host names indexed.
+    std::size_t rescan();
+
+    /// \brief Set the function used to create a Context for a host name.
+    ///
+    /// By default a server Context with no CA location is created.
+    ///
+    /// \param factory The Context factory.
+    void setContextFactory(ContextFactory factory);
+
+    /// \brief Select Contexts from this store by SNI in the given Context.
+    /// \param pContext The server Context used when no host name matches.
+    /// \note This store must outlive the Context.
+    void attach(Poco::Net::Context::Ptr pContext);
+
+    /// \brief Get the Context for a host name, loading it if needed.
+    /// \param hostName The host name.
+    /// \returns The Context or nullptr if no host directory matches or the
+    ///          host's certificate could not be loaded.
+    Poco::Net::Context::Ptr getContext(const std::string& hostName);
+
+    /// \brief Load the Contexts of the indexed host names ahead of time.
+    ///
+    /// At most getMaximumSize() Contexts are loaded.
+    ///
+    /// \returns The number of Contexts loaded.
+    std::size_t preload();
+
+    /// \brief Find the host directory name that matches a host name.
+    /// \param hostName The host name.
+    /// \returns The matching directory name or an empty string if none.
+    std::string find(const std::string& hostName) const;
+
+    /// \returns the number of host names indexed.
+    std::size_t size() const;
+
+    /// \returns the number of Contexts currently loaded.
+    std::size_t getLoadedCount() const;
+
+    /// \brief Discard all loaded Contexts.
+    void clear();
+
+    /// \brief Set the maximum number of loaded Contexts.
+    /// \param maximumSize The maximum number of loaded Contexts.
+    void setMaximumSize(std::size_t maximumSize);
+
+    /// \returns the maximum number of loaded Contexts.
+    std::size_t getMaximumSize() const;
+
+    /// \returns the number of lookups that found a loaded Context.
+    uint64_t getHits() const;
+
+    /// \returns the number of lookups that loaded a Context.
+    uint64_t getMisses() const;
+
+    /// \returns the number of Contexts discarded to respect the maximum size.
+    uint64_t getEvictions() const;
+
+    /// \returns the number of lookups that matched no host directory.
+    uint64_t getUnknownNames() const;
+
+    /// \returns the number of host Contexts that could not be loaded.
+    uint64_t getLoadFailures() const;
+
+    /// \brief Reset the counters.
+    void resetCounters();
+
+    /// \brief Normalize a host name for lookup.
+    /// \param hostName The host name.
+    /// \returns The host name in lower case without a trailing dot.
+    static std::string normalize(const std::string& hostName);
+
+private:
+    struct Entry
+    {
+        std::string name;
+
+        /// \brief The loaded Context, or nullptr if loading failed.
+        Poco::Net::Context::Ptr pContext;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    /// \brief Find the host directory name for a normalized host name.
+    /// \note The mutex must be held by the caller.
+    std::string _find(const std::string& hostName) const;
+
+    /// \brief Evict least recently used Contexts until size <= maximumSize.
+    /// \note The mutex must be held by the caller.
+    void _trim();
+
+    static int _serverNameCallback(SSL* ssl, int* alert, void* arg);
+
+    /// \brief Get the SSL ex_data index used to keep the selected Context
+    ///        alive while the connection is open.
+    static int _contextIndex();
+
+    static void _freeContext(void* parent,
+                             void* ptr,
+                             CRYPTO_EX_DATA* ad,
+                             int index,
+                             long argl,
+                             void* argp);
+
+    std::string _directory;
+
+    /// \brief The host directory names.
+    std::unordered_map<std::string, std::string> _hosts;
+
+    /// \brief The wildcard host directory names by parent domain.
+    std::unordered_map<std::string, std::string> _wildcardHosts;
+
+    /// \brief The loaded Contexts, most recently used first.
+    EntryList _entries;
+
+    /// \brief An index of the loaded Contexts by host directory name.
+    std::unordered_map<std::string, EntryList::iterator> _index;
+
+    std::size_t _maximumSize = DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief Incremented when loaded Contexts are discarded.
+    uint64_t _generation = 0;
+
+    ContextFactory _factory;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _evictions;
+    std::atomic<uint64_t> _unknownNames;
+    std::atomic<uint64_t> _loadFailures;
+
+    /// \brief The mutex protecting the index, entries and settings.
+    mutable std::mutex _mutex;
+
+};
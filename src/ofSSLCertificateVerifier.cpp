@@ -0,0 +1,372 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLCertificateVerifier.h"
+#include <algorithm>
+#include <openssl/asn1.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include "ofSSLManager.h"
+
+
+namespace
+{
+
+
+/// \brief Decode a PEM or DER encoded certificate and its intermediates.
+/// \returns the first certificate, or nullptr if it could not be decoded.
+X509* decode(const std::string& certificate, STACK_OF(X509)* pChain)
+{
+    X509* pCertificate = nullptr;
+
+    if (certificate.find("-----BEGIN") != std::string::npos)
+    {
+        BIO* pBIO = BIO_new_mem_buf(certificate.data(), static_cast<int>(certificate.size()));
+
+        if (pBIO == nullptr)
+            return nullptr;
+
+        pCertificate = PEM_read_bio_X509(pBIO, nullptr, nullptr, nullptr);
+
+        while (pCertificate != nullptr)
+        {
+            X509* pIntermediate = PEM_read_bio_X509(pBIO, nullptr, nullptr, nullptr);
+
+            if (pIntermediate == nullptr || sk_X509_push(pChain, pIntermediate) == 0)
+            {
+                X509_free(pIntermediate);
+                break;
+            }
+        }
+
+        BIO_free(pBIO);
+    }
+    else
+    {
+        const unsigned char* pData = reinterpret_cast<const unsigned char*>(certificate.data());
+        const unsigned char* pEnd = pData + certificate.size();
+
+        pCertificate = d2i_X509(nullptr, &pData, static_cast<long>(pEnd - pData));
+
+        while (pCertificate != nullptr && pData < pEnd)
+        {
+            X509* pIntermediate = d2i_X509(nullptr, &pData, static_cast<long>(pEnd - pData));
+
+            if (pIntermediate == nullptr || sk_X509_push(pChain, pIntermediate) == 0)
+            {
+                X509_free(pIntermediate);
+                break;
+            }
+        }
+    }
+
+    // Reading past the last certificate leaves an error on the queue.
+    ERR_clear_error();
+
+    return pCertificate;
+}
+
+
+}
+
+
+ofSSLCertificateVerifier::ofSSLCertificateVerifier(std::size_t threadCount):
+    _threadCount(threadCount),
+    _verified(0),
+    _failed(0),
+    _unreadable(0)
+{
+}
+
+
+ofSSLCertificateVerifier::~ofSSLCertificateVerifier()
+{
+    _stopWorkers();
+}
+
+
+std::vector<ofSSLCertificateVerifier::Result> ofSSLCertificateVerifier::verify(const std::vector<std::string>& certificates)
+{
+    std::vector<Result> results(certificates.size());
+
+    if (certificates.empty())
+        return results;
+
+    ofSSLTrustStore::Ptr pTrustStore = getTrustStore();
+
+    if (pTrustStore.isNull())
+        pTrustStore = ofSSLManager::getTrustStore();
+
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->certificates = &certificates;
+    batch->results = &results;
+    batch->count = certificates.size();
+    batch->pStore = pTrustStore->store();
+    batch->next = 0;
+    batch->remaining = certificates.size();
+
+    bool shared = certificates.size() > 1 && getThreadCount() > 1;
+
+    if (shared)
+    {
+        _startWorkers();
+
+        {
+            std::unique_lock<std::mutex> lock(_workerMutex);
+            _batches.push_back(batch);
+        }
+
+        _workerCondition.notify_all();
+    }
+
+    _work(*batch);
+
+    {
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->done.wait(lock, [&]() { return batch->remaining == 0; });
+    }
+
+    if (shared)
+    {
+        std::unique_lock<std::mutex> lock(_workerMutex);
+        _batches.erase(std::remove(_batches.begin(), _batches.end(), batch), _batches.end());
+    }
+
+    return results;
+}
+
+
+void ofSSLCertificateVerifier::setTrustStore(ofSSLTrustStore::Ptr pTrustStore)
+{
+    std::unique_lock<std::mutex> lock(_trustStoreMutex);
+    _pTrustStore = pTrustStore;
+}
+
+
+ofSSLTrustStore::Ptr ofSSLCertificateVerifier::getTrustStore() const
+{
+    std::unique_lock<std::mutex> lock(_trustStoreMutex);
+    return _pTrustStore;
+}
+
+
+void ofSSLCertificateVerifier::setThreadCount(std::size_t threadCount)
+{
+    _threadCount = threadCount;
+
+    // The workers are started again with the new count by the next batch.
+    _stopWorkers();
+}
+
+
+std::size_t ofSSLCertificateVerifier::getThreadCount() const
+{
+    std::size_t threadCount = _threadCount;
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    return threadCount;
+}
+
+
+uint64_t ofSSLCertificateVerifier::getVerified() const
+{
+    return _verified;
+}
+
+
+uint64_t ofSSLCertificateVerifier::getFailed() const
+{
+    return _failed;
+}
+
+
+uint64_t ofSSLCertificateVerifier::getUnreadable() const
+{
+    return _unreadable;
+}
+
+
+void ofSSLCertificateVerifier::resetCounters()
+{
+    _verified = 0;
+    _failed = 0;
+    _unreadable = 0;
+}
+
+
+ofSSLCertificateVerifier::Result ofSSLCertificateVerifier::verify(const std::string& certificate,
+                                                                  X509_STORE* pStore,
+                                                                  X509_STORE_CTX* pContext)
+{
+    Result result;
+
+    STACK_OF(X509)* pChain = sk_X509_new_null();
+    X509* pCertificate = pChain != nullptr ? decode(certificate, pChain) : nullptr;
+
+    if (pCertificate == nullptr)
+    {
+        sk_X509_free(pChain);
+        result.error = X509_V_ERR_UNSPECIFIED;
+        return result;
+    }
+
+    // The difference from now avoids converting the calendar time.
+    int days = 0;
+    int seconds = 0;
+
+    if (ASN1_TIME_diff(&days, &seconds, nullptr, X509_get0_notAfter(pCertificate)) == 1)
+    {
+        result.expiresOn = std::chrono::time_point_cast<std::chrono::system_clock::duration>(std::chrono::system_clock::now()
+                         + std::chrono::hours(24) * days
+                         + std::chrono::seconds(seconds));
+    }
+
+    X509_STORE_CTX* pOwnContext = pContext == nullptr ? X509_STORE_CTX_new() : nullptr;
+
+    if (pContext == nullptr)
+        pContext = pOwnContext;
+
+    if (pContext != nullptr && X509_STORE_CTX_init(pContext, pStore, pCertificate, pChain) == 1)
+    {
+        if (X509_verify_cert(pContext) == 1)
+        {
+            result.status = Result::VERIFIED;
+        }
+        else
+        {
+            result.status = Result::FAILED;
+            result.error = X509_STORE_CTX_get_error(pContext);
+            result.depth = X509_STORE_CTX_get_error_depth(pContext);
+        }
+
+        X509_STORE_CTX_cleanup(pContext);
+    }
+    else
+    {
+        result.status = Result::FAILED;
+    }
+
+    // An internal error (e.g. out of memory) doesn't set a verification error.
+    if (result.status == Result::FAILED && result.error == X509_V_OK)
+        result.error = X509_V_ERR_UNSPECIFIED;
+
+    X509_STORE_CTX_free(pOwnContext);
+    X509_free(pCertificate);
+    sk_X509_pop_free(pChain, X509_free);
+    ERR_clear_error();
+
+    return result;
+}
+
+
+void ofSSLCertificateVerifier::_work(Batch& batch)
+{
+    // One verification context is reused for the whole batch.
+    X509_STORE_CTX* pContext = X509_STORE_CTX_new();
+
+    for (;;)
+    {
+        std::size_t i = batch.next++;
+
+        if (i >= batch.count)
+            break;
+
+        Result result = verify((*batch.certificates)[i], batch.pStore, pContext);
+
+        switch (result.status)
+        {
+            case Result::VERIFIED:
+                ++_verified;
+                break;
+            case Result::FAILED:
+                ++_failed;
+                break;
+            case Result::UNREADABLE:
+                ++_unreadable;
+                break;
+        }
+
+        (*batch.results)[i] = result;
+
+        // The calling thread may return as soon as the last one is done.
+        if (--batch.remaining == 0)
+        {
+            std::unique_lock<std::mutex> lock(batch.mutex);
+            batch.done.notify_all();
+        }
+    }
+
+    X509_STORE_CTX_free(pContext);
+}
+
+
+void ofSSLCertificateVerifier::_startWorkers()
+{
+    std::unique_lock<std::mutex> lock(_workerMutex);
+
+    // The calling thread is one of the threads verifying a batch.
+    std::size_t workerCount = getThreadCount() - 1;
+
+    // Nothing is started while setThreadCount() is stopping the workers.
+    while (_workers.size() < workerCount && !_workersStopping)
+        _workers.push_back(std::thread([this]() { _run(); }));
+}
+
+
+void ofSSLCertificateVerifier::_stopWorkers()
+{
+    std::vector<std::thread> workers;
+
+    {
+        std::unique_lock<std::mutex> lock(_workerMutex);
+        _workersStopping = true;
+        workers.swap(_workers);
+    }
+
+    _workerCondition.notify_all();
+
+    for (auto& worker: workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+
+    std::unique_lock<std::mutex> lock(_workerMutex);
+    _workersStopping = false;
+}
+
+
+void ofSSLCertificateVerifier::_run()
+{
+    std::unique_lock<std::mutex> lock(_workerMutex);
+
+    while (!_workersStopping)
+    {
+        if (_batches.empty())
+        {
+            _workerCondition.wait(lock);
+            continue;
+        }
+
+        std::shared_ptr<Batch> batch = _batches.front();
+
+        // A batch whose certificates are all taken is finished by the
+        // threads verifying them.
+        if (batch->next >= batch->count)
+        {
+            _batches.pop_front();
+            continue;
+        }
+
+        lock.unlock();
+        _work(*batch);
+        lock.lock();
+    }
+}
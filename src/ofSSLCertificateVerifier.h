@@ -0,0 +1,215 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <openssl/x509.h>
+#include "ofSSLTrustStore.h"
+
+
+/// \brief Verifies batches of certificate chains on a pool of threads.
+///
+/// Validating many certificates (e.g. uploaded certificates or an audit of a
+/// CA bundle) one at a time with Poco::Net::X509Certificate parses each
+/// certificate into several strings and verifies on a single thread.  The
+/// verifier decodes each chain once, verifies it against an ofSSLTrustStore
+/// and returns a compact result, without formatting any strings:
+///
+/// ~~~{.cpp}
+///     std::vector<std::string> certificates = ...; // PEM or DER
+///
+///     auto results = ofSSLManager::verifyCertificates(certificates);
+///
+///     for (std::size_t i = 0; i < results.size(); ++i)
+///     {
+///         if (!results[i].ok())
+///             ofLogWarning() << i << ": " << X509_verify_cert_error_string(results[i].error);
+///     }
+/// ~~~
+///
+/// Each certificate is PEM or DER encoded.  A PEM certificate may be followed
+/// by the intermediate certificates of its chain (likewise, DER certificates
+/// may be concatenated).  The first certificate is verified and the others
+/// are used, untrusted, to build the chain.
+///
+/// The certificates of a batch are shared by the calling thread and the
+/// worker threads, which are started on first use.  The trust store is
+/// shared and only read, so any number of batches can be verified at the
+/// same time.
+///
+/// All methods are thread-safe.
+class ofSSLCertificateVerifier
+{
+public:
+    /// \brief The result of verifying one certificate chain.
+    struct Result
+    {
+        enum Status: uint8_t
+        {
+            /// \brief The chain was verified.
+            VERIFIED,
+            /// \brief The chain failed verification.
+            FAILED,
+            /// \brief The certificate could not be decoded.
+            UNREADABLE
+        };
+
+        /// \returns true iff the chain was verified.
+        bool ok() const
+        {
+            return status == VERIFIED;
+        }
+
+        /// \brief The outcome of the verification.
+        Status status = UNREADABLE;
+
+        /// \brief The OpenSSL X509_V_ERR_* error number, or X509_V_OK.
+        ///
+        /// X509_verify_cert_error_string() describes it.
+        int error = X509_V_OK;
+
+        /// \brief The depth in the chain of the certificate with the error,
+        ///        or -1.
+        int depth = -1;
+
+        /// \brief The end of the validity period of the first certificate,
+        ///        if it could be decoded.
+        std::chrono::system_clock::time_point expiresOn;
+    };
+
+    /// \brief Create a verifier.
+    /// \param threadCount The number of threads verifying a batch, including
+    ///        the calling thread, or 0 for the number of hardware threads.
+    ofSSLCertificateVerifier(std::size_t threadCount = 0);
+
+    /// \brief Stop the worker threads.
+    ~ofSSLCertificateVerifier();
+
+    /// \brief Verify a batch of certificate chains.
+    ///
+    /// The call returns when the whole batch is verified.
+    ///
+    /// \param certificates The PEM or DER encoded certificate chains.
+    /// \returns The results, in the order of the certificates.
+    std::vector<Result> verify(const std::vector<std::string>& certificates);
+
+    /// \brief Set the trust store that chains are verified against.
+    /// \param pTrustStore The trust store, or nullptr to use
+    ///        ofSSLManager::getTrustStore().
+    void setTrustStore(ofSSLTrustStore::Ptr pTrustStore);
+
+    /// \returns the trust store that chains are verified against, or nullptr
+    ///          for ofSSLManager::getTrustStore().
+    ofSSLTrustStore::Ptr getTrustStore() const;
+
+    /// \brief Set the number of threads verifying a batch.
+    ///
+    /// Batches that are being verified keep their threads.
+    ///
+    /// \param threadCount The number of threads, including the calling
+    ///        thread, or 0 for the number of hardware threads.
+    void setThreadCount(std::size_t threadCount);
+
+    /// \returns the number of threads verifying a batch, including the
+    ///          calling thread.
+    std::size_t getThreadCount() const;
+
+    /// \returns the number of chains verified.
+    uint64_t getVerified() const;
+
+    /// \returns the number of chains that failed verification.
+    uint64_t getFailed() const;
+
+    /// \returns the number of certificates that could not be decoded.
+    uint64_t getUnreadable() const;
+
+    /// \brief Reset the verified, failed and unreadable counters.
+    void resetCounters();
+
+    /// \brief Verify one certificate chain on the calling thread.
+    /// \param certificate The PEM or DER encoded certificate chain.
+    /// \param pStore The trusted certificates.
+    /// \param pContext A verification context to reuse, or nullptr.
+    /// \returns The result.
+    static Result verify(const std::string& certificate,
+                         X509_STORE* pStore,
+                         X509_STORE_CTX* pContext = nullptr);
+
+private:
+    struct Batch
+    {
+        const std::vector<std::string>* certificates = nullptr;
+        std::vector<Result>* results = nullptr;
+        X509_STORE* pStore = nullptr;
+
+        /// \brief The number of certificates.
+        std::size_t count = 0;
+
+        /// \brief The index of the next certificate to verify.
+        std::atomic<std::size_t> next;
+
+        /// \brief The number of certificates not yet verified.
+        std::atomic<std::size_t> remaining;
+
+        /// \brief Notifies the calling thread when the batch is verified.
+        std::condition_variable done;
+
+        /// \brief The mutex protecting the notification.
+        std::mutex mutex;
+    };
+
+    /// \brief Verify certificates of a batch until none are left.
+    void _work(Batch& batch);
+
+    /// \brief Start the worker threads if they are not running.
+    void _startWorkers();
+
+    /// \brief Stop the worker threads.
+    void _stopWorkers();
+
+    /// \brief Work on queued batches until stopped.
+    void _run();
+
+    /// \brief The trust store, or nullptr for the default.
+    ofSSLTrustStore::Ptr _pTrustStore;
+
+    /// \brief The mutex protecting the trust store.
+    mutable std::mutex _trustStoreMutex;
+
+    std::atomic<std::size_t> _threadCount;
+
+    std::atomic<uint64_t> _verified;
+    std::atomic<uint64_t> _failed;
+    std::atomic<uint64_t> _unreadable;
+
+    /// \brief The batches with certificates left to verify, oldest first.
+    std::deque<std::shared_ptr<Batch>> _batches;
+
+    /// \brief The worker threads.
+    std::vector<std::thread> _workers;
+
+    /// \brief True while the worker threads should stop.
+    bool _workersStopping = false;
+
+    /// \brief Wakes the worker threads.
+    std::condition_variable _workerCondition;
+
+    /// \brief The mutex protecting the batches and worker threads.
+    std::mutex _workerMutex;
+
+};
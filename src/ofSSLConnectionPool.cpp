@@ -0,0 +1,541 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLConnectionPool.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "Poco/Exception.h"
+#include "Poco/Net/SocketAddress.h"
+#include "ofLog.h"
+#include "ofSSLManager.h"
+#include "ofSSLSessionCache.h"
+
+
+const std::size_t ofSSLConnectionPool::DEFAULT_MINIMUM_SIZE = 2;
+const std::size_t ofSSLConnectionPool::DEFAULT_MAXIMUM_SIZE = 16;
+const std::chrono::seconds ofSSLConnectionPool::DEFAULT_IDLE_TIMEOUT = std::chrono::seconds(60);
+const std::chrono::milliseconds ofSSLConnectionPool::MAINTENANCE_INTERVAL = std::chrono::milliseconds(1000);
+
+
+namespace
+{
+
+
+void closeQuietly(Poco::Net::SecureStreamSocket& socket)
+{
+    try
+    {
+        socket.close();
+    }
+    catch (...)
+    {
+    }
+}
+
+
+/// \returns true iff an idle connection has something to read, or can't be
+///          polled.
+bool hasInput(Poco::Net::SecureStreamSocket& socket)
+{
+    try
+    {
+        return socket.poll(Poco::Timespan(0), Poco::Net::Socket::SELECT_READ);
+    }
+    catch (const Poco::Exception&)
+    {
+        return true;
+    }
+}
+
+
+}
+
+
+ofSSLConnectionPool::ofSSLConnectionPool():
+    _minimumSize(DEFAULT_MINIMUM_SIZE),
+    _maximumSize(DEFAULT_MAXIMUM_SIZE),
+    _idleTimeoutSeconds(DEFAULT_IDLE_TIMEOUT.count()),
+    _hits(0),
+    _misses(0),
+    _healthCheckFailures(0),
+    _expirations(0)
+{
+}
+
+
+ofSSLConnectionPool::~ofSSLConnectionPool()
+{
+    clear();
+}
+
+
+Poco::Net::SecureStreamSocket ofSSLConnectionPool::acquire(const std::string& host,
+                                                           uint16_t port)
+{
+    std::string key = ofSSLSessionCache::makeKey(host, port);
+    Stripe& stripe = _stripe(key);
+
+    while (true)
+    {
+        Connection connection;
+
+        {
+            std::unique_lock<std::mutex> lock(stripe.mutex);
+
+            auto iter = stripe.hosts.find(key);
+
+            if (iter == stripe.hosts.end() || iter->second.idle.empty())
+                break;
+
+            // The most recently used connection is the least likely to have
+            // been closed by the server.
+            connection = iter->second.idle.back();
+            iter->second.idle.pop_back();
+        }
+
+        if (isHealthy(connection.socket))
+        {
+            ++_hits;
+            return connection.socket;
+        }
+
+        ++_healthCheckFailures;
+        closeQuietly(connection.socket);
+    }
+
+    ++_misses;
+    return _connect(host, port);
+}
+
+
+void ofSSLConnectionPool::release(const std::string& host,
+                                  uint16_t port,
+                                  Poco::Net::SecureStreamSocket socket)
+{
+    // TLS 1.3 session tickets arrive after the handshake, so the session
+    // is only resumable once a response has been received.
+    ofSSLManager::setClientSession(host, port, socket.currentSession());
+
+    std::string key = ofSSLSessionCache::makeKey(host, port);
+    Stripe& stripe = _stripe(key);
+
+    {
+        std::unique_lock<std::mutex> lock(stripe.mutex);
+
+        Host& entry = stripe.hosts[key];
+
+        if (entry.idle.size() < _maximumSize.load())
+        {
+            entry.host = host;
+            entry.port = port;
+            entry.idle.push_back({ socket, Clock::now() });
+            lock.unlock();
+            _startMaintenance();
+            return;
+        }
+    }
+
+    closeQuietly(socket);
+}
+
+
+void ofSSLConnectionPool::prewarm(const std::string& host, uint16_t port)
+{
+    std::string key = ofSSLSessionCache::makeKey(host, port);
+    Stripe& stripe = _stripe(key);
+
+    {
+        std::unique_lock<std::mutex> lock(stripe.mutex);
+        Host& entry = stripe.hosts[key];
+        entry.host = host;
+        entry.port = port;
+        entry.prewarmed = true;
+    }
+
+    _startMaintenance();
+    _maintenanceCondition.notify_all();
+}
+
+
+void ofSSLConnectionPool::clear()
+{
+    _stopMaintenance();
+
+    for (auto& stripe: _stripes)
+    {
+        std::unordered_map<std::string, Host> hosts;
+
+        {
+            std::unique_lock<std::mutex> lock(stripe.mutex);
+            hosts.swap(stripe.hosts);
+        }
+
+        for (auto& entry: hosts)
+        {
+            for (auto& connection: entry.second.idle)
+                closeQuietly(connection.socket);
+        }
+    }
+}
+
+
+std::size_t ofSSLConnectionPool::size(const std::string& host, uint16_t port) const
+{
+    std::string key = ofSSLSessionCache::makeKey(host, port);
+    const Stripe& stripe = _stripe(key);
+    std::unique_lock<std::mutex> lock(stripe.mutex);
+    auto iter = stripe.hosts.find(key);
+    return iter != stripe.hosts.end() ? iter->second.idle.size() : 0;
+}
+
+
+void ofSSLConnectionPool::setContext(Poco::Net::Context::Ptr pContext)
+{
+    std::unique_lock<std::mutex> lock(_contextMutex);
+    _pContext = pContext;
+}
+
+
+Poco::Net::Context::Ptr ofSSLConnectionPool::getContext() const
+{
+    std::unique_lock<std::mutex> lock(_contextMutex);
+    return _pContext;
+}
+
+
+void ofSSLConnectionPool::setMinimumSize(std::size_t minimumSize)
+{
+    _minimumSize = minimumSize;
+    _maintenanceCondition.notify_all();
+}
+
+
+std::size_t ofSSLConnectionPool::getMinimumSize() const
+{
+    return _minimumSize;
+}
+
+
+void ofSSLConnectionPool::setMaximumSize(std::size_t maximumSize)
+{
+    _maximumSize = maximumSize;
+}
+
+
+std::size_t ofSSLConnectionPool::getMaximumSize() const
+{
+    return _maximumSize;
+}
+
+
+void ofSSLConnectionPool::setIdleTimeout(std::chrono::seconds idleTimeout)
+{
+    _idleTimeoutSeconds = idleTimeout.count();
+}
+
+
+std::chrono::seconds ofSSLConnectionPool::getIdleTimeout() const
+{
+    return std::chrono::seconds(_idleTimeoutSeconds.load());
+}
+
+
+uint64_t ofSSLConnectionPool::getHits() const
+{
+    return _hits;
+}
+
+
+uint64_t ofSSLConnectionPool::getMisses() const
+{
+    return _misses;
+}
+
+
+uint64_t ofSSLConnectionPool::getHealthCheckFailures() const
+{
+    return _healthCheckFailures;
+}
+
+
+uint64_t ofSSLConnectionPool::getExpirations() const
+{
+    return _expirations;
+}
+
+
+void ofSSLConnectionPool::resetCounters()
+{
+    _hits = 0;
+    _misses = 0;
+    _healthCheckFailures = 0;
+    _expirations = 0;
+}
+
+
+bool ofSSLConnectionPool::isHealthy(Poco::Net::SecureStreamSocket& socket)
+{
+    try
+    {
+        // An idle connection has nothing to read.
+        if (!socket.poll(Poco::Timespan(0), Poco::Net::Socket::SELECT_READ))
+            return true;
+
+        // Something arrived.  Post-handshake messages are consumed without
+        // returning data, while a close or application data means that the
+        // connection is out of step with the server.
+        socket.setBlocking(false);
+        char c;
+        int n = socket.receiveBytes(&c, 1);
+        socket.setBlocking(true);
+        return n < 0;
+    }
+    catch (const Poco::Exception&)
+    {
+        return false;
+    }
+}
+
+
+ofSSLConnectionPool::Stripe& ofSSLConnectionPool::_stripe(const std::string& key)
+{
+    return _stripes[std::hash<std::string>()(key) % STRIPE_COUNT];
+}
+
+
+const ofSSLConnectionPool::Stripe& ofSSLConnectionPool::_stripe(const std::string& key) const
+{
+    return _stripes[std::hash<std::string>()(key) % STRIPE_COUNT];
+}
+
+
+Poco::Net::SecureStreamSocket ofSSLConnectionPool::_connect(const std::string& host,
+                                                            uint16_t port)
+{
+    Poco::Net::Context::Ptr pContext = getContext();
+
+    if (pContext.isNull())
+        pContext = ofSSLManager::getDefaultClientContext();
+
+    Poco::Net::SecureStreamSocket socket(Poco::Net::SocketAddress(host, port),
+                                         host,
+                                         pContext,
+                                         ofSSLManager::getClientSession(host, port));
+    socket.completeHandshake();
+    ofSSLManager::setClientSession(host, port, socket.currentSession());
+    return socket;
+}
+
+
+void ofSSLConnectionPool::_startMaintenance()
+{
+    std::unique_lock<std::mutex> lock(_maintenanceMutex);
+
+    // Nothing is started while clear() is stopping the thread.
+    if (!_maintenanceThread.joinable() && !_maintenanceStopping)
+        _maintenanceThread = std::thread([this]() { _maintain(); });
+}
+
+
+void ofSSLConnectionPool::_stopMaintenance()
+{
+    std::thread thread;
+
+    {
+        std::unique_lock<std::mutex> lock(_maintenanceMutex);
+        _maintenanceStopping = true;
+        thread.swap(_maintenanceThread);
+    }
+
+    _maintenanceCondition.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+
+    std::unique_lock<std::mutex> lock(_maintenanceMutex);
+    _maintenanceStopping = false;
+}
+
+
+void ofSSLConnectionPool::_maintain()
+{
+    std::unique_lock<std::mutex> lock(_maintenanceMutex);
+
+    while (!_maintenanceStopping)
+    {
+        lock.unlock();
+
+        for (auto& stripe: _stripes)
+            _maintain(stripe);
+
+        lock.lock();
+
+        if (!_maintenanceStopping)
+            _maintenanceCondition.wait_for(lock, MAINTENANCE_INTERVAL);
+    }
+}
+
+
+void ofSSLConnectionPool::_maintain(Stripe& stripe)
+{
+    struct Pending
+    {
+        std::string key;
+        std::string host;
+        uint16_t port;
+        std::vector<Connection> received;
+        std::size_t connect;
+    };
+
+    std::vector<Pending> pending;
+    std::vector<Connection> expired;
+    std::size_t minimumSize = _minimumSize;
+    std::size_t maximumSize = _maximumSize;
+    Clock::time_point now = Clock::now();
+    std::chrono::seconds idleTimeout(_idleTimeoutSeconds.load());
+
+    // Polling doesn't block, so idle connections are checked in place and
+    // stay available to acquire().  Only expired connections and
+    // connections that received something are taken out.
+    {
+        std::unique_lock<std::mutex> lock(stripe.mutex);
+
+        auto iter = stripe.hosts.begin();
+
+        while (iter != stripe.hosts.end())
+        {
+            Host& entry = iter->second;
+
+            if (entry.idle.empty() && entry.connecting == 0 && !entry.prewarmed)
+            {
+                iter = stripe.hosts.erase(iter);
+                continue;
+            }
+
+            Pending p;
+            p.key = iter->first;
+            p.host = entry.host;
+            p.port = entry.port;
+            p.connect = 0;
+
+            std::size_t keep = entry.prewarmed ? std::min(minimumSize, maximumSize) : 0;
+
+            // Oldest first, expiring only the connections above the minimum.
+            std::size_t expirable = entry.idle.size() > keep ? entry.idle.size() - keep : 0;
+
+            auto connection = entry.idle.begin();
+
+            while (connection != entry.idle.end())
+            {
+                if (expirable > 0 && now - connection->idleSince >= idleTimeout)
+                {
+                    --expirable;
+                    expired.push_back(*connection);
+                    connection = entry.idle.erase(connection);
+                }
+                else if (hasInput(connection->socket))
+                {
+                    p.received.push_back(*connection);
+                    connection = entry.idle.erase(connection);
+                }
+                else
+                {
+                    ++connection;
+                }
+            }
+
+            std::size_t available = entry.idle.size() + p.received.size() + entry.connecting;
+
+            if (available < keep)
+            {
+                p.connect = keep - available;
+                entry.connecting += p.connect;
+            }
+
+            if (!p.received.empty() || p.connect > 0)
+                pending.push_back(std::move(p));
+
+            ++iter;
+        }
+    }
+
+    for (auto& connection: expired)
+    {
+        ++_expirations;
+        closeQuietly(connection.socket);
+    }
+
+    for (auto& p: pending)
+    {
+        if (p.received.empty())
+            continue;
+
+        std::vector<Connection> survivors;
+
+        for (auto& connection: p.received)
+        {
+            if (isHealthy(connection.socket))
+            {
+                survivors.push_back(connection);
+            }
+            else
+            {
+                ++_healthCheckFailures;
+                closeQuietly(connection.socket);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(stripe.mutex);
+
+        // Checked connections are older than the connections released in
+        // the meantime.
+        Host& entry = stripe.hosts[p.key];
+        entry.idle.insert(entry.idle.begin(), survivors.begin(), survivors.end());
+    }
+
+    // Hosts are refilled one connection at a time, so a slow host only
+    // delays the hosts refilled after it.
+    for (auto& p: pending)
+    {
+        while (p.connect > 0)
+        {
+            Connection connection;
+
+            try
+            {
+                connection = { _connect(p.host, p.port), Clock::now() };
+            }
+            catch (const Poco::Exception& exc)
+            {
+                ofLogWarning("ofSSLConnectionPool::_maintain") << "Unable to connect to " << p.key << ": " << exc.displayText();
+
+                std::unique_lock<std::mutex> lock(stripe.mutex);
+                stripe.hosts[p.key].connecting -= p.connect;
+                break;
+            }
+
+            --p.connect;
+
+            std::unique_lock<std::mutex> lock(stripe.mutex);
+
+            Host& entry = stripe.hosts[p.key];
+            entry.host = p.host;
+            entry.port = p.port;
+            --entry.connecting;
+
+            if (entry.idle.size() < maximumSize)
+            {
+                entry.idle.push_front(connection);
+                continue;
+            }
+
+            lock.unlock();
+            closeQuietly(connection.socket);
+        }
+    }
+}
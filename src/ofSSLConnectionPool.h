@@ -0,0 +1,265 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "Poco/Net/Context.h"
+#include "Poco/Net/SecureStreamSocket.h"
+
+
+/// \brief A pool of connected client sockets for each host and port.
+///
+/// Connecting to a server costs a TCP handshake and a TLS handshake.  For
+/// services that make many short requests to the same few hosts, the pool
+/// keeps connections that have completed their handshake, so that a
+/// request can start immediately:
+///
+/// ~~~{.cpp}
+///     ofSSLConnectionPool& pool = ofSSLManager::getClientConnectionPool();
+///
+///     Poco::Net::SecureStreamSocket socket = pool.acquire("api.example.com", 443);
+///     // ... send a request and receive the complete response ...
+///     pool.release("api.example.com", 443, socket);
+/// ~~~
+///
+/// Only release a connection after a complete response has been received,
+/// and don't release connections the server may have closed (e.g. after a
+/// "Connection: close" response).  Connections are checked before they
+/// are handed out, and connections that were closed or have unexpected
+/// data are discarded.
+///
+/// At most the maximum size of idle connections is kept for each host, and
+/// connections idle for longer than the idle timeout are closed.  Hosts
+/// prepared with prewarm() are kept at the minimum size in the background.
+/// Connections use the default Client Context (or the Context set with
+/// setContext()) and resume sessions from the client session cache.
+///
+/// Hosts are spread over independently locked stripes, and acquiring or
+/// releasing a connection takes one stripe lock for a constant time, so
+/// threads using different hosts do not contend.
+///
+/// All methods are thread-safe.
+class ofSSLConnectionPool
+{
+public:
+    /// \brief The default minimum number of idle connections for prewarmed hosts.
+    static const std::size_t DEFAULT_MINIMUM_SIZE;
+
+    /// \brief The default maximum number of idle connections for each host.
+    static const std::size_t DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The default time an idle connection is kept.
+    static const std::chrono::seconds DEFAULT_IDLE_TIMEOUT;
+
+    /// \brief The time between background maintenance passes.
+    static const std::chrono::milliseconds MAINTENANCE_INTERVAL;
+
+    /// \brief Create an empty connection pool.
+    ofSSLConnectionPool();
+
+    /// \brief Close all connections and stop background maintenance.
+    ~ofSSLConnectionPool();
+
+    /// \brief Get a connection to a host.
+    ///
+    /// The most recently released healthy connection is returned.  If there
+    /// is none, a new connection is made and its handshake completed.
+    ///
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \returns A connected socket that has completed its handshake.
+    /// \throws Poco::Exception if a new connection fails.
+    Poco::Net::SecureStreamSocket acquire(const std::string& host, uint16_t port);
+
+    /// \brief Return a connection to the pool.
+    ///
+    /// If the host already has the maximum number of idle connections, the
+    /// connection is closed.
+    ///
+    /// \param host The server host name passed to acquire().
+    /// \param port The server port passed to acquire().
+    /// \param socket The connection, idle after a complete response.
+    void release(const std::string& host,
+                 uint16_t port,
+                 Poco::Net::SecureStreamSocket socket);
+
+    /// \brief Keep the minimum number of connections to a host ready.
+    ///
+    /// Connections are made in the background, and replaced in the
+    /// background when they are used, expire or fail.
+    ///
+    /// \param host The server host name.
+    /// \param port The server port.
+    void prewarm(const std::string& host, uint16_t port);
+
+    /// \brief Close all idle connections, forget prewarmed hosts and stop
+    ///        background maintenance.
+    void clear();
+
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \returns the number of idle connections to a host.
+    std::size_t size(const std::string& host, uint16_t port) const;
+
+    /// \brief Set the Context used for new connections.
+    /// \param pContext The Context, or nullptr to use the default Client
+    ///        Context.
+    void setContext(Poco::Net::Context::Ptr pContext);
+
+    /// \returns the Context used for new connections, or nullptr for the
+    ///          default Client Context.
+    Poco::Net::Context::Ptr getContext() const;
+
+    /// \brief Set the number of idle connections kept for prewarmed hosts.
+    /// \param minimumSize The minimum number of idle connections.
+    void setMinimumSize(std::size_t minimumSize);
+
+    /// \returns the number of idle connections kept for prewarmed hosts.
+    std::size_t getMinimumSize() const;
+
+    /// \brief Set the maximum number of idle connections kept for each host.
+    /// \param maximumSize The maximum number of idle connections.
+    void setMaximumSize(std::size_t maximumSize);
+
+    /// \returns the maximum number of idle connections kept for each host.
+    std::size_t getMaximumSize() const;
+
+    /// \brief Set the time an idle connection is kept.
+    ///
+    /// Connections that are kept for the minimum size of a prewarmed host
+    /// don't expire.
+    ///
+    /// \param idleTimeout The idle timeout.
+    void setIdleTimeout(std::chrono::seconds idleTimeout);
+
+    /// \returns the time an idle connection is kept.
+    std::chrono::seconds getIdleTimeout() const;
+
+    /// \returns the number of acquisitions that returned a pooled connection.
+    uint64_t getHits() const;
+
+    /// \returns the number of acquisitions that made a new connection.
+    uint64_t getMisses() const;
+
+    /// \returns the number of idle connections discarded by health checks.
+    uint64_t getHealthCheckFailures() const;
+
+    /// \returns the number of idle connections closed because they expired.
+    uint64_t getExpirations() const;
+
+    /// \brief Reset the hit, miss, health check failure and expiration
+    ///        counters.
+    void resetCounters();
+
+    /// \brief Check if an idle connection can be used.
+    ///
+    /// A connection is healthy if the server has not closed it and has not
+    /// sent application data.  Post-handshake messages, like TLS 1.3
+    /// session tickets, are processed.
+    ///
+    /// \param socket The idle connection.
+    /// \returns true iff the connection can be used.
+    static bool isHealthy(Poco::Net::SecureStreamSocket& socket);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum
+    {
+        /// \brief The number of independently locked stripes.
+        STRIPE_COUNT = 16
+    };
+
+    struct Connection
+    {
+        Poco::Net::SecureStreamSocket socket;
+        Clock::time_point idleSince;
+    };
+
+    struct Host
+    {
+        std::string host;
+        uint16_t port = 0;
+
+        /// \brief The idle connections, most recently released last.
+        std::deque<Connection> idle;
+
+        /// \brief The number of connections being made in the background.
+        std::size_t connecting = 0;
+
+        /// \brief True if the host is kept at the minimum size.
+        bool prewarmed = false;
+    };
+
+    struct Stripe
+    {
+        std::unordered_map<std::string, Host> hosts;
+
+        /// \brief The mutex protecting the hosts.
+        mutable std::mutex mutex;
+    };
+
+    /// \returns the stripe holding a host key.
+    Stripe& _stripe(const std::string& key);
+    const Stripe& _stripe(const std::string& key) const;
+
+    /// \brief Make a new connection and complete its handshake.
+    Poco::Net::SecureStreamSocket _connect(const std::string& host, uint16_t port);
+
+    /// \brief Start the maintenance thread if it is not running.
+    void _startMaintenance();
+
+    /// \brief Stop the maintenance thread.
+    void _stopMaintenance();
+
+    /// \brief Expire, check and refill idle connections until stopped.
+    void _maintain();
+
+    /// \brief Run one maintenance pass over a stripe.
+    void _maintain(Stripe& stripe);
+
+    std::array<Stripe, STRIPE_COUNT> _stripes;
+
+    /// \brief The Context for new connections, or nullptr for the default.
+    Poco::Net::Context::Ptr _pContext;
+
+    /// \brief The mutex protecting the Context.
+    mutable std::mutex _contextMutex;
+
+    std::atomic<std::size_t> _minimumSize;
+    std::atomic<std::size_t> _maximumSize;
+    std::atomic<int64_t> _idleTimeoutSeconds;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _healthCheckFailures;
+    std::atomic<uint64_t> _expirations;
+
+    /// \brief The background maintenance thread.
+    std::thread _maintenanceThread;
+
+    /// \brief True while the maintenance thread should stop.
+    bool _maintenanceStopping = false;
+
+    /// \brief Wakes the maintenance thread.
+    std::condition_variable _maintenanceCondition;
+
+    /// \brief The mutex protecting the maintenance thread.
+    std::mutex _maintenanceMutex;
+
+};
@@ -0,0 +1,213 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLKernelTLS.h"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include "Poco/Exception.h"
+
+
+#if defined(__linux__)
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/sendfile.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+#endif
+
+
+#if defined(__linux__) && OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+    #define OF_SSL_KERNEL_TLS 1
+#else
+    #define OF_SSL_KERNEL_TLS 0
+#endif
+
+
+namespace
+{
+
+
+// From linux/tls.h, which older kernel headers don't provide.
+const int KERNEL_SOL_TLS = 282;
+const int KERNEL_TLS_TX = 1;
+const int KERNEL_TLS_RX = 2;
+
+// struct tls_crypto_info, the header of the crypto info the kernel returns.
+struct KernelTLSCryptoInfo
+{
+    uint16_t version;
+    uint16_t cipherType;
+};
+
+const std::size_t FALLBACK_BUFFER_SIZE = 16384;
+
+
+}
+
+
+bool ofSSLKernelTLS::isAvailable()
+{
+    return OF_SSL_KERNEL_TLS == 1;
+}
+
+
+void ofSSLKernelTLS::enable(Poco::Net::Context::Ptr pContext)
+{
+#if OF_SSL_KERNEL_TLS
+    SSL_CTX_set_options(pContext->sslContext(), SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+
+bool ofSSLKernelTLS::isEnabled(Poco::Net::Context::Ptr pContext)
+{
+#if OF_SSL_KERNEL_TLS
+    return (SSL_CTX_get_options(pContext->sslContext()) & SSL_OP_ENABLE_KTLS) != 0;
+#else
+    return false;
+#endif
+}
+
+
+bool ofSSLKernelTLS::isSendOffloaded(const Poco::Net::Socket& socket)
+{
+    return socket.impl() != nullptr && _hasKernelTLS(socket.impl()->sockfd(), KERNEL_TLS_TX);
+}
+
+
+bool ofSSLKernelTLS::isReceiveOffloaded(const Poco::Net::Socket& socket)
+{
+    return socket.impl() != nullptr && _hasKernelTLS(socket.impl()->sockfd(), KERNEL_TLS_RX);
+}
+
+
+bool ofSSLKernelTLS::isSendOffloaded(const SSL* ssl)
+{
+#if OF_SSL_KERNEL_TLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) == 1;
+#else
+    return false;
+#endif
+}
+
+
+bool ofSSLKernelTLS::isReceiveOffloaded(const SSL* ssl)
+{
+#if OF_SSL_KERNEL_TLS
+    return BIO_get_ktls_recv(SSL_get_rbio(ssl)) == 1;
+#else
+    return false;
+#endif
+}
+
+
+int64_t ofSSLKernelTLS::sendFile(Poco::Net::StreamSocket& socket,
+                                 const std::string& path,
+                                 int64_t offset,
+                                 int64_t count)
+{
+#if defined(__linux__)
+    if (isSendOffloaded(socket))
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            throw Poco::OpenFileException(path);
+
+        struct stat status;
+
+        if (::fstat(fd, &status) != 0)
+        {
+            ::close(fd);
+            throw Poco::ReadFileException(path);
+        }
+
+        int64_t remaining = count < 0 ? std::max<int64_t>(status.st_size - offset, 0) : count;
+        int64_t sent = 0;
+        off_t position = static_cast<off_t>(offset);
+
+        while (remaining > 0)
+        {
+            ssize_t n = ::sendfile(socket.impl()->sockfd(), fd, &position, static_cast<std::size_t>(remaining));
+
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            if (n < 0 && errno == EAGAIN && socket.poll(socket.getSendTimeout(), Poco::Net::Socket::SELECT_WRITE))
+                continue;
+
+            if (n <= 0)
+            {
+                int error = errno;
+                ::close(fd);
+
+                if (n == 0)
+                    return sent;
+
+                throw Poco::IOException("sendfile failed", path, error);
+            }
+
+            sent += n;
+            remaining -= n;
+        }
+
+        ::close(fd);
+        return sent;
+    }
+#endif
+
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+        throw Poco::OpenFileException(path);
+
+    file.seekg(offset);
+
+    std::vector<char> buffer(FALLBACK_BUFFER_SIZE);
+    int64_t sent = 0;
+
+    while (count < 0 || sent < count)
+    {
+        std::size_t size = buffer.size();
+
+        if (count >= 0)
+            size = static_cast<std::size_t>(std::min<int64_t>(size, count - sent));
+
+        file.read(buffer.data(), size);
+        std::streamsize n = file.gcount();
+
+        if (n <= 0)
+            break;
+
+        for (std::streamsize written = 0; written < n; )
+            written += socket.sendBytes(buffer.data() + written, static_cast<int>(n - written));
+
+        sent += n;
+    }
+
+    return sent;
+}
+
+
+bool ofSSLKernelTLS::_hasKernelTLS(int fd, int direction)
+{
+#if defined(__linux__)
+    if (fd < 0)
+        return false;
+
+    // The kernel only returns crypto info once keys are installed.  Asking
+    // for the header alone avoids copying the keys, and any other length
+    // that doesn't match the cipher is rejected with EINVAL.
+    KernelTLSCryptoInfo info;
+    socklen_t length = sizeof(info);
+    return ::getsockopt(fd, KERNEL_SOL_TLS, direction, &info, &length) == 0;
+#else
+    return false;
+#endif
+}
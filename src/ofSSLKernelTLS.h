@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <openssl/ssl.h>
+#include "Poco/Net/Context.h"
+#include "Poco/Net/StreamSocket.h"
+
+
+/// \brief Helpers for Linux kernel TLS (kTLS) offload.
+///
+/// With kernel TLS, OpenSSL hands the session keys to the kernel after the
+/// handshake, and the kernel encrypts (and optionally decrypts) the records.
+/// Data written to the socket, including data sent with sendfile(), is then
+/// encrypted without being copied through userspace.
+///
+/// Offload requires OpenSSL 3 built with kTLS support, a Linux kernel with
+/// the tls module, and a cipher the kernel supports (AES-GCM, and
+/// ChaCha20-Poly1305 on newer kernels).  When any of these is missing, the
+/// connection silently uses userspace TLS, so enabling offload is always
+/// safe.
+///
+/// ~~~{.cpp}
+///     ofSSLManager::setKernelTLSEnabled(true);
+///     // ... accept a connection with the default Server Context ...
+///     ofSSLKernelTLS::sendFile(socket, ofToDataPath("video.mp4", true));
+/// ~~~
+class ofSSLKernelTLS
+{
+public:
+    /// \returns true iff this build of OpenSSL and platform support kernel TLS.
+    static bool isAvailable();
+
+    /// \brief Let a Context use kernel TLS for its connections.
+    ///
+    /// Does nothing if kernel TLS is not available.
+    ///
+    /// \param pContext The Context to configure.
+    static void enable(Poco::Net::Context::Ptr pContext);
+
+    /// \returns true iff the Context lets its connections use kernel TLS.
+    static bool isEnabled(Poco::Net::Context::Ptr pContext);
+
+    /// \brief Determine if the kernel encrypts data sent on a connection.
+    /// \param socket The socket, after the handshake.
+    /// \returns true iff sending is offloaded to the kernel.
+    static bool isSendOffloaded(const Poco::Net::Socket& socket);
+
+    /// \brief Determine if the kernel decrypts data received on a connection.
+    /// \param socket The socket, after the handshake.
+    /// \returns true iff receiving is offloaded to the kernel.
+    static bool isReceiveOffloaded(const Poco::Net::Socket& socket);
+
+    /// \brief Determine if the kernel encrypts data sent by an SSL connection.
+    /// \param ssl The connection, after the handshake.
+    /// \returns true iff sending is offloaded to the kernel.
+    static bool isSendOffloaded(const SSL* ssl);
+
+    /// \brief Determine if the kernel decrypts data received by an SSL connection.
+    /// \param ssl The connection, after the handshake.
+    /// \returns true iff receiving is offloaded to the kernel.
+    static bool isReceiveOffloaded(const SSL* ssl);
+
+    /// \brief Send part of a file on a connection.
+    ///
+    /// When sending is offloaded, the file is sent with sendfile() and never
+    /// copied to userspace.  Otherwise it is read and sent through OpenSSL.
+    ///
+    /// \param socket The connected socket, after the handshake.
+    /// \param path The path of the file to send.
+    /// \param offset The offset of the first byte to send.
+    /// \param count The number of bytes to send, or -1 to send to the end.
+    /// \returns the number of bytes sent.
+    /// \throws Poco::Exception if the file can't be read or the connection fails.
+    static int64_t sendFile(Poco::Net::StreamSocket& socket,
+                            const std::string& path,
+                            int64_t offset = 0,
+                            int64_t count = -1);
+
+private:
+    /// \brief Determine if a socket has a kernel TLS direction configured.
+    /// \param fd The socket file descriptor.
+    /// \param direction TLS_TX or TLS_RX.
+    static bool _hasKernelTLS(int fd, int direction);
+
+};
@@ -6,130 +6,1828 @@
 
 
 #include "ofSSLManager.h"
+#include <algorithm>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include "Poco/Net/SSLException.h"
 #include "ofLog.h"
 
 
+#if defined(__x86_64__) || defined(__i386__)
+    #if defined(__GNUC__)
+        #include <cpuid.h>
+    #endif
+#elif defined(_M_X64) || defined(_M_IX86)
+    #include <intrin.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+    #include <sys/auxv.h>
+    #include <asm/hwcap.h>
+#endif
+
+
+namespace
+{
+
+
+// ECDHE suites in the profile's order, then the remaining strong suites for
+// compatibility with older peers.
+const char* AES_CIPHER_LIST = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                              "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                              "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+                              "HIGH:!aNULL:!eNULL:!MD5:!RC4";
+
+const char* CHACHA20_CIPHER_LIST = "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+                                   "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                                   "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                                   "HIGH:!aNULL:!eNULL:!MD5:!RC4";
+
+const char* AES_CIPHERSUITES = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+
+const char* CHACHA20_CIPHERSUITES = "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384";
+
+const char* GROUPS_LIST = "X25519:P-256:P-384";
+
+
+// True on the warmUp() thread, whose listeners must not wait for warmUp().
+thread_local bool isWarmingUp = false;
+
+
+}
+
+
 const std::string ofSSLManager::DEFAULT_CA_LOCATION       = "ssl/cacert.pem";
 const std::string ofSSLManager::DEFAULT_PRIVATE_KEY_FILE  = "ssl/privateKey.pem";
 const std::string ofSSLManager::DEFAULT_CERTIFICATE_FILE  = "ssl/certificate.pem";
+const std::string ofSSLManager::DEFAULT_CA_DIRECTORY      = "ssl/certs";
+const std::size_t ofSSLManager::DEFAULT_SERVER_SESSION_CACHE_SIZE = 4096;
+const std::chrono::seconds ofSSLManager::DEFAULT_SERVER_SESSION_TIMEOUT = std::chrono::seconds(300);
+const std::string ofSSLManager::SESSION_ID_CONTEXT = "ofxSSLManager";
+const std::chrono::milliseconds ofSSLManager::DEFAULT_ASYNC_VERIFICATION_TIMEOUT = std::chrono::milliseconds(100);
+const std::size_t ofSSLManager::DEFAULT_LOW_MEMORY_FRAGMENT_LENGTH = 4096;
+const uint32_t ofSSLManager::DEFAULT_MAX_EARLY_DATA = 16384;
+const std::string ofSSLManager::DEFAULT_OCSP_CACHE_DIRECTORY = "ssl/ocsp";
+const std::chrono::milliseconds ofSSLManager::PENDING_VERIFICATION_POLL_INTERVAL = std::chrono::milliseconds(10);
+
+
+ofSSLManager::ofSSLManager():
+    _clientSessionCacheEnabled(true),
+    _performanceProfile(PROFILE_AUTO),
+    _kernelTLSEnabled(false),
+    _lowMemoryModeEnabled(false),
+    _lowMemoryFragmentLength(DEFAULT_LOW_MEMORY_FRAGMENT_LENGTH),
+    _earlyDataEnabled(false),
+    _maxEarlyData(DEFAULT_MAX_EARLY_DATA),
+    _ocspStaplingEnabled(false),
+    _serverContextShardCount(1),
+    _serverShardGeneration(1),
+    _warmUpPending(false),
+    _warmUpWaitMicroseconds(0),
+    _warmUpWaitCount(0),
+    _serverReloadCount(0),
+    _serverReloadFailureCount(0),
+    _lastServerReloadMicroseconds(0),
+    _verificationCache(0),
+    _asyncVerificationCount(0),
+    _asyncVerificationTimeoutCount(0)
+{
+#if defined(OF_SSL_POOLED_ALLOCATOR)
+    // OpenSSL memory functions can only be replaced before OpenSSL allocates.
+    ofSSLAllocator::install();
+#endif
+
+    Poco::Net::initializeSSL();
+
+    // Host Contexts are configured like the default Server Context.
+    _serverCertificateStore.setContextFactory([](const std::string& privateKeyFile,
+                                                 const std::string& certificateFile) {
+        return _createServerContext(privateKeyFile, certificateFile);
+    });
+
+    Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
+    manager.ClientVerificationError      += Poco::delegate(this, &ofSSLManager::_onClientVerificationError);
+    manager.ServerVerificationError      += Poco::delegate(this, &ofSSLManager::_onServerVerificationError);
+    manager.PrivateKeyPassphraseRequired += Poco::delegate(this, &ofSSLManager::_onPrivateKeyPassphraseRequired);
+}
+
+
+ofSSLManager::~ofSSLManager()
+{
+    {
+        std::unique_lock<std::mutex> lock(_serverReloadMutex);
+        _serverReloadStopping = true;
+        _serverReloadCondition.notify_all();
+    }
+
+    if (_serverReloadThread.joinable())
+        _serverReloadThread.join();
+
+    {
+        std::unique_lock<std::mutex> lock(_asyncVerificationMutex);
+        _pendingVerificationsStopping = true;
+        _pendingVerificationCondition.notify_all();
+    }
+
+    if (_pendingVerificationThread.joinable())
+        _pendingVerificationThread.join();
+
+    // Pooled connections use the Contexts and the session cache.
+    _clientConnectionPool.clear();
+
+    Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
+    manager.ClientVerificationError      -= Poco::delegate(this, &ofSSLManager::_onClientVerificationError);
+    manager.ServerVerificationError      -= Poco::delegate(this, &ofSSLManager::_onServerVerificationError);
+    manager.PrivateKeyPassphraseRequired -= Poco::delegate(this, &ofSSLManager::_onPrivateKeyPassphraseRequired);
+
+    Poco::Net::uninitializeSSL();
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::getDefaultServerContext()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    if (manager._serverContext.current.load(std::memory_order_acquire) == nullptr)
+    {
+        _waitForWarmUp();
+        initializeServer(nullptr); // make sure it's initialized with something
+    }
+
+    if (manager._serverContextShardCount.load(std::memory_order_relaxed) > 1)
+        return _getServerContextShard();
+
+    return _load(manager._serverContext);
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::getDefaultClientContext()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    if (manager._clientContext.current.load(std::memory_order_acquire) == nullptr)
+    {
+        _waitForWarmUp();
+        initializeClient(nullptr); // make sure it's initialized with something
+    }
+
+    return _load(manager._clientContext);
+}
+
+
+void ofSSLManager::initializeClient(Poco::Net::Context::Ptr pContext)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._clientContextMutex);
+
+    if (!pContext.isNull())
+    {
+        Poco::Net::SSLManager::instance().initializeClient(nullptr,
+                                                           nullptr,
+                                                           pContext);
+        _publish(manager._clientContext, pContext);
+        return;
+    }
+
+    if (!_beginBuild(manager._clientContextBuild, lock, manager._clientContext))
+    {
+        ofLogVerbose("ofSSLManager::initializeClient") << "pContext exists or the manager has already been initialized.";
+        return;
+    }
+
+    lock.unlock();
+
+    Poco::Net::Context::Ptr _pContext;
+
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        _pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "");
+
+        getTrustStore()->attach(_pContext);
+
+        _pContext->enableSessionCache(manager._clientSessionCacheEnabled);
+
+        applyPerformanceProfile(_pContext, manager._performanceProfile);
+
+        if (manager._kernelTLSEnabled)
+            ofSSLKernelTLS::enable(_pContext);
+
+        if (manager._lowMemoryModeEnabled)
+            applyLowMemoryMode(_pContext, manager._lowMemoryFragmentLength);
+
+        manager._metrics.attach(_pContext);
+        manager._metrics.recordContextBuild(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+    }
+    catch (...)
+    {
+        lock.lock();
+        _endBuild(manager._clientContextBuild);
+        throw;
+    }
+
+    lock.lock();
+
+    // A Context passed in meanwhile is kept.
+    if (manager._clientContext.current.load(std::memory_order_acquire) == nullptr)
+    {
+        Poco::Net::SSLManager::instance().initializeClient(nullptr,
+                                                           nullptr,
+                                                           _pContext);
+        _publish(manager._clientContext, _pContext);
+    }
+
+    _endBuild(manager._clientContextBuild);
+}
+
+
+void ofSSLManager::initializeServer(Poco::Net::Context::Ptr pContext)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._serverContextMutex);
+
+    if (!pContext.isNull())
+    {
+        Poco::Net::SSLManager::instance().initializeServer(nullptr,
+                                                           nullptr,
+                                                           pContext);
+        _publishServerContext(pContext);
+        manager._serverContextIsDefault = false;
+        return;
+    }
+
+    if (!_beginBuild(manager._serverContextBuild, lock, manager._serverContext))
+    {
+        ofLogVerbose("ofSSLManager::initializeServer") << "pContext exists or the manager has already been initialized.";
+        return;
+    }
+
+    lock.unlock();
+
+    std::string version;
+    Poco::Net::Context::Ptr _pContext;
+
+    try
+    {
+        version = _getServerFilesVersion();
+        _pContext = _createServerContext();
+    }
+    catch (...)
+    {
+        lock.lock();
+        _endBuild(manager._serverContextBuild);
+        throw;
+    }
+
+    lock.lock();
+
+    // A Context passed in meanwhile is kept.
+    if (manager._serverContext.current.load(std::memory_order_acquire) == nullptr)
+    {
+        manager._serverFilesVersion = version;
+
+        Poco::Net::SSLManager::instance().initializeServer(nullptr,
+                                                           nullptr,
+                                                           _pContext);
+        _publishServerContext(_pContext);
+        manager._serverContextIsDefault = true;
+    }
+
+    _endBuild(manager._serverContextBuild);
+}
+
+
+bool ofSSLManager::_beginBuild(ContextBuild& build,
+                               std::unique_lock<std::mutex>& lock,
+                               const ContextSlot& slot)
+{
+    const std::atomic<Poco::Net::Context*>& current = slot.current;
+
+    if (current.load(std::memory_order_acquire) != nullptr)
+        return false;
+
+    // Waiting for this thread's own build would never return.
+    if (build.builder == std::this_thread::get_id())
+        throw Poco::IllegalStateException("The default Context is being built by this thread.  Listeners called during the build must not get it.");
+
+    build.finished.wait(lock, [&]() {
+        return build.builder == std::thread::id() || current.load(std::memory_order_acquire) != nullptr;
+    });
+
+    if (current.load(std::memory_order_acquire) != nullptr)
+        return false;
+
+    build.builder = std::this_thread::get_id();
+    return true;
+}
+
+
+void ofSSLManager::_endBuild(ContextBuild& build)
+{
+    build.builder = std::thread::id();
+    build.finished.notify_all();
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::_createServerContext()
+{
+    Poco::Net::Context::Ptr pContext = _createServerContext(ofToDataPath(DEFAULT_PRIVATE_KEY_FILE, true),
+                                                            ofToDataPath(DEFAULT_CERTIFICATE_FILE, true));
+
+    instance()._serverCertificateStore.attach(pContext);
+
+    return pContext;
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::_createServerContext(const std::string& privateKeyFile,
+                                                           const std::string& certificateFile)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Poco::Net::Context::Ptr pContext;
+
+    ofSSLPrivateKeyCache& privateKeyCache = instance()._privateKeyCache;
+
+    if (!privateKeyCache.isEnabled())
+    {
+        pContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                          privateKeyFile,
+                                          certificateFile,
+                                          "");
+    }
+    else
+    {
+        pContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                          "",
+                                          certificateFile,
+                                          "");
+
+        // Ask for the passphrase as Poco does, so that the registered
+        // passphrase handlers and listeners are used.
+        EVP_PKEY* pKey = privateKeyCache.load(privateKeyFile, []() {
+            Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
+            std::string passphrase;
+            manager.PrivateKeyPassphraseRequired.notify(&manager, passphrase);
+            return passphrase;
+        });
+
+        int result = SSL_CTX_use_PrivateKey(pContext->sslContext(), pKey);
+
+        EVP_PKEY_free(pKey);
+
+        if (result != 1)
+        {
+            throw Poco::Net::SSLContextException("Error loading private key from file", privateKeyFile);
+        }
+    }
+
+    // OpenSSL discards a certificate that does not match the private key
+    // rather than failing, e.g. while only one of the files is replaced.
+    if (SSL_CTX_check_private_key(pContext->sslContext()) != 1)
+    {
+        throw Poco::Net::SSLContextException("The private key does not match the certificate", privateKeyFile);
+    }
+
+    _configureServerContext(pContext, start);
+
+    return pContext;
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::_createServerContextReplica(Poco::Net::Context::Ptr pPrimary)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Poco::Net::Context::Ptr pContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+                                                              "",
+                                                              "",
+                                                              "");
+
+    SSL_CTX* pPrimarySSLContext = pPrimary->sslContext();
+    SSL_CTX* pSSLContext = pContext->sslContext();
+
+    // The certificate, chain and private key are reference counted and
+    // shared, rather than parsed again.
+    STACK_OF(X509)* pChain = nullptr;
+    SSL_CTX_get0_chain_certs(pPrimarySSLContext, &pChain);
+
+    if (SSL_CTX_use_certificate(pSSLContext, SSL_CTX_get0_certificate(pPrimarySSLContext)) != 1
+     || SSL_CTX_use_PrivateKey(pSSLContext, SSL_CTX_get0_privatekey(pPrimarySSLContext)) != 1
+     || (pChain != nullptr && SSL_CTX_set1_chain(pSSLContext, pChain) != 1))
+    {
+        throw Poco::Net::SSLContextException("Unable to share the certificate and private key");
+    }
+
+    _configureServerContext(pContext, start);
+
+    instance()._serverCertificateStore.attach(pContext);
+
+    return pContext;
+}
+
+
+void ofSSLManager::_configureServerContext(Poco::Net::Context::Ptr pContext,
+                                           std::chrono::steady_clock::time_point start)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    getTrustStore()->attach(pContext);
+
+    // A session id context is required for resumption even when the
+    // session cache is disabled.
+    pContext->enableSessionCache(manager._serverSessionCacheSize > 0,
+                                 SESSION_ID_CONTEXT);
+
+    if (manager._serverSessionCacheSize > 0)
+        pContext->setSessionCacheSize(manager._serverSessionCacheSize);
+
+    pContext->setSessionTimeout(static_cast<long>(manager._serverSessionTimeout.count()));
+
+    manager._serverSessionTicketKeys.attach(pContext);
+
+    applyPerformanceProfile(pContext, manager._performanceProfile);
+
+    if (manager._kernelTLSEnabled)
+        ofSSLKernelTLS::enable(pContext);
+
+    if (manager._lowMemoryModeEnabled)
+        applyLowMemoryMode(pContext, manager._lowMemoryFragmentLength);
+
+    if (manager._earlyDataEnabled)
+        applyEarlyData(pContext, manager._maxEarlyData);
+
+    if (manager._ocspStaplingEnabled)
+        manager._ocspStapler.attach(pContext);
+
+    manager._metrics.attach(pContext);
+    manager._metrics.recordContextBuild(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::_getServerContextShard()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    // The shard is not owned by the thread, so that an idle thread doesn't
+    // keep a replaced Context and its keys alive.
+    struct ThreadShard
+    {
+        uint64_t generation = 0;
+        Poco::Net::Context* pContext = nullptr;
+    };
+
+    static std::atomic<std::size_t> nextThreadIndex(0);
+    static thread_local std::size_t threadIndex = nextThreadIndex++;
+    static thread_local ThreadShard shard;
+
+    // Fast path: this thread's shard is still current.  A shard can't be
+    // released while a reader that saw its generation is counted.
+    {
+        ContextSlot& slot = manager._serverContext;
+        std::atomic<uint64_t>& readers = slot.readers[slot.epoch.load() & 1];
+
+        Poco::Net::Context::Ptr pContext;
+
+        ++readers;
+
+        if (shard.generation == manager._serverShardGeneration.load())
+            pContext = Poco::Net::Context::Ptr(shard.pContext, true);
+
+        --readers;
+
+        if (!pContext.isNull())
+            return pContext;
+    }
+
+    std::unique_lock<std::mutex> lock(manager._serverContextMutex);
+
+    Poco::Net::Context* pPrimary = manager._serverContext.current.load(std::memory_order_acquire);
+    std::size_t shardCount = manager._serverContextShardCount;
+
+    shard.generation = manager._serverShardGeneration;
+
+    // Only the default Server Context can be replicated.
+    if (!manager._serverContextIsDefault)
+    {
+        shard.pContext = pPrimary;
+        return Poco::Net::Context::Ptr(pPrimary, true);
+    }
+
+    // The shards are cleared whenever the generation changes.
+    if (manager._serverShards.empty())
+    {
+        manager._serverShards.push_back(Poco::Net::Context::Ptr(pPrimary, true));
+
+        try
+        {
+            while (manager._serverShards.size() < shardCount)
+                manager._serverShards.push_back(_createServerContextReplica(manager._serverShards.front()));
+        }
+        catch (const Poco::Exception& exc)
+        {
+            ofLogError("ofSSLManager::_getServerContextShard") << "Unable to replicate the default Server Context: " << exc.displayText();
+        }
+    }
+
+    Poco::Net::Context::Ptr pContext = manager._serverShards[threadIndex % manager._serverShards.size()];
+    shard.pContext = pContext.get();
+    return pContext;
+}
+
+
+Poco::Net::Context::Ptr ofSSLManager::_load(ContextSlot& slot)
+{
+    // While counted, the Context can't be released by _publish().  The
+    // operations are sequentially consistent so that a getter counted in
+    // an epoch that _publish() has already waited for sees the new Context.
+    std::atomic<uint64_t>& readers = slot.readers[slot.epoch.load() & 1];
+
+    ++readers;
+    Poco::Net::Context::Ptr pContext(slot.current.load(), true);
+    --readers;
+
+    return pContext;
+}
+
+
+void ofSSLManager::_publish(ContextSlot& slot, Poco::Net::Context::Ptr pContext)
+{
+    slot.contexts.push_back(pContext);
+    slot.current.store(pContext.get());
+
+    _waitForReaders(slot);
+    _releaseRetired(slot);
+}
+
+
+void ofSSLManager::_publishServerContext(Poco::Net::Context::Ptr pContext)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    // Threads check the generation of their shard while counted as readers
+    // of the default Server Context, so once the readers have been waited
+    // for, no thread can take a new reference to a previous shard.
+    ++manager._serverShardGeneration;
+    _publish(manager._serverContext, pContext);
+    manager._serverShards.clear();
+}
+
+
+void ofSSLManager::_waitForReaders(ContextSlot& slot)
+{
+    // New getters count in the next epoch and see the new Context.  Getters
+    // of the previous epoch only hold the pointer for a few instructions.
+    std::atomic<uint64_t>& readers = slot.readers[slot.epoch++ & 1];
+
+    while (readers.load() != 0)
+        std::this_thread::yield();
+}
+
+
+void ofSSLManager::_releaseRetired(ContextSlot& slot)
+{
+    std::vector<Poco::Net::Context::Ptr>& contexts = slot.contexts;
+
+    if (contexts.empty())
+        return;
+
+    // The newest Context is current and is never released.  Getters can no
+    // longer take a reference to the others, so a Context only referenced
+    // here stays unreferenced.
+    auto last = std::remove_if(contexts.begin(), contexts.end() - 1, [](const Poco::Net::Context::Ptr& pContext) {
+        return pContext->referenceCount() == 1;
+    });
+
+    contexts.erase(last, contexts.end() - 1);
+}
+
+
+void ofSSLManager::setServerReloadInterval(std::chrono::milliseconds interval)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._serverReloadMutex);
+
+    manager._serverReloadInterval = interval;
+
+    if (interval.count() > 0 && !manager._serverReloadThread.joinable())
+        manager._serverReloadThread = std::thread(&ofSSLManager::_watchServerFiles, &manager);
+
+    manager._serverReloadCondition.notify_all();
+}
+
+
+std::chrono::milliseconds ofSSLManager::getServerReloadInterval()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+    std::unique_lock<std::mutex> lock(manager._serverReloadMutex);
+    return manager._serverReloadInterval;
+}
+
+
+bool ofSSLManager::reloadServerContext()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    auto start = Clock::now();
+
+    std::string version = _getServerFilesVersion();
+
+    {
+        std::unique_lock<std::mutex> lock(manager._serverContextMutex);
+        manager._serverFilesVersion = version;
+    }
+
+    // Build the new Context without holding the lock, so that the current
+    // Context can still be initialized and used meanwhile.
+    Poco::Net::Context::Ptr pContext;
+
+    try
+    {
+        pContext = _createServerContext();
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ++manager._serverReloadFailureCount;
+        ofLogError("ofSSLManager::reloadServerContext") << "Keeping the current Server Context: " << exc.displayText();
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(manager._serverContextMutex);
+
+    if (manager._serverContext.current.load(std::memory_order_acquire) != nullptr && !manager._serverContextIsDefault)
+    {
+        ofLogWarning("ofSSLManager::reloadServerContext") << "The Server Context was set by initializeServer() and will not be replaced.";
+        return false;
+    }
+
+    Poco::Net::SSLManager::instance().initializeServer(nullptr,
+                                                       nullptr,
+                                                       pContext);
+    _publishServerContext(pContext);
+    manager._serverContextIsDefault = true;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+
+    manager._lastServerReloadMicroseconds = static_cast<uint64_t>(elapsed.count());
+    ++manager._serverReloadCount;
+
+    ofLogNotice("ofSSLManager::reloadServerContext") << "Reloaded the Server Context in " << elapsed.count() << " us.";
+
+    return true;
+}
+
+
+uint64_t ofSSLManager::getServerReloadCount()
+{
+    return instance()._serverReloadCount;
+}
+
+
+uint64_t ofSSLManager::getServerReloadFailureCount()
+{
+    return instance()._serverReloadFailureCount;
+}
+
+
+std::chrono::microseconds ofSSLManager::getLastServerReloadTime()
+{
+    return std::chrono::microseconds(instance()._lastServerReloadMicroseconds);
+}
+
+
+std::size_t ofSSLManager::getServerContextsInUse()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._serverContextMutex);
+
+    // The current Context, plus replaced Contexts that are still referenced.
+    _releaseRetired(manager._serverContext);
+
+    return manager._serverContext.contexts.size();
+}
+
+
+std::string ofSSLManager::_getServerFilesVersion()
+{
+    std::stringstream version;
+
+    for (const auto& file: { DEFAULT_PRIVATE_KEY_FILE, DEFAULT_CERTIFICATE_FILE })
+    {
+        std::filesystem::path path = ofToDataPath(file, true);
+        std::error_code error;
+
+        auto size = std::filesystem::file_size(path, error);
+        auto modified = std::filesystem::last_write_time(path, error);
+
+        version << size << " " << modified.time_since_epoch().count() << " ";
+    }
+
+    return version.str();
+}
+
+
+void ofSSLManager::_onClientVerificationError(const void* pSender, Poco::Net::VerificationErrorArgs& args)
+{
+    _onVerificationError(pSender, args, _clientVerificationError, false);
+}
+
+
+void ofSSLManager::_onServerVerificationError(const void* pSender, Poco::Net::VerificationErrorArgs& args)
+{
+    _onVerificationError(pSender, args, _serverVerificationError, true);
+}
+
+
+void ofSSLManager::_onVerificationError(const void* pSender,
+                                        Poco::Net::VerificationErrorArgs& args,
+                                        Poco::BasicEvent<Poco::Net::VerificationErrorArgs>& event,
+                                        bool server)
+{
+    _metrics.recordVerificationFailure(args.errorNumber(), args.errorDepth());
+
+    std::shared_ptr<AsyncVerification> verification;
+
+    {
+        std::unique_lock<std::mutex> lock(_asyncVerificationMutex);
+        verification = server ? _serverAsyncVerification : _clientAsyncVerification;
+    }
+
+    // Without listeners there is no decision worth caching.
+    if (verification == nullptr && !event.hasDelegates())
+        return;
+
+    std::string key = ofSSLVerificationCache::makeKey(args, server);
+
+    bool ignoreError = false;
+
+    if (!key.empty() && _verificationCache.get(key, ignoreError))
+    {
+        args.setIgnoreError(ignoreError);
+        return;
+    }
+
+    if (verification != nullptr)
+    {
+        // Decisions are cached by _decideAsync(), except timeouts.
+        args.setIgnoreError(_decideAsync(key, args, *verification));
+        return;
+    }
+
+    event.notify(pSender, args);
+
+    if (!key.empty())
+        _verificationCache.put(key, args.getIgnoreError());
+}
+
+
+bool ofSSLManager::_decideAsync(const std::string& key,
+                                const Poco::Net::VerificationErrorArgs& args,
+                                const AsyncVerification& verification)
+{
+    std::shared_future<bool> decision;
+
+    {
+        std::unique_lock<std::mutex> lock(_asyncVerificationMutex);
+
+        auto iter = _pendingVerifications.find(key);
+
+        if (iter != _pendingVerifications.end())
+            decision = iter->second;
+    }
+
+    if (!decision.valid())
+    {
+        ++_asyncVerificationCount;
+
+        try
+        {
+            decision = verification.handler(args).share();
+        }
+        catch (const std::exception& exc)
+        {
+            ofLogError("ofSSLManager::_decideAsync") << "Verification handler failed: " << exc.what();
+            return verification.ignoreErrorOnTimeout;
+        }
+
+        if (!decision.valid())
+            return verification.ignoreErrorOnTimeout;
+
+        // Cache the decision when it arrives, even if it arrives late.
+        // The number of pending decisions is bounded like the cache.
+        std::unique_lock<std::mutex> lock(_asyncVerificationMutex);
+
+        if (!key.empty() && _pendingVerifications.size() < _verificationCache.getMaximumSize())
+        {
+            _pendingVerifications.emplace(key, decision);
+
+            if (!_pendingVerificationThread.joinable())
+                _pendingVerificationThread = std::thread(&ofSSLManager::_cachePendingVerifications, this);
+
+            _pendingVerificationCondition.notify_all();
+        }
+    }
+
+    if (decision.wait_for(verification.timeout) != std::future_status::ready)
+    {
+        ++_asyncVerificationTimeoutCount;
+        return verification.ignoreErrorOnTimeout;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_asyncVerificationMutex);
+        _pendingVerifications.erase(key);
+    }
+
+    bool ignoreError = verification.ignoreErrorOnTimeout;
+
+    try
+    {
+        ignoreError = decision.get();
+    }
+    catch (const std::exception& exc)
+    {
+        ofLogError("ofSSLManager::_decideAsync") << "Verification decision failed: " << exc.what();
+        return ignoreError;
+    }
+
+    if (!key.empty())
+        _verificationCache.put(key, ignoreError);
+
+    return ignoreError;
+}
+
+
+void ofSSLManager::_cachePendingVerifications()
+{
+    std::unique_lock<std::mutex> lock(_asyncVerificationMutex);
+
+    while (!_pendingVerificationsStopping)
+    {
+        if (_pendingVerifications.empty())
+        {
+            _pendingVerificationCondition.wait(lock);
+            continue;
+        }
+
+        auto iter = _pendingVerifications.begin();
+
+        while (iter != _pendingVerifications.end())
+        {
+            if (iter->second.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+            {
+                ++iter;
+                continue;
+            }
+
+            // The handler can't be replaced while the lock is held, so the
+            // decision is cached before a new handler clears the cache.
+            try
+            {
+                _verificationCache.put(iter->first, iter->second.get());
+            }
+            catch (const std::exception& exc)
+            {
+                ofLogError("ofSSLManager::_cachePendingVerifications") << "Verification decision failed: " << exc.what();
+            }
+
+            iter = _pendingVerifications.erase(iter);
+        }
+
+        _pendingVerificationCondition.wait_for(lock, PENDING_VERIFICATION_POLL_INTERVAL);
+    }
+}
+
+
+void ofSSLManager::_onPrivateKeyPassphraseRequired(const void*, std::string&)
+{
+    _metrics.recordPassphraseRequest();
+}
+
+
+void ofSSLManager::_watchServerFiles()
+{
+    std::unique_lock<std::mutex> lock(_serverReloadMutex);
+
+    while (!_serverReloadStopping)
+    {
+        if (_serverReloadInterval.count() <= 0)
+        {
+            _serverReloadCondition.wait(lock);
+            continue;
+        }
+
+        if (_serverReloadCondition.wait_for(lock, _serverReloadInterval) == std::cv_status::no_timeout)
+            continue;
+
+        lock.unlock();
+
+        std::string version = _getServerFilesVersion();
+        bool changed = false;
+
+        {
+            std::unique_lock<std::mutex> contextLock(_serverContextMutex);
+
+            _releaseRetired(_serverContext);
+
+            changed = _serverContextIsDefault && _serverFilesVersion != version;
+        }
+
+        if (changed)
+            reloadServerContext();
+
+        _privateKeyCache.purge();
+
+        lock.lock();
+    }
+}
+
+
+ofSSLSessionCache& ofSSLManager::getClientSessionCache()
+{
+    return instance()._clientSessionCache;
+}
+
+
+void ofSSLManager::setClientSessionCacheEnabled(bool enabled)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    manager._clientSessionCacheEnabled = enabled;
+
+    if (!enabled)
+        manager._clientSessionCache.clear();
+}
+
+
+bool ofSSLManager::isClientSessionCacheEnabled()
+{
+    return instance()._clientSessionCacheEnabled;
+}
+
+
+Poco::Net::Session::Ptr ofSSLManager::getClientSession(const std::string& host,
+                                                       uint16_t port)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    if (!manager._clientSessionCacheEnabled)
+        return nullptr;
+
+    return manager._clientSessionCache.get(host, port);
+}
+
+
+void ofSSLManager::setClientSession(const std::string& host,
+                                    uint16_t port,
+                                    Poco::Net::Session::Ptr session)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    if (manager._clientSessionCacheEnabled)
+        manager._clientSessionCache.put(host, port, session);
+}
+
+
+void ofSSLManager::setServerSessionCacheSize(std::size_t size)
+{
+    instance()._serverSessionCacheSize = size;
+}
+
+
+std::size_t ofSSLManager::getServerSessionCacheSize()
+{
+    return instance()._serverSessionCacheSize;
+}
+
+
+void ofSSLManager::setServerSessionTimeout(std::chrono::seconds timeout)
+{
+    instance()._serverSessionTimeout = timeout;
+}
+
+
+std::chrono::seconds ofSSLManager::getServerSessionTimeout()
+{
+    return instance()._serverSessionTimeout;
+}
+
+
+ofSSLSessionTicketKeys& ofSSLManager::getServerSessionTicketKeys()
+{
+    return instance()._serverSessionTicketKeys;
+}
+
+
+ofSSLCertificateStore& ofSSLManager::getServerCertificateStore()
+{
+    return instance()._serverCertificateStore;
+}
+
+
+void ofSSLManager::setOCSPStaplingEnabled(bool enabled)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    if (enabled && manager._ocspStapler.getCacheDirectory().empty())
+        manager._ocspStapler.setCacheDirectory(ofToDataPath(DEFAULT_OCSP_CACHE_DIRECTORY, true));
+
+    manager._ocspStaplingEnabled = enabled;
+}
+
+
+bool ofSSLManager::isOCSPStaplingEnabled()
+{
+    return instance()._ocspStaplingEnabled;
+}
+
+
+ofSSLOCSPStapler& ofSSLManager::getOCSPStapler()
+{
+    return instance()._ocspStapler;
+}
+
+
+ofSSLMetrics& ofSSLManager::getMetrics()
+{
+    return instance()._metrics;
+}
+
+
+void ofSSLManager::setClientVerificationHandler(AsyncVerificationHandler handler,
+                                                std::chrono::milliseconds timeout,
+                                                bool ignoreErrorOnTimeout)
+{
+    _setVerificationHandler(instance()._clientAsyncVerification,
+                            handler,
+                            timeout,
+                            ignoreErrorOnTimeout);
+}
+
+
+void ofSSLManager::setServerVerificationHandler(AsyncVerificationHandler handler,
+                                                std::chrono::milliseconds timeout,
+                                                bool ignoreErrorOnTimeout)
+{
+    _setVerificationHandler(instance()._serverAsyncVerification,
+                            handler,
+                            timeout,
+                            ignoreErrorOnTimeout);
+}
+
+
+uint64_t ofSSLManager::getAsyncVerificationCount()
+{
+    return instance()._asyncVerificationCount;
+}
+
+
+uint64_t ofSSLManager::getAsyncVerificationTimeoutCount()
+{
+    return instance()._asyncVerificationTimeoutCount;
+}
+
+
+void ofSSLManager::_setVerificationHandler(std::shared_ptr<AsyncVerification>& current,
+                                           AsyncVerificationHandler handler,
+                                           std::chrono::milliseconds timeout,
+                                           bool ignoreErrorOnTimeout,
+                                           const void* listener)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::shared_ptr<AsyncVerification> verification;
+
+    if (handler)
+    {
+        verification = std::make_shared<AsyncVerification>();
+        verification->handler = handler;
+        verification->timeout = std::max(timeout, std::chrono::milliseconds(0));
+        verification->ignoreErrorOnTimeout = ignoreErrorOnTimeout;
+        verification->listener = listener;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(manager._asyncVerificationMutex);
+        current = verification;
+        manager._pendingVerifications.clear();
+    }
+
+    // A new handler may decide differently.
+    manager._verificationCache.clear();
+}
+
+
+void ofSSLManager::_unsetVerificationHandler(std::shared_ptr<AsyncVerification>& current,
+                                             const void* listener)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    {
+        std::unique_lock<std::mutex> lock(manager._asyncVerificationMutex);
+
+        if (current == nullptr || current->listener != listener)
+            return;
+
+        current = nullptr;
+        manager._pendingVerifications.clear();
+    }
+
+    manager._verificationCache.clear();
+}
+
+
+ofSSLVerificationCache& ofSSLManager::getVerificationCache()
+{
+    return instance()._verificationCache;
+}
+
+
+ofSSLPrivateKeyCache& ofSSLManager::getPrivateKeyCache()
+{
+    return instance()._privateKeyCache;
+}
+
+
+ofSSLConnectionPool& ofSSLManager::getClientConnectionPool()
+{
+    return instance()._clientConnectionPool;
+}
+
+
+std::vector<ofSSLCertificateVerifier::Result> ofSSLManager::verifyCertificates(const std::vector<std::string>& certificates)
+{
+    return instance()._certificateVerifier.verify(certificates);
+}
+
+
+ofSSLCertificateVerifier& ofSSLManager::getCertificateVerifier()
+{
+    return instance()._certificateVerifier;
+}
+
+
+ofSSLMetricsSnapshot ofSSLManager::getMetricsSnapshot()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    ofSSLMetricsSnapshot snapshot = manager._metrics.snapshot();
+
+    snapshot.clientSessionCacheHits = manager._clientSessionCache.getHits();
+    snapshot.clientSessionCacheMisses = manager._clientSessionCache.getMisses();
+    snapshot.clientSessionCacheEvictions = manager._clientSessionCache.getEvictions();
+    snapshot.clientSessionCacheExpirations = manager._clientSessionCache.getExpirations();
+
+    snapshot.ticketsIssued = manager._serverSessionTicketKeys.getTicketsIssued();
+    snapshot.ticketsAccepted = manager._serverSessionTicketKeys.getTicketsAccepted();
+    snapshot.ticketsRenewed = manager._serverSessionTicketKeys.getTicketsRenewed();
+    snapshot.ticketsRejected = manager._serverSessionTicketKeys.getTicketsRejected();
+    snapshot.ticketKeyRotations = manager._serverSessionTicketKeys.getRotations();
+
+    snapshot.verificationCacheHits = manager._verificationCache.getHits();
+    snapshot.verificationCacheMisses = manager._verificationCache.getMisses();
+
+    snapshot.privateKeyCacheHits = manager._privateKeyCache.getHits();
+    snapshot.privateKeyCacheMisses = manager._privateKeyCache.getMisses();
+
+    snapshot.earlyDataReplays = manager._earlyDataReplayWindow.getReplays();
+
+    snapshot.connectionPoolHits = manager._clientConnectionPool.getHits();
+    snapshot.connectionPoolMisses = manager._clientConnectionPool.getMisses();
+    snapshot.connectionPoolHealthCheckFailures = manager._clientConnectionPool.getHealthCheckFailures();
+    snapshot.connectionPoolExpirations = manager._clientConnectionPool.getExpirations();
+
+    snapshot.certificatesVerified = manager._certificateVerifier.getVerified();
+    snapshot.certificatesFailed = manager._certificateVerifier.getFailed();
+    snapshot.certificatesUnreadable = manager._certificateVerifier.getUnreadable();
+
+    snapshot.ocspStapled = manager._ocspStapler.getStapled();
+    snapshot.ocspNotStapled = manager._ocspStapler.getNotStapled();
+    snapshot.ocspFetches = manager._ocspStapler.getFetches();
+    snapshot.ocspFetchFailures = manager._ocspStapler.getFetchFailures();
+    snapshot.ocspFreshResponses = manager._ocspStapler.getFreshCount();
+    snapshot.ocspStaleResponses = manager._ocspStapler.getStaleCount();
+
+    ofSSLAllocator::Usage allocatorUsage = ofSSLAllocator::getTotalUsage();
+    snapshot.allocatorBytesInUse = allocatorUsage.bytesInUse;
+    snapshot.allocatorPeakBytesInUse = allocatorUsage.peakBytesInUse;
+    snapshot.allocatorPooledBytes = ofSSLAllocator::getPooledBytes();
+
+    if (snapshot.openConnections > 0)
+        snapshot.connectionBytesUpperBound = ofSSLAllocator::getUsage(ofSSLAllocator::CATEGORY_SSL).bytesInUse / snapshot.openConnections;
+
+    snapshot.certificateStoreHits = manager._serverCertificateStore.getHits();
+    snapshot.certificateStoreMisses = manager._serverCertificateStore.getMisses();
+    snapshot.certificateStoreEvictions = manager._serverCertificateStore.getEvictions();
+    snapshot.certificateStoreLoadFailures = manager._serverCertificateStore.getLoadFailures();
+
+    snapshot.serverReloads = getServerReloadCount();
+    snapshot.serverReloadFailures = getServerReloadFailureCount();
+    snapshot.lastServerReloadTime = getLastServerReloadTime();
+    snapshot.serverContextsInUse = getServerContextsInUse();
+
+    snapshot.warmUpWaitCount = getWarmUpWaitCount();
+    snapshot.warmUpWaitTime = getWarmUpWaitTime();
+
+    return snapshot;
+}
+
+
+std::shared_future<void> ofSSLManager::warmUp()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._warmUpMutex);
+
+    if (!manager._warmUp.valid())
+    {
+        manager._warmUpPending = true;
+        manager._warmUp = std::async(std::launch::async, [&manager]() {
+            // Getters stop waiting however the build ends.
+            struct PendingGuard
+            {
+                std::atomic<bool>& pending;
+
+                ~PendingGuard()
+                {
+                    pending = false;
+                }
+            } guard { manager._warmUpPending };
+
+            isWarmingUp = true;
+
+            // A Context that fails to build is built again by its getter,
+            // which reports the error to the caller.
+            auto build = [](const std::string& name, void (*initialize)(Poco::Net::Context::Ptr)) {
+                try
+                {
+                    initialize(nullptr);
+                }
+                catch (const Poco::Exception& exc)
+                {
+                    ofLogError("ofSSLManager::warmUp") << "Unable to build the default " << name << " Context: " << exc.displayText();
+                }
+                catch (const std::exception& exc)
+                {
+                    ofLogError("ofSSLManager::warmUp") << "Unable to build the default " << name << " Context: " << exc.what();
+                }
+                catch (...)
+                {
+                    ofLogError("ofSSLManager::warmUp") << "Unable to build the default " << name << " Context.";
+                }
+            };
+
+            build("Client", &ofSSLManager::initializeClient);
+            build("Server", &ofSSLManager::initializeServer);
+        }).share();
+    }
+
+    return manager._warmUp;
+}
 
 
-ofSSLManager::ofSSLManager()
+std::chrono::microseconds ofSSLManager::getWarmUpWaitTime()
 {
-    Poco::Net::initializeSSL();
+    return std::chrono::microseconds(instance()._warmUpWaitMicroseconds);
 }
 
 
-ofSSLManager::~ofSSLManager()
+uint64_t ofSSLManager::getWarmUpWaitCount()
 {
-    Poco::Net::uninitializeSSL();
+    return instance()._warmUpWaitCount;
 }
 
 
-Poco::Net::Context::Ptr ofSSLManager::getDefaultServerContext()
+void ofSSLManager::_waitForWarmUp()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    if (!manager._warmUpPending || isWarmingUp)
+        return;
+
+    std::shared_future<void> warmUp;
+
+    {
+        std::unique_lock<std::mutex> lock(manager._warmUpMutex);
+        warmUp = manager._warmUp;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    warmUp.wait();
+
+    auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    manager._warmUpWaitMicroseconds += static_cast<uint64_t>(waited.count());
+    ++manager._warmUpWaitCount;
+}
+
+
+void ofSSLManager::setPerformanceProfile(PerformanceProfile profile)
 {
-    initializeServer(nullptr); // make sure it's initialized with something
-    return Poco::Net::SSLManager::instance().defaultServerContext();
+    instance()._performanceProfile = profile;
 }
 
 
-Poco::Net::Context::Ptr ofSSLManager::getDefaultClientContext()
+ofSSLManager::PerformanceProfile ofSSLManager::getPerformanceProfile()
 {
-    initializeClient(nullptr); // make sure it's initialized with something
-    return Poco::Net::SSLManager::instance().defaultClientContext();
+    return instance()._performanceProfile;
 }
 
 
-void ofSSLManager::initializeClient(Poco::Net::Context::Ptr pContext)
+ofSSLManager::PerformanceProfile ofSSLManager::getDetectedPerformanceProfile()
 {
-    ofSSLManager& manager = ofSSLManager::instance();
+    return hasAESAcceleration() ? PROFILE_AES : PROFILE_CHACHA20;
+}
 
-    if (!pContext.isNull())
+
+bool ofSSLManager::hasAESAcceleration()
+{
+    static const bool hasAES = []() {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) && (ecx & bit_PCLMUL);
+#elif defined(_M_X64) || defined(_M_IX86)
+        int info[4] = { 0 };
+        __cpuid(info, 1);
+        return (info[2] & (1 << 25)) && (info[2] & (1 << 1));
+#elif defined(__APPLE__) && defined(__aarch64__)
+        return true;
+#elif defined(__linux__) && defined(__aarch64__)
+        return (getauxval(AT_HWCAP) & HWCAP_AES) && (getauxval(AT_HWCAP) & HWCAP_PMULL);
+#elif defined(__linux__) && defined(__arm__) && defined(HWCAP2_AES)
+        return (getauxval(AT_HWCAP2) & HWCAP2_AES) && (getauxval(AT_HWCAP2) & HWCAP2_PMULL);
+#else
+        return false;
+#endif
+    }();
+
+    return hasAES;
+}
+
+
+void ofSSLManager::applyPerformanceProfile(Poco::Net::Context::Ptr pContext,
+                                           PerformanceProfile profile)
+{
+    if (profile == PROFILE_AUTO)
+        profile = getDetectedPerformanceProfile();
+
+    if (profile == PROFILE_NONE)
+        return;
+
+    SSL_CTX* pSSLContext = pContext->sslContext();
+
+    bool preferChaCha20 = (profile == PROFILE_CHACHA20);
+
+    if (SSL_CTX_set_cipher_list(pSSLContext, preferChaCha20 ? CHACHA20_CIPHER_LIST : AES_CIPHER_LIST) != 1)
+        ofLogWarning("ofSSLManager::applyPerformanceProfile") << "Unable to set the cipher list for " << to_string(profile) << ".";
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (SSL_CTX_set_ciphersuites(pSSLContext, preferChaCha20 ? CHACHA20_CIPHERSUITES : AES_CIPHERSUITES) != 1)
+        ofLogWarning("ofSSLManager::applyPerformanceProfile") << "Unable to set the TLS 1.3 cipher suites for " << to_string(profile) << ".";
+
+    if (SSL_CTX_set1_groups_list(pSSLContext, GROUPS_LIST) != 1)
+        ofLogWarning("ofSSLManager::applyPerformanceProfile") << "Unable to set the key exchange groups.";
+#endif
+
+    if (pContext->isForServerUse())
     {
-        Poco::Net::SSLManager::instance().initializeClient(nullptr,
-                                                           nullptr,
-                                                           pContext);
-        manager._clientContextInitialized = true;
+        long options = SSL_OP_CIPHER_SERVER_PREFERENCE;
+
+#ifdef SSL_OP_PRIORITIZE_CHACHA
+        // Let clients without AES instructions choose ChaCha20-Poly1305.
+        options |= SSL_OP_PRIORITIZE_CHACHA;
+#endif
+
+        SSL_CTX_set_options(pSSLContext, options);
     }
-    else if (!manager._clientContextInitialized)
+}
+
+
+void ofSSLManager::setKernelTLSEnabled(bool enabled)
+{
+    if (enabled && !ofSSLKernelTLS::isAvailable())
+        ofLogWarning("ofSSLManager::setKernelTLSEnabled") << "Kernel TLS is not supported by this build of OpenSSL.  Userspace TLS will be used.";
+
+    instance()._kernelTLSEnabled = enabled;
+}
+
+
+bool ofSSLManager::isKernelTLSEnabled()
+{
+    return instance()._kernelTLSEnabled;
+}
+
+
+void ofSSLManager::setLowMemoryModeEnabled(bool enabled)
+{
+    instance()._lowMemoryModeEnabled = enabled;
+}
+
+
+bool ofSSLManager::isLowMemoryModeEnabled()
+{
+    return instance()._lowMemoryModeEnabled;
+}
+
+
+void ofSSLManager::setLowMemoryFragmentLength(std::size_t length)
+{
+    if (length != 0 && length != 512 && length != 1024 && length != 2048 && length != 4096)
     {
-        std::string caLocation = "";
-        
-        std::filesystem::path localCACertPath = ofToDataPath(DEFAULT_CA_LOCATION, true);
+        ofLogWarning("ofSSLManager::setLowMemoryFragmentLength") << "Invalid fragment length " << length << ", must be 512, 1024, 2048, 4096 or 0.";
+        return;
+    }
+
+    instance()._lowMemoryFragmentLength = length;
+}
 
-        std::filesystem::path sharedCACertPath = std::filesystem::path(__FILE__).parent_path().parent_path();
-        sharedCACertPath /= "shared";
-        sharedCACertPath /= "data";
-        sharedCACertPath /= DEFAULT_CA_LOCATION;
 
-        if (std::filesystem::exists(localCACertPath))
-        {
-            caLocation = localCACertPath.string();
-        }
-        else if (std::filesystem::exists(sharedCACertPath))
+std::size_t ofSSLManager::getLowMemoryFragmentLength()
+{
+    return instance()._lowMemoryFragmentLength;
+}
+
+
+void ofSSLManager::applyLowMemoryMode(Poco::Net::Context::Ptr pContext,
+                                      std::size_t fragmentLength)
+{
+    SSL_CTX* pSSLContext = pContext->sslContext();
+
+    // Buffers are freed when they are empty and allocated again on demand.
+    SSL_CTX_set_mode(pSSLContext, SSL_MODE_RELEASE_BUFFERS);
+
+    if (fragmentLength == 0)
+        return;
+
+    // Smaller records need a smaller write buffer.
+    SSL_CTX_set_max_send_fragment(pSSLContext, static_cast<long>(fragmentLength));
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    // Servers can only send smaller records if the client asks for them.
+    if (!pContext->isForServerUse())
+    {
+        uint8_t mode = TLSEXT_max_fragment_length_DISABLED;
+
+        switch (fragmentLength)
         {
-            ofLogWarning("ofSSLManager::initializeClient") << "CA File not found @ " << localCACertPath.string() << ". Using " << sharedCACertPath.string() << ".";
-            caLocation = sharedCACertPath.string();
+            case 512:
+                mode = TLSEXT_max_fragment_length_512;
+                break;
+            case 1024:
+                mode = TLSEXT_max_fragment_length_1024;
+                break;
+            case 2048:
+                mode = TLSEXT_max_fragment_length_2048;
+                break;
+            case 4096:
+                mode = TLSEXT_max_fragment_length_4096;
+                break;
         }
-        else
+
+        if (mode == TLSEXT_max_fragment_length_DISABLED || SSL_CTX_set_tlsext_max_fragment_length(pSSLContext, mode) != 1)
+            ofLogWarning("ofSSLManager::applyLowMemoryMode") << "Unable to request a maximum fragment length of " << fragmentLength << ".";
+    }
+#endif
+}
+
+
+std::size_t ofSSLManager::estimateConnectionBufferSize(const SSL* ssl)
+{
+    if (ssl == nullptr)
+        return 0;
+
+    SSL* pSSL = const_cast<SSL*>(ssl);
+
+    std::size_t fragmentLength = SSL3_RT_MAX_PLAIN_LENGTH;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    SSL_SESSION* pSession = SSL_get_session(ssl);
+
+    if (pSession != nullptr)
+    {
+        uint8_t mode = SSL_SESSION_get_max_fragment_length(pSession);
+
+        if (mode != TLSEXT_max_fragment_length_DISABLED)
+            fragmentLength = std::size_t(256) << mode;
+    }
+#endif
+
+    // Each buffer holds a record: a header, the fragment and the encryption
+    // overhead.
+    std::size_t bufferSize = SSL3_RT_HEADER_LENGTH + fragmentLength + SSL3_RT_MAX_ENCRYPTED_OVERHEAD;
+
+    if ((SSL_get_mode(pSSL) & SSL_MODE_RELEASE_BUFFERS) == 0)
+        return 2 * bufferSize;
+
+    // Released buffers are only held while they have data: the read buffer
+    // while it holds a record or part of one that hasn't been processed,
+    // and the write buffer while a record hasn't been sent.
+    std::size_t size = 0;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (SSL_has_pending(ssl))
+        size += bufferSize;
+#else
+    if (SSL_pending(ssl) > 0)
+        size += bufferSize;
+#endif
+
+    if (SSL_want_write(ssl))
+        size += bufferSize;
+
+    return size;
+}
+
+
+std::size_t ofSSLManager::estimateConnectionBufferSize(const Poco::Net::SecureStreamSocket& socket)
+{
+    if (socket.impl() == nullptr)
+        return 0;
+
+    return estimateConnectionBufferSize(instance()._metrics.findConnection(static_cast<int>(socket.impl()->sockfd())));
+}
+
+
+void ofSSLManager::setEarlyDataEnabled(bool enabled)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10101000L
+    if (enabled)
+        ofLogWarning("ofSSLManager::setEarlyDataEnabled") << "Early data requires OpenSSL 1.1.1 or newer.";
+#endif
+
+    instance()._earlyDataEnabled = enabled;
+}
+
+
+bool ofSSLManager::isEarlyDataEnabled()
+{
+    return instance()._earlyDataEnabled;
+}
+
+
+void ofSSLManager::setMaxEarlyData(uint32_t bytes)
+{
+    instance()._maxEarlyData = bytes;
+}
+
+
+uint32_t ofSSLManager::getMaxEarlyData()
+{
+    return instance()._maxEarlyData;
+}
+
+
+void ofSSLManager::applyEarlyData(Poco::Net::Context::Ptr pContext,
+                                  uint32_t maxEarlyData)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    // Clients need no configuration, the session says if the server accepts
+    // early data.
+    if (!pContext->isForServerUse())
+        return;
+
+    SSL_CTX* pSSLContext = pContext->sslContext();
+
+    // The first limit is advertised in session tickets, the second is
+    // enforced when early data is received.
+    SSL_CTX_set_max_early_data(pSSLContext, maxEarlyData);
+    SSL_CTX_set_recv_max_early_data(pSSLContext, maxEarlyData);
+
+    // OpenSSL's own replay protection only resumes tickets found in this
+    // Context's session cache, which breaks resumption across replicas and
+    // processes and after cache evictions.  The replay window is used
+    // instead, and early data is refused when the session ticket keys are
+    // shared with other processes (see _allowEarlyData()).
+    SSL_CTX_set_options(pSSLContext, SSL_OP_NO_ANTI_REPLAY);
+    SSL_CTX_set_allow_early_data_cb(pSSLContext,
+                                    &ofSSLManager::_allowEarlyData,
+                                    &instance()._earlyDataReplayWindow);
+#endif
+}
+
+
+ofSSLAntiReplayWindow& ofSSLManager::getEarlyDataReplayWindow()
+{
+    return instance()._earlyDataReplayWindow;
+}
+
+
+std::size_t ofSSLManager::writeEarlyData(SSL* ssl,
+                                         const void* buffer,
+                                         std::size_t length)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    SSL_SESSION* pSession = ssl != nullptr ? SSL_get_session(ssl) : nullptr;
+
+    // TLS 1.3 clients use each session ticket once.
+    if (pSession == nullptr || !SSL_SESSION_is_resumable(pSession) || length == 0)
+        return 0;
+
+    std::size_t maxEarlyData = SSL_SESSION_get_max_early_data(pSession);
+
+    if (maxEarlyData == 0)
+        return 0;
+
+    std::size_t written = 0;
+
+    if (SSL_write_early_data(ssl, buffer, std::min(length, maxEarlyData), &written) != 1)
+    {
+        ERR_clear_error();
+        throw Poco::Net::SSLException("Unable to write early data");
+    }
+
+    return written;
+#else
+    return 0;
+#endif
+}
+
+
+std::string ofSSLManager::readEarlyData(SSL* ssl)
+{
+    std::string data;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    char buffer[4096];
+
+    while (true)
+    {
+        std::size_t n = 0;
+
+        int result = SSL_read_early_data(ssl, buffer, sizeof(buffer), &n);
+
+        if (result == SSL_READ_EARLY_DATA_ERROR)
         {
-            ofLogWarning("ofSSLManager::initializeClient") << "CA File not found. Please refer to the ofxSSLManager documentation.";
+            ERR_clear_error();
+            throw Poco::Net::SSLException("Unable to read early data");
         }
-        
-        Poco::Net::Context::Ptr _pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
-                                                                   caLocation);
 
-        Poco::Net::SSLManager::instance().initializeClient(nullptr,
-                                                           nullptr,
-                                                           _pContext);
-        manager._clientContextInitialized = true;
+        data.append(buffer, n);
+
+        if (result == SSL_READ_EARLY_DATA_FINISH)
+            break;
     }
-    else
+
+    if (!data.empty())
+        instance()._metrics.recordEarlyData(data.size());
+#endif
+
+    return data;
+}
+
+
+bool ofSSLManager::isEarlyDataAccepted(const SSL* ssl)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    return ssl != nullptr && SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED;
+#else
+    return false;
+#endif
+}
+
+
+int ofSSLManager::_allowEarlyData(SSL* ssl, void* arg)
+{
+    // The window only sees this process, so a client hello recorded once
+    // could be replayed to every process that shares the ticket keys.
+    if (ofSSLSessionTicketKeys::isShared(SSL_get_SSL_CTX(ssl)))
+        return 0;
+
+    ofSSLAntiReplayWindow* window = static_cast<ofSSLAntiReplayWindow*>(arg);
+    return window->accept(ofSSLAntiReplayWindow::makeKey(ssl)) ? 1 : 0;
+}
+
+
+void ofSSLManager::setServerContextShardCount(std::size_t count)
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._serverContextMutex);
+
+    manager._serverContextShardCount = std::max<std::size_t>(count, 1);
+
+    // See _publishServerContext().
+    ++manager._serverShardGeneration;
+    _waitForReaders(manager._serverContext);
+    manager._serverShards.clear();
+}
+
+
+std::size_t ofSSLManager::getServerContextShardCount()
+{
+    return instance()._serverContextShardCount;
+}
+
+
+ofSSLTrustStore::Ptr ofSSLManager::getTrustStore()
+{
+    ofSSLManager& manager = ofSSLManager::instance();
+
+    std::unique_lock<std::mutex> lock(manager._trustStoreMutex);
+
+    if (manager._trustStore.isNull())
     {
-        ofLogVerbose("ofSSLManager::initializeClient") << "pContext exists or the manager has already been initialized.";
+        manager._trustStore = new ofSSLTrustStore();
+        _loadTrustStore(*manager._trustStore);
     }
+
+    return manager._trustStore;
 }
 
 
-void ofSSLManager::initializeServer(Poco::Net::Context::Ptr pContext)
+void ofSSLManager::setTrustStore(ofSSLTrustStore::Ptr pTrustStore)
 {
     ofSSLManager& manager = ofSSLManager::instance();
+    std::unique_lock<std::mutex> lock(manager._trustStoreMutex);
+    manager._trustStore = pTrustStore;
+}
 
-    if (!pContext.isNull())
+
+std::size_t ofSSLManager::createCADirectory()
+{
+    std::string caLocation = _findCALocation();
+
+    if (caLocation.empty())
+        return 0;
+
+    return ofSSLTrustStore::createDirectory(caLocation, _getCADirectory(caLocation));
+}
+
+
+void ofSSLManager::_loadTrustStore(ofSSLTrustStore& trustStore)
+{
+    std::string caLocation = _findCALocation();
+
+    if (caLocation.empty())
+        return;
+
+    // Prefer a hashed directory next to the PEM bundle.
+    std::string caDirectory = _getCADirectory(caLocation);
+
+    if (std::filesystem::is_directory(caDirectory))
     {
-        Poco::Net::SSLManager::instance().initializeServer(nullptr,
-                                                           nullptr,
-                                                           pContext);
-        manager._serverContextInitialized = true;
+        if (!ofSSLTrustStore::isDirectoryCurrent(caLocation, caDirectory))
+        {
+            ofLogNotice("ofSSLManager::_loadTrustStore") << caLocation << " has changed. Regenerating " << caDirectory << ".";
+            ofSSLTrustStore::createDirectory(caLocation, caDirectory);
+        }
+
+        if (trustStore.loadDirectory(caDirectory) > 0)
+            return;
     }
-    else if (!manager._serverContextInitialized)
-    {
-        std::string privateKeyFile = ofToDataPath(DEFAULT_PRIVATE_KEY_FILE, true);
-        std::string certificateFile = ofToDataPath(DEFAULT_CERTIFICATE_FILE, true);
-        std::string caLocation = ofToDataPath(DEFAULT_CA_LOCATION, true);
 
-        Poco::File caLocationFile(caLocation);
+    // Then prefer a binary bundle next to the PEM bundle, unless it is stale.
+    std::filesystem::path caBinaryLocation = std::filesystem::path(caLocation).replace_extension(".bin");
 
-        if (!caLocationFile.exists())
+    if (std::filesystem::exists(caBinaryLocation))
+    {
+        if (std::filesystem::last_write_time(caBinaryLocation) < std::filesystem::last_write_time(caLocation))
+        {
+            ofLogWarning("ofSSLManager::_loadTrustStore") << caBinaryLocation.string() << " is older than " << caLocation << ". Using " << caLocation << ".";
+        }
+        else if (trustStore.loadBinary(caBinaryLocation.string()) > 0)
         {
-            ofLogWarning("ofSSLManager::initializeClient") << "CA File not found.";
-            caLocation = "";
+            return;
         }
+    }
 
-        Poco::Net::Context::Ptr _pContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
-                                                                   privateKeyFile,
-                                                                   certificateFile,
-                                                                   caLocation);
+    trustStore.loadPEM(caLocation);
+}
 
-        Poco::Net::SSLManager::instance().initializeServer(nullptr,
-                                                           nullptr,
-                                                           _pContext);
-        manager._serverContextInitialized = true;
+
+std::string ofSSLManager::_getCADirectory(const std::string& caLocation)
+{
+    std::filesystem::path caDirectory = std::filesystem::path(caLocation).parent_path();
+    caDirectory /= std::filesystem::path(DEFAULT_CA_DIRECTORY).filename();
+    return caDirectory.string();
+}
+
+
+std::string ofSSLManager::_findCALocation()
+{
+    std::filesystem::path localCACertPath = ofToDataPath(DEFAULT_CA_LOCATION, true);
+
+    std::filesystem::path sharedCACertPath = std::filesystem::path(__FILE__).parent_path().parent_path();
+    sharedCACertPath /= "shared";
+    sharedCACertPath /= "data";
+    sharedCACertPath /= DEFAULT_CA_LOCATION;
+
+    if (std::filesystem::exists(localCACertPath))
+    {
+        return localCACertPath.string();
     }
-    else
+    else if (std::filesystem::exists(sharedCACertPath))
     {
-        ofLogVerbose("ofSSLManager::initializeServer") << "pContext exists or the manager has already been initialized.";
+        ofLogWarning("ofSSLManager::_findCALocation") << "CA File not found @ " << localCACertPath.string() << ". Using " << sharedCACertPath.string() << ".";
+        return sharedCACertPath.string();
     }
+
+    ofLogWarning("ofSSLManager::_findCALocation") << "CA File not found. Please refer to the ofxSSLManager documentation.";
+    return "";
 }
 
 
@@ -159,6 +1857,25 @@ std::string ofSSLManager::to_string(Poco::Net::Context::VerificationMode mode)
 }
 
 
+std::string ofSSLManager::to_string(PerformanceProfile profile)
+{
+    switch (profile)
+    {
+        case PROFILE_AUTO:
+            return "PROFILE_AUTO";
+        case PROFILE_AES:
+            return "PROFILE_AES";
+        case PROFILE_CHACHA20:
+            return "PROFILE_CHACHA20";
+        case PROFILE_NONE:
+            return "PROFILE_NONE";
+    }
+
+    ofLogWarning("ofSSLManager::to_string") << "Unknown performance profile.";
+    return "UNKNOWN";
+}
+
+
 Poco::Net::Context::VerificationMode ofSSLManager::from_string(const std::string& mode)
 {
     if (mode == "VERIFY_NONE")
@@ -183,3 +1900,29 @@ Poco::Net::Context::VerificationMode ofSSLManager::from_string(const std::string
         return Poco::Net::Context::VERIFY_STRICT;
     }
 }
+
+
+ofSSLManager::PerformanceProfile ofSSLManager::performanceProfileFromString(const std::string& profile)
+{
+    if (profile == "PROFILE_AUTO")
+    {
+        return PROFILE_AUTO;
+    }
+    else if (profile == "PROFILE_AES")
+    {
+        return PROFILE_AES;
+    }
+    else if (profile == "PROFILE_CHACHA20")
+    {
+        return PROFILE_CHACHA20;
+    }
+    else if (profile == "PROFILE_NONE")
+    {
+        return PROFILE_NONE;
+    }
+    else
+    {
+        ofLogWarning("ofSSLManager::performanceProfileFromString") << "Unrecognized performance profile: " << profile;
+        return PROFILE_AUTO;
+    }
+}
@@ -8,6 +8,16 @@
 #pragma once
 
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "Poco/BasicEvent.h"
 #include "Poco/DateTimeFormatter.h"
 #include "Poco/Delegate.h"
@@ -20,6 +30,19 @@
 #include "Poco/Net/SSLManager.h"
 #include "ofUtils.h"
 #include "ofEvents.h"
+#include "ofSSLAllocator.h"
+#include "ofSSLAntiReplayWindow.h"
+#include "ofSSLCertificateStore.h"
+#include "ofSSLCertificateVerifier.h"
+#include "ofSSLConnectionPool.h"
+#include "ofSSLKernelTLS.h"
+#include "ofSSLMetrics.h"
+#include "ofSSLOCSPStapler.h"
+#include "ofSSLPrivateKeyCache.h"
+#include "ofSSLSessionCache.h"
+#include "ofSSLSessionTicketKeys.h"
+#include "ofSSLTrustStore.h"
+#include "ofSSLVerificationCache.h"
 
 
 /// \brief A class to simplify client and server SSL Context management.
@@ -73,6 +96,27 @@
 class ofSSLManager
 {
 public:
+    /// \brief A function that decides whether to ignore a verification error.
+    ///
+    /// The function must return quickly.  The returned future is set to true
+    /// to ignore the error, or false to reject the certificate.  The
+    /// arguments are only valid during the call, so anything needed to make
+    /// the decision must be copied before returning.
+    typedef std::function<std::future<bool>(const Poco::Net::VerificationErrorArgs&)> AsyncVerificationHandler;
+
+    /// \brief Cipher suite and key exchange group orderings.
+    enum PerformanceProfile
+    {
+        /// \brief Choose PROFILE_AES or PROFILE_CHACHA20 for this CPU.
+        PROFILE_AUTO,
+        /// \brief Prefer AES-GCM, for CPUs with AES instructions.
+        PROFILE_AES,
+        /// \brief Prefer ChaCha20-Poly1305, for CPUs without AES instructions.
+        PROFILE_CHACHA20,
+        /// \brief Keep the Poco default cipher list.
+        PROFILE_NONE
+    };
+
     /// \brief Get the default Server Context via the ofSSLManager.
     /// \returns A pointer to the default Server Context.
     /// \note This is the same context that is returned via
@@ -82,6 +126,9 @@ public:
     ///        called prior to the Poco::Net::SSLManager call.  This
     ///        ensures that the default Server Context has been configured
     ///        first by ofSSLManager, rather than Poco::Net::SSLManager.
+    /// \note Once the default Server Context is initialized, this only
+    ///       uses atomic operations and does not lock, so it can be called
+    ///       for every connection from any number of threads.
     static Poco::Net::Context::Ptr getDefaultServerContext();
 
     /// \brief Get the default Client Context via the ofSSLManager.
@@ -93,6 +140,9 @@ public:
     ///        called prior to the Poco::Net::SSLManager call.  This
     ///        ensures that the default Client Context has been configured
     ///        first by ofSSLManager, rather than Poco::Net::SSLManager.
+    /// \note Once the default Client Context is initialized, this only
+    ///       uses atomic operations and does not lock, so it can be called
+    ///       for every connection from any number of threads.
     static Poco::Net::Context::Ptr getDefaultClientContext();
 
     /// \brief Initialize a SSL Server Context.
@@ -103,6 +153,13 @@ public:
     ///        function immediately in the ofBaseApp::setup() function.
     ///        Otherwise, ofSSLManager::initializeSlient() will be
     ///        configured with the ofSSLManager default settings.
+    /// \note Initialization is thread-safe.  The default Server Context is
+    ///       built only once, by the first caller, while concurrent callers
+    ///       wait for it.  No lock is held during the build, so passphrase
+    ///       and verification listeners may call ofSSLManager, except to get
+    ///       the Context being built.
+    /// \throws Poco::IllegalStateException if called by a listener while
+    ///         this thread builds the default Server Context.
     static void initializeServer(Poco::Net::Context::Ptr pContext = nullptr);
 
     /// \brief Initialize a SSL Client Context.
@@ -113,8 +170,619 @@ public:
     ///        function immediately in the ofBaseApp::setup() function.
     ///        Otherwise, ofSSLManager::initializeClient() will be
     ///        configured with the ofSSLManager default settings.
+    /// \note Initialization is thread-safe.  The default Client Context is
+    ///       built only once, by the first caller, while concurrent callers
+    ///       wait for it.  No lock is held during the build, so listeners
+    ///       may call ofSSLManager, except to get the Context being built.
+    /// \throws Poco::IllegalStateException if called by a listener while
+    ///         this thread builds the default Client Context.
     static void initializeClient(Poco::Net::Context::Ptr pContext = nullptr);
 
+    /// \brief Start building the default Client and Server Contexts.
+    ///
+    /// Building the default Contexts loads the trust store and the server
+    /// certificate and private key, which can take a while.  By default this
+    /// happens on the first call to getDefaultClientContext() or
+    /// getDefaultServerContext(), usually on a request handling thread.
+    /// Calling warmUp() (e.g. in ofBaseApp::setup()) builds both default
+    /// Contexts on a background thread instead.  Getters called before the
+    /// build finishes block only until it is ready.  The time spent waiting
+    /// is reported by getWarmUpWaitTime().
+    ///
+    /// ~~~{.cpp}
+    ///     void ofApp::setup()
+    ///     {
+    ///         ofSSLManager::registerAllEvents(this);
+    ///         ofSSLManager::warmUp();
+    ///     }
+    /// ~~~
+    ///
+    /// Calling warmUp() again returns the same future.
+    ///
+    /// A Context that fails to build is logged and built again by the first
+    /// getter, which then throws the error.
+    ///
+    /// \returns A future that is ready when both default Contexts are built.
+    /// \note Event listeners and custom settings must be registered before
+    ///       calling warmUp().
+    /// \note Verification and private key passphrase listeners called while
+    ///       the default Contexts are built run on the warm-up thread, not on
+    ///       the thread that called warmUp().  Listeners that touch
+    ///       application state must synchronize.
+    static std::shared_future<void> warmUp();
+
+    /// \returns the total time getters spent waiting for warmUp() to finish.
+    static std::chrono::microseconds getWarmUpWaitTime();
+
+    /// \returns the number of getter calls that waited for warmUp().
+    static uint64_t getWarmUpWaitCount();
+
+    /// \brief Reload the default Server Context when its files change.
+    ///
+    /// When enabled, a background thread checks DEFAULT_PRIVATE_KEY_FILE and
+    /// DEFAULT_CERTIFICATE_FILE at the given interval.  When either file
+    /// changes, a new default Server Context is built on that thread and
+    /// published atomically.  New connections use the new Context, while
+    /// connections that are already established keep the Context they were
+    /// created with until they are closed.
+    ///
+    /// If the new files cannot be loaded (e.g. the certificate has been
+    /// replaced but the private key has not been replaced yet), the current
+    /// Context is kept and the build is retried when the files change again.
+    ///
+    /// Session tickets issued before a reload remain valid because the
+    /// session ticket keys are shared.  Sessions cached by session id are not
+    /// carried over.
+    ///
+    /// \param interval The interval between checks.  Zero disables reloading.
+    /// \note Only a default Server Context built by ofSSLManager is reloaded,
+    ///       not a Context passed to initializeServer().
+    static void setServerReloadInterval(std::chrono::milliseconds interval);
+
+    /// \returns the interval between checks for changed server files.
+    static std::chrono::milliseconds getServerReloadInterval();
+
+    /// \brief Rebuild the default Server Context from its files now.
+    /// \returns true iff a new default Server Context was published.
+    static bool reloadServerContext();
+
+    /// \returns the number of times the default Server Context was reloaded.
+    static uint64_t getServerReloadCount();
+
+    /// \returns the number of reloads that failed to build a Context.
+    static uint64_t getServerReloadFailureCount();
+
+    /// \returns the time taken by the last successful reload.
+    static std::chrono::microseconds getLastServerReloadTime();
+
+    /// \brief Get the number of Server Contexts still in use.
+    ///
+    /// This includes the current default Server Context and every previous
+    /// default Server Context still referenced, e.g. by a connection.  A
+    /// replaced Context is released as soon as its last reference is gone.
+    ///
+    /// \returns the number of Server Contexts in use.
+    static std::size_t getServerContextsInUse();
+
+    /// \brief Set the cipher suite and key exchange ordering of default Contexts.
+    ///
+    /// Both profiles put X25519 before P-256 and prefer ECDHE key exchange.
+    /// They differ in the order of the bulk ciphers.  AES-GCM is fastest on
+    /// CPUs with AES instructions, while ChaCha20-Poly1305 is several times
+    /// faster than AES-GCM on CPUs without them.  Server Contexts also honor
+    /// clients that prefer ChaCha20-Poly1305, e.g. phones without AES
+    /// instructions.  The default, PROFILE_AUTO, chooses by CPU.
+    ///
+    /// The profile applies to default Contexts created after this call.
+    ///
+    /// \param profile The performance profile.
+    static void setPerformanceProfile(PerformanceProfile profile);
+
+    /// \returns the performance profile of the default Contexts.
+    static PerformanceProfile getPerformanceProfile();
+
+    /// \returns PROFILE_AES or PROFILE_CHACHA20, depending on this CPU.
+    static PerformanceProfile getDetectedPerformanceProfile();
+
+    /// \returns true iff this CPU has AES instructions.
+    static bool hasAESAcceleration();
+
+    /// \brief Apply a performance profile to a Context.
+    ///
+    /// Use this to configure Contexts that are not created by ofSSLManager
+    /// like the default Contexts:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::applyPerformanceProfile(pContext, ofSSLManager::getPerformanceProfile());
+    /// ~~~
+    ///
+    /// \param pContext The Context to configure.
+    /// \param profile The performance profile.
+    static void applyPerformanceProfile(Poco::Net::Context::Ptr pContext,
+                                        PerformanceProfile profile);
+
+    /// \brief Enable or disable kernel TLS offload for default Contexts.
+    ///
+    /// When enabled, connections of default Contexts created after this call
+    /// hand encryption to the kernel after the handshake, if the kernel and
+    /// the negotiated cipher support it.  Other connections use userspace
+    /// TLS as usual.  Use ofSSLKernelTLS::isSendOffloaded() to check a
+    /// connection and ofSSLKernelTLS::sendFile() to send files without
+    /// copying them to userspace.  Disabled by default.
+    ///
+    /// \param enabled True to enable kernel TLS offload.
+    static void setKernelTLSEnabled(bool enabled);
+
+    /// \returns true iff kernel TLS offload is enabled for default Contexts.
+    static bool isKernelTLSEnabled();
+
+    /// \brief Enable or disable the low memory mode for default Contexts.
+    ///
+    /// Each connection holds a read and a write buffer of about 17 KB.  In
+    /// low memory mode, connections of default Contexts created after this
+    /// call release their buffers while idle, send smaller records, and
+    /// clients ask servers for smaller records (the maximum fragment length
+    /// extension), so that the buffers allocated while data is transferred
+    /// are smaller too.  This greatly reduces the memory used by many mostly
+    /// idle connections (e.g. websockets), at the cost of an allocation per
+    /// burst of traffic and more record overhead.  Disabled by default.
+    ///
+    /// \param enabled True to enable the low memory mode.
+    static void setLowMemoryModeEnabled(bool enabled);
+
+    /// \returns true iff the low memory mode is enabled for default Contexts.
+    static bool isLowMemoryModeEnabled();
+
+    /// \brief Set the maximum record size used in low memory mode.
+    /// \param length The maximum fragment length: 512, 1024, 2048 or 4096
+    ///        bytes, or 0 to keep the standard 16384 bytes and only release
+    ///        idle buffers.
+    static void setLowMemoryFragmentLength(std::size_t length);
+
+    /// \returns the maximum record size used in low memory mode.
+    static std::size_t getLowMemoryFragmentLength();
+
+    /// \brief Apply the low memory mode to a Context.
+    ///
+    /// Use this to configure Contexts that are not created by ofSSLManager
+    /// like the default Contexts.
+    ///
+    /// \param pContext The Context to configure.
+    /// \param fragmentLength The maximum fragment length: 512, 1024, 2048 or
+    ///        4096 bytes, or 0 to only release idle buffers.
+    static void applyLowMemoryMode(Poco::Net::Context::Ptr pContext,
+                                   std::size_t fragmentLength);
+
+    /// \brief Estimate the memory held by the record buffers of a connection.
+    ///
+    /// This is an upper bound computed from the connection's state, not a
+    /// measurement.  Buffers are sized for the negotiated maximum fragment
+    /// length.  A connection in low memory mode holds a buffer only while
+    /// it has an unprocessed (possibly partial) record to read or a record
+    /// to send, and no buffers while idle.  Other per-connection state
+    /// (keys, handshake state, the session) is not included.
+    ///
+    /// \param ssl The connection.
+    /// \returns the estimated size of the buffers in bytes.
+    static std::size_t estimateConnectionBufferSize(const SSL* ssl);
+
+    /// \brief Estimate the memory held by the record buffers of a connection.
+    ///
+    /// The connection is found by its socket in the metrics, so it must use
+    /// a Context created by ofSSLManager or attached to
+    /// ofSSLManager::getMetrics().
+    ///
+    /// \param socket The connection.
+    /// \returns the estimated size of the buffers in bytes, or 0 if the
+    ///          connection is not found.
+    static std::size_t estimateConnectionBufferSize(const Poco::Net::SecureStreamSocket& socket);
+
+    /// \brief Enable or disable TLS 1.3 early data for default Server Contexts.
+    ///
+    /// Early (0-RTT) data lets a client that resumes a session send its
+    /// first request with the client hello, saving a round trip.  Early data
+    /// can be replayed by an attacker, so only use it for idempotent
+    /// requests.  When enabled, default Server Contexts created after this
+    /// call issue session tickets that allow early data and accept it
+    /// through readEarlyData(), once per ticket (see
+    /// getEarlyDataReplayWindow()).  Clients send early data explicitly
+    /// with writeEarlyData().  Disabled by default, so that all handshakes
+    /// take a full round trip.
+    ///
+    /// \note Poco::Net::SecureStreamSocket completes the handshake without
+    ///       reading or writing early data, so early data is used with SSL
+    ///       connections created from the Context's SSL_CTX.  Servers that
+    ///       accept connections with Poco sockets reject early data.
+    ///
+    /// \note Replays are only detected within this process.  When the
+    ///       session ticket keys are shared with other processes (see
+    ///       getServerSessionTicketKeys()), a replayed client hello could be
+    ///       accepted once by each of them, so early data is refused and
+    ///       resumed handshakes take a full round trip.
+    ///
+    /// \param enabled True to enable early data.
+    static void setEarlyDataEnabled(bool enabled);
+
+    /// \returns true iff early data is enabled for default Server Contexts.
+    static bool isEarlyDataEnabled();
+
+    /// \brief Set the maximum amount of early data a server accepts.
+    /// \param bytes The maximum number of bytes of early data.
+    static void setMaxEarlyData(uint32_t bytes);
+
+    /// \returns the maximum amount of early data a server accepts.
+    static uint32_t getMaxEarlyData();
+
+    /// \brief Let a Server Context accept early data.
+    ///
+    /// Use this to configure Contexts that are not created by ofSSLManager
+    /// like the default Contexts.  Replays are rejected with the early data
+    /// replay window.  Early data is refused while session ticket keys with
+    /// a shared key file are attached to the Context.  Does nothing for
+    /// Client Contexts or if OpenSSL is older than 1.1.1.
+    ///
+    /// \param pContext The Context to configure.
+    /// \param maxEarlyData The maximum number of bytes of early data, or 0
+    ///        to reject early data.
+    static void applyEarlyData(Poco::Net::Context::Ptr pContext,
+                               uint32_t maxEarlyData);
+
+    /// \brief Get the window used to reject replayed early data.
+    /// \returns A reference to the anti-replay window.
+    static ofSSLAntiReplayWindow& getEarlyDataReplayWindow();
+
+    /// \brief Send early data on a client connection.
+    ///
+    /// Call this instead of SSL_connect() on a blocking connection that
+    /// resumes a session, e.g. from getClientSession(), then complete the
+    /// handshake as usual.  If isEarlyDataAccepted() returns false after the
+    /// handshake, the server did not receive the data and it must be sent
+    /// again.
+    ///
+    /// ~~~{.cpp}
+    ///     std::size_t sent = ofSSLManager::writeEarlyData(ssl, request.data(), request.size());
+    ///
+    ///     if (SSL_do_handshake(ssl) == 1 && !ofSSLManager::isEarlyDataAccepted(ssl))
+    ///         sent = 0;
+    ///
+    ///     SSL_write(ssl, request.data() + sent, request.size() - sent);
+    /// ~~~
+    ///
+    /// \param ssl The client connection, before the handshake.
+    /// \param buffer The data to send.
+    /// \param length The number of bytes to send.
+    /// \returns the number of bytes sent as early data, limited by the
+    ///          session, or 0 if the session does not allow early data.
+    /// \throws Poco::Net::SSLException if the connection fails.
+    static std::size_t writeEarlyData(SSL* ssl,
+                                      const void* buffer,
+                                      std::size_t length);
+
+    /// \brief Receive early data on a server connection.
+    ///
+    /// Call this instead of SSL_accept() on a blocking connection, then
+    /// complete the handshake as usual.  Early data from a client hello that
+    /// was already seen is rejected, and the client sends it again after
+    /// the handshake.
+    ///
+    /// \param ssl The server connection, before the handshake.
+    /// \returns the early data, or an empty string if none was accepted.
+    /// \throws Poco::Net::SSLException if the connection fails.
+    static std::string readEarlyData(SSL* ssl);
+
+    /// \param ssl The connection, after the handshake.
+    /// \returns true iff early data was sent and accepted.
+    static bool isEarlyDataAccepted(const SSL* ssl);
+
+    /// \brief Set the number of replicas of the default Server Context.
+    ///
+    /// A single Server Context shared by many accepting threads contends on
+    /// the locks of its session cache and certificate store.  With more
+    /// than one shard, ofSSLManager::getDefaultServerContext() gives each
+    /// thread one of several replicas of the default Server Context, in
+    /// turn.  The replicas have the same settings and share the certificate,
+    /// private key, trust store and session ticket keys, but each has its own
+    /// session cache.  Sessions resume across shards with session tickets.
+    ///
+    /// Typically the count is the number of accepting threads or cores:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::setServerContextShardCount(std::thread::hardware_concurrency());
+    /// ~~~
+    ///
+    /// Sharding applies only to the default Server Context, not to a Context
+    /// passed to ofSSLManager::initializeServer().
+    ///
+    /// \param count The number of shards, or 1 to disable sharding.
+    static void setServerContextShardCount(std::size_t count);
+
+    /// \returns the number of replicas of the default Server Context.
+    static std::size_t getServerContextShardCount();
+
+    /// \brief Get the trust store shared by the default Contexts.
+    ///
+    /// On first use, the trust store is loaded from the CA bundle at
+    /// DEFAULT_CA_LOCATION in the data folder or, if it does not exist, the
+    /// CA bundle in the addon's shared data folder.  The bundle is parsed
+    /// once and the resulting store is shared by the default Client and
+    /// Server Contexts.  Custom Contexts can share it by attaching it:
+    ///
+    /// ~~~{.cpp}
+    ///     Poco::Net::Context::Ptr pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "");
+    ///     ofSSLManager::getTrustStore()->attach(pContext);
+    ///     ofSSLManager::initializeClient(pContext);
+    /// ~~~
+    ///
+    /// Alternative formats next to the PEM bundle are preferred, in order:
+    ///
+    /// 1. A hashed certificate directory (see DEFAULT_CA_DIRECTORY and
+    ///    ofSSLManager::createCADirectory()).  It is regenerated if the PEM
+    ///    bundle has changed since it was created.
+    /// 2. A binary bundle created by `shared/data/ssl.sh` (e.g.
+    ///    `ssl/cacert.bin`), unless it is older than the PEM bundle.
+    ///
+    /// Both are loaded lazily: certificates are only read when they are
+    /// needed to build a chain.  ofSSLTrustStore::getParsedCount() reports
+    /// how many certificates have actually been loaded.  The PEM bundle is
+    /// the fallback.
+    ///
+    /// \returns The shared trust store.
+    static ofSSLTrustStore::Ptr getTrustStore();
+
+    /// \brief Create a hashed certificate directory from the CA bundle.
+    ///
+    /// The directory is created next to the CA bundle found by
+    /// ofSSLManager::getTrustStore() and is preferred by it from then on.
+    ///
+    /// \returns The number of certificates written.
+    /// \note The trust store is loaded once, so this should be called before
+    ///       the default Contexts are created.
+    static std::size_t createCADirectory();
+
+    /// \brief Replace the trust store shared by the default Contexts.
+    /// \param pTrustStore The trust store to share.
+    /// \note Contexts that are already created keep the store they were
+    ///       created with, so this should be called before the default
+    ///       Contexts are created.
+    static void setTrustStore(ofSSLTrustStore::Ptr pTrustStore);
+
+    /// \brief Get the client session cache managed by the ofSSLManager.
+    ///
+    /// The cache is used to resume client sessions with servers that were
+    /// previously connected to, avoiding a full handshake.
+    ///
+    /// \returns A reference to the client session cache.
+    static ofSSLSessionCache& getClientSessionCache();
+
+    /// \brief Enable or disable client session caching.
+    ///
+    /// Client session caching is enabled by default.  When enabled, the
+    /// default Client Context is created with OpenSSL client session caching
+    /// turned on and the client session cache stores sessions.  Disabling the
+    /// cache also clears it.
+    ///
+    /// \param enabled True to enable client session caching.
+    /// \note The default Client Context is configured when it is created, so
+    ///       this should be called before the first call to
+    ///       ofSSLManager::getDefaultClientContext().
+    static void setClientSessionCacheEnabled(bool enabled);
+
+    /// \returns true iff client session caching is enabled.
+    static bool isClientSessionCacheEnabled();
+
+    /// \brief Get a cached client session for the given host and port.
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \returns The session or nullptr if none is available or caching is
+    ///          disabled.
+    static Poco::Net::Session::Ptr getClientSession(const std::string& host,
+                                                    uint16_t port);
+
+    /// \brief Cache a client session for the given host and port.
+    ///
+    /// The session is usually retrieved after a successful handshake with
+    /// Poco::Net::SecureStreamSocket::currentSession() or
+    /// Poco::Net::HTTPSClientSession::sslSession().  It is ignored if caching
+    /// is disabled.
+    ///
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \param session The session to cache.
+    static void setClientSession(const std::string& host,
+                                 uint16_t port,
+                                 Poco::Net::Session::Ptr session);
+
+    /// \brief Set the size of the server session cache.
+    ///
+    /// The server session cache allows clients to resume sessions by session
+    /// id.  A size of zero disables the server session cache.  Session
+    /// tickets are not affected.
+    ///
+    /// \param size The maximum number of cached server sessions.
+    /// \note The default Server Context is configured when it is created, so
+    ///       this should be called before the first call to
+    ///       ofSSLManager::getDefaultServerContext().
+    static void setServerSessionCacheSize(std::size_t size);
+
+    /// \returns the maximum number of cached server sessions.
+    static std::size_t getServerSessionCacheSize();
+
+    /// \brief Set the server session timeout.
+    ///
+    /// The timeout applies to both cached sessions and session tickets.
+    ///
+    /// \param timeout The session timeout.
+    /// \note The default Server Context is configured when it is created, so
+    ///       this should be called before the first call to
+    ///       ofSSLManager::getDefaultServerContext().
+    static void setServerSessionTimeout(std::chrono::seconds timeout);
+
+    /// \returns the server session timeout.
+    static std::chrono::seconds getServerSessionTimeout();
+
+    /// \brief Get the session ticket keys used by the default Server Context.
+    ///
+    /// To share session tickets between several server processes, set a
+    /// shared key file before the first call to
+    /// ofSSLManager::getDefaultServerContext():
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::getServerSessionTicketKeys().setSharedKeyFile(ofToDataPath("ssl/ticketKeys.txt", true));
+    /// ~~~
+    ///
+    /// \returns A reference to the session ticket keys.
+    static ofSSLSessionTicketKeys& getServerSessionTicketKeys();
+
+    /// \brief Get the certificates the default Server Context selects by SNI.
+    ///
+    /// The default Server Context serves the certificate for the host name
+    /// requested by the client from this store, and its own certificate when
+    /// no host directory matches.  Host Contexts share the trust store,
+    /// session settings and session ticket keys of the default Server Context.
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::getServerCertificateStore().setDirectory(ofToDataPath("ssl/hosts", true));
+    /// ~~~
+    ///
+    /// \returns A reference to the server certificate store.
+    static ofSSLCertificateStore& getServerCertificateStore();
+
+    /// \brief Enable or disable OCSP stapling for default Server Contexts.
+    ///
+    /// When enabled, default Server Contexts created after this call send a
+    /// recent OCSP response for their certificate to clients that ask for
+    /// it, so that clients checking revocation don't ask the certificate
+    /// authority's responder themselves.  Responses are fetched and
+    /// refreshed in the background by getOCSPStapler(), and saved to
+    /// DEFAULT_OCSP_CACHE_DIRECTORY unless another cache directory is set.
+    /// Certificates without an OCSP responder are not stapled.  Disabled by
+    /// default.
+    ///
+    /// \param enabled True to enable OCSP stapling.
+    static void setOCSPStaplingEnabled(bool enabled);
+
+    /// \returns true iff OCSP stapling is enabled for default Server Contexts.
+    static bool isOCSPStaplingEnabled();
+
+    /// \brief Get the OCSP stapler used by default Server Contexts.
+    ///
+    /// Use it to staple responses to other server Contexts, or to test
+    /// with a local responder:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::getOCSPStapler().setResponderURL("http://127.0.0.1:8888");
+    ///     ofSSLManager::getOCSPStapler().attach(pContext);
+    /// ~~~
+    ///
+    /// \returns A reference to the OCSP stapler.
+    static ofSSLOCSPStapler& getOCSPStapler();
+
+    /// \brief Get the handshake and Context metrics.
+    ///
+    /// Handshakes made with Contexts created by ofSSLManager are counted and
+    /// timed.  Use the metrics to set a trace handler:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::getMetrics().setTraceHandler([](const ofSSLHandshakeTrace& trace) {
+    ///         ofLogVerbose("ofApp") << trace.protocol << " " << trace.latency.count() << " us";
+    ///     });
+    /// ~~~
+    ///
+    /// \returns A reference to the metrics.
+    static ofSSLMetrics& getMetrics();
+
+    /// \brief Get a copy of all TLS metrics.
+    ///
+    /// The snapshot includes the handshake and Context metrics and the
+    /// counters kept by the client session cache, the session ticket keys,
+    /// the verification and private key caches, the server certificate
+    /// store, server reloading, warm-up and the pooled allocator.
+    ///
+    /// \returns a copy of all TLS metrics.
+    static ofSSLMetricsSnapshot getMetricsSnapshot();
+
+    /// \brief Get the cache of certificate verification decisions.
+    ///
+    /// The cache is disabled by default, so the listeners are called for
+    /// every verification error.  When enabled, the decision made by the
+    /// registered verification error listeners is cached by certificate
+    /// fingerprint and error number, and repeated errors are answered from
+    /// the cache without calling the listeners:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::getVerificationCache().setMaximumSize(ofSSLVerificationCache::DEFAULT_MAXIMUM_SIZE);
+    ///     ofSSLManager::getVerificationCache().setTimeToLive(std::chrono::minutes(10));
+    /// ~~~
+    ///
+    /// The cache is cleared whenever a listener is registered or
+    /// unregistered.  Asynchronous decisions that arrive after the timeout
+    /// are only used if the cache is enabled.
+    ///
+    /// \returns A reference to the verification cache.
+    static ofSSLVerificationCache& getVerificationCache();
+
+    /// \brief Get the cache of decrypted private keys.
+    ///
+    /// Server Contexts load their private key through this cache.  When a
+    /// time to live is set, the decrypted key and its passphrase are kept in
+    /// locked memory, so that Contexts rebuilt by reloading, sharding or
+    /// host names do not ask for the passphrase or decrypt the key again:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::getPrivateKeyCache().setTimeToLive(std::chrono::hours(1));
+    /// ~~~
+    ///
+    /// The cache is disabled by default.
+    ///
+    /// \returns A reference to the private key cache.
+    static ofSSLPrivateKeyCache& getPrivateKeyCache();
+
+    /// \brief Get the pool of client connections.
+    ///
+    /// The pool keeps connections that have completed their handshake with
+    /// the default Client Context, so that short requests to the same hosts
+    /// don't wait for a new handshake:
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLConnectionPool& pool = ofSSLManager::getClientConnectionPool();
+    ///     pool.prewarm("api.example.com", 443);
+    ///
+    ///     Poco::Net::SecureStreamSocket socket = pool.acquire("api.example.com", 443);
+    ///     // ... send a request and receive the complete response ...
+    ///     pool.release("api.example.com", 443, socket);
+    /// ~~~
+    ///
+    /// \returns A reference to the client connection pool.
+    static ofSSLConnectionPool& getClientConnectionPool();
+
+    /// \brief Verify a batch of certificate chains against the trust store.
+    ///
+    /// The chains are verified in parallel against the trust store shared by
+    /// the default Contexts (see getTrustStore()), and compact results are
+    /// returned instead of formatted strings:
+    ///
+    /// ~~~{.cpp}
+    ///     auto results = ofSSLManager::verifyCertificates(certificates);
+    ///
+    ///     for (const auto& result: results)
+    ///     {
+    ///         if (!result.ok())
+    ///             ofLogWarning() << X509_verify_cert_error_string(result.error) << " at depth " << result.depth;
+    ///     }
+    /// ~~~
+    ///
+    /// \param certificates The PEM or DER encoded certificate chains, each
+    ///        starting with the certificate to verify.
+    /// \returns The results, in the order of the certificates.
+    static std::vector<ofSSLCertificateVerifier::Result> verifyCertificates(const std::vector<std::string>& certificates);
+
+    /// \brief Get the certificate verifier used by verifyCertificates().
+    ///
+    /// The verifier sets the number of threads and counts the results.
+    ///
+    /// \returns A reference to the certificate verifier.
+    static ofSSLCertificateVerifier& getCertificateVerifier();
+
     /// \brief Register the listener class for all Client and Server SSL events.
     /// \param listener A pointer to the class containing all callbacks.
     /// \note Applications that do not implement these callbacks will not be
@@ -190,6 +858,109 @@ public:
     template <class ListenerClass>
     static void unregisterServerEvents(ListenerClass* listener);
 
+    /// \brief Register the listener class to decide client verification errors asynchronously.
+    ///
+    /// Listening classes must have a callback in the form:
+    ///
+    /// ~~~{.cpp}
+    ///     std::future<bool> onSSLClientVerificationErrorAsync(const Poco::Net::VerificationErrorArgs& args);
+    /// ~~~
+    ///
+    /// See ofSSLManager::setClientVerificationHandler() for details.
+    ///
+    /// \param listener A pointer to the class containing the callback.
+    /// \param timeout The maximum time a handshake waits for a decision.
+    /// \param ignoreErrorOnTimeout The decision used when the timeout passes.
+    template <class ListenerClass>
+    static void registerAsyncClientEvents(ListenerClass* listener,
+                                          std::chrono::milliseconds timeout = DEFAULT_ASYNC_VERIFICATION_TIMEOUT,
+                                          bool ignoreErrorOnTimeout = false);
+
+    /// \brief Unregister the asynchronous client verification listener.
+    ///
+    /// Does nothing if another handler was set since the listener was
+    /// registered.
+    ///
+    /// \param listener A pointer to the class containing the callback.
+    template <class ListenerClass>
+    static void unregisterAsyncClientEvents(ListenerClass* listener);
+
+    /// \brief Register the listener class to decide server verification errors asynchronously.
+    ///
+    /// Listening classes must have a callback in the form:
+    ///
+    /// ~~~{.cpp}
+    ///     std::future<bool> onSSLServerVerificationErrorAsync(const Poco::Net::VerificationErrorArgs& args);
+    /// ~~~
+    ///
+    /// See ofSSLManager::setClientVerificationHandler() for details.
+    ///
+    /// \param listener A pointer to the class containing the callback.
+    /// \param timeout The maximum time a handshake waits for a decision.
+    /// \param ignoreErrorOnTimeout The decision used when the timeout passes.
+    template <class ListenerClass>
+    static void registerAsyncServerEvents(ListenerClass* listener,
+                                          std::chrono::milliseconds timeout = DEFAULT_ASYNC_VERIFICATION_TIMEOUT,
+                                          bool ignoreErrorOnTimeout = false);
+
+    /// \brief Unregister the asynchronous server verification listener.
+    ///
+    /// Does nothing if another handler was set since the listener was
+    /// registered.
+    ///
+    /// \param listener A pointer to the class containing the callback.
+    template <class ListenerClass>
+    static void unregisterAsyncServerEvents(ListenerClass* listener);
+
+    /// \brief Set a function to decide client verification errors asynchronously.
+    ///
+    /// The handler starts the decision (e.g. a request to a policy service)
+    /// and returns a future.  The handshake waits for the decision for at
+    /// most the timeout and then uses the default decision.  When the
+    /// verification cache is enabled (see getVerificationCache()), a
+    /// decision that arrives late is cached when it arrives, so the next
+    /// handshake with the same certificate uses it without waiting.  With a
+    /// timeout of 0 the handshake never waits.
+    ///
+    /// While the cache is enabled, errors with a pending decision are not
+    /// passed to the handler again.
+    /// While a handler is set, it is used instead of the listeners registered
+    /// with ofSSLManager::registerClientEvents().
+    ///
+    /// ~~~{.cpp}
+    ///     ofSSLManager::setClientVerificationHandler([&](const Poco::Net::VerificationErrorArgs& args) {
+    ///         // The policy service sets the returned future from its own thread.
+    ///         return policyService.isAllowed(args.certificate().subjectName());
+    ///     }, std::chrono::milliseconds(50));
+    /// ~~~
+    ///
+    /// \note Futures returned by std::async wait for the decision when they
+    ///       are destroyed.  Return futures from a std::promise instead.
+    ///
+    /// \param handler The handler, or nullptr to use the listeners.
+    /// \param timeout The maximum time a handshake waits for a decision.
+    /// \param ignoreErrorOnTimeout The decision used when the timeout passes.
+    static void setClientVerificationHandler(AsyncVerificationHandler handler,
+                                             std::chrono::milliseconds timeout = DEFAULT_ASYNC_VERIFICATION_TIMEOUT,
+                                             bool ignoreErrorOnTimeout = false);
+
+    /// \brief Set a function to decide server verification errors asynchronously.
+    ///
+    /// See ofSSLManager::setClientVerificationHandler() for details.
+    ///
+    /// \param handler The handler, or nullptr to use the listeners.
+    /// \param timeout The maximum time a handshake waits for a decision.
+    /// \param ignoreErrorOnTimeout The decision used when the timeout passes.
+    static void setServerVerificationHandler(AsyncVerificationHandler handler,
+                                             std::chrono::milliseconds timeout = DEFAULT_ASYNC_VERIFICATION_TIMEOUT,
+                                             bool ignoreErrorOnTimeout = false);
+
+    /// \returns the number of decisions requested from asynchronous handlers.
+    static uint64_t getAsyncVerificationCount();
+
+    /// \returns the number of asynchronous decisions that timed out.
+    static uint64_t getAsyncVerificationTimeoutCount();
+
     /// \brief The default location of the certificate authority bundle.
     ///
     /// The certificate authority bundle can be extracted from
@@ -213,6 +984,36 @@ public:
     /// https://devcenter.heroku.com/articles/ssl-certificate-self
     static const std::string DEFAULT_CERTIFICATE_FILE;
 
+    /// \brief The default location of the hashed certificate directory.
+    ///
+    /// A hashed certificate directory holds one file per certificate, named
+    /// after the certificate's subject name hash, so that OpenSSL can load
+    /// only the certificates it needs.  It is created next to the CA bundle
+    /// by ofSSLManager::createCADirectory().
+    static const std::string DEFAULT_CA_DIRECTORY;
+
+    /// \brief The default maximum number of cached server sessions.
+    static const std::size_t DEFAULT_SERVER_SESSION_CACHE_SIZE;
+
+    /// \brief The default server session timeout.
+    static const std::chrono::seconds DEFAULT_SERVER_SESSION_TIMEOUT;
+
+    /// \brief The session id context used by the default Server Context.
+    static const std::string SESSION_ID_CONTEXT;
+
+    /// \brief The default time a handshake waits for an asynchronous decision.
+    static const std::chrono::milliseconds DEFAULT_ASYNC_VERIFICATION_TIMEOUT;
+
+    /// \brief The default maximum fragment length used in low memory mode.
+    static const std::size_t DEFAULT_LOW_MEMORY_FRAGMENT_LENGTH;
+
+    /// \brief The default maximum amount of early data a server accepts.
+    static const uint32_t DEFAULT_MAX_EARLY_DATA;
+
+    /// \brief The default directory OCSP responses are saved to, relative to
+    ///        the data folder.
+    static const std::string DEFAULT_OCSP_CACHE_DIRECTORY;
+
     /// \brief Get the string representation of a verification mode.
     /// \param mode The mode to convert.
     /// \returns The string representation.  Returns "UNKNOWN" if unknown.
@@ -223,6 +1024,16 @@ public:
     /// \returns The verification mode. Returns VERIFY_STRICT if unknown.
     static Poco::Net::Context::VerificationMode from_string(const std::string& mode);
 
+    /// \brief Get the string representation of a performance profile.
+    /// \param profile The profile to convert.
+    /// \returns The string representation.  Returns "UNKNOWN" if unknown.
+    static std::string to_string(PerformanceProfile profile);
+
+    /// \brief Get the performance profile from a string.
+    /// \param profile The profile string to convert.
+    /// \returns The performance profile. Returns PROFILE_AUTO if unknown.
+    static PerformanceProfile performanceProfileFromString(const std::string& profile);
+
 private:
     ofSSLManager();
     ofSSLManager(const ofSSLManager&) = delete;
@@ -239,11 +1050,394 @@ private:
     /// \returns A reference to the singleton.
     static ofSSLManager& instance();
 
-    /// \brief True iff ofSSLManager initialized its own Client Context.
-    bool _clientContextInitialized = false;
+    /// \brief Find the CA bundle in the data folder or shared data folder.
+    /// \returns The absolute path of the CA bundle or an empty string.
+    static std::string _findCALocation();
+
+    /// \brief Wait for a pending warmUp() to finish.
+    static void _waitForWarmUp();
+
+    /// \brief Load the trust store from the CA bundle or its alternatives.
+    /// \param trustStore The trust store to load.
+    static void _loadTrustStore(ofSSLTrustStore& trustStore);
+
+    /// \brief Get the hashed certificate directory for a CA bundle.
+    /// \param caLocation The path of the CA bundle.
+    /// \returns The path of the hashed certificate directory.
+    static std::string _getCADirectory(const std::string& caLocation);
+
+    typedef std::chrono::steady_clock Clock;
+
+    /// \brief A default Context that getters read without locking.
+    ///
+    /// A getter loads the pointer to the current Context and then takes a
+    /// reference to it.  So that a Context is never released in between,
+    /// getters count themselves in the readers of the current epoch while
+    /// they do so.  Publishing a Context starts a new epoch and waits until
+    /// the readers of the previous epoch have taken their references.  From
+    /// then on, only the references counted by the Context itself keep it
+    /// alive.
+    struct ContextSlot
+    {
+        /// \brief The current Context, or nullptr if not initialized.
+        std::atomic<Poco::Net::Context*> current { nullptr };
+
+        /// \brief The epoch whose readers count new getters.
+        std::atomic<uint64_t> epoch { 0 };
+
+        /// \brief The number of getters reading the pointer, by epoch parity.
+        std::atomic<uint64_t> readers[2] = { { 0 }, { 0 } };
+
+        /// \brief The Contexts published and not yet released, newest last.
+        std::vector<Poco::Net::Context::Ptr> contexts;
+    };
+
+    /// \brief Build a Server Context from the default files.
+    ///
+    /// The Context selects host Contexts from the server certificate store.
+    ///
+    /// \returns The new Server Context.
+    /// \throws Poco::Exception if the files cannot be loaded.
+    static Poco::Net::Context::Ptr _createServerContext();
+
+    /// \brief Build a Server Context with the default server settings.
+    /// \param privateKeyFile The private key file.
+    /// \param certificateFile The certificate file.
+    /// \returns The new Server Context.
+    /// \throws Poco::Exception if the files cannot be loaded.
+    static Poco::Net::Context::Ptr _createServerContext(const std::string& privateKeyFile,
+                                                        const std::string& certificateFile);
+
+    /// \brief Build a replica of a default Server Context.
+    ///
+    /// The replica shares the certificate, chain and private key of the
+    /// primary Context rather than loading them again.
+    ///
+    /// \param pPrimary The Context to replicate.
+    /// \returns The new Server Context.
+    /// \throws Poco::Exception if the replica cannot be built.
+    static Poco::Net::Context::Ptr _createServerContextReplica(Poco::Net::Context::Ptr pPrimary);
+
+    /// \brief Apply the default server settings to a Server Context.
+    /// \param pContext The Context to configure.
+    /// \param start The time the Context build started.
+    static void _configureServerContext(Poco::Net::Context::Ptr pContext,
+                                        std::chrono::steady_clock::time_point start);
+
+    /// \returns this thread's shard of the default Server Context.
+    static Poco::Net::Context::Ptr _getServerContextShard();
+
+    /// \brief Decide whether a server connection may accept early data.
+    /// \param ssl The server connection.
+    /// \param arg The anti-replay window.
+    /// \returns 1 to accept early data, or 0 to reject it.
+    static int _allowEarlyData(SSL* ssl, void* arg);
+
+    /// \brief Get the current Context of a slot without locking.
+    /// \param slot The slot to read.
+    /// \returns the current Context, or nullptr if not initialized.
+    static Poco::Net::Context::Ptr _load(ContextSlot& slot);
+
+    /// \brief Make a Context the current Context of a slot.
+    ///
+    /// Returns once no getter can still take a reference to the previous
+    /// Context.
+    ///
+    /// \param slot The slot to publish to.
+    /// \param pContext The new default Context.
+    /// \note The corresponding Context mutex must be held by the caller.
+    static void _publish(ContextSlot& slot, Poco::Net::Context::Ptr pContext);
+
+    /// \brief Publish a new default Server Context and release its shards.
+    /// \param pContext The new default Server Context.
+    /// \note The Server Context mutex must be held by the caller.
+    static void _publishServerContext(Poco::Net::Context::Ptr pContext);
+
+    /// \brief Start a new epoch and wait for the readers of the previous one.
+    /// \param slot The slot to wait for.
+    static void _waitForReaders(ContextSlot& slot);
+
+    /// \brief The build of a default Context.
+    ///
+    /// Contexts are built without holding the Context mutex, because
+    /// building them calls listeners, which may call ofSSLManager.
+    struct ContextBuild
+    {
+        /// \brief The thread building the Context, if any.
+        std::thread::id builder;
+
+        /// \brief Notifies threads waiting for the build to finish.
+        std::condition_variable finished;
+    };
+
+    /// \brief Claim the build of a default Context.
+    ///
+    /// Waits while another thread builds the Context.
+    ///
+    /// \param build The build to claim.
+    /// \param lock The lock of the corresponding Context mutex.
+    /// \param slot The slot the Context is published to.
+    /// \returns true iff the calling thread must build the Context, false if
+    ///          it is already built.
+    /// \throws Poco::IllegalStateException if the calling thread is already
+    ///         building the Context.
+    static bool _beginBuild(ContextBuild& build,
+                            std::unique_lock<std::mutex>& lock,
+                            const ContextSlot& slot);
+
+    /// \brief Release a build claimed with _beginBuild().
+    /// \param build The build to release.
+    /// \note The corresponding Context mutex must be held by the caller.
+    static void _endBuild(ContextBuild& build);
+
+    /// \brief Release replaced Contexts that are no longer referenced.
+    /// \param slot The slot whose Contexts are released.
+    /// \note The corresponding Context mutex must be held by the caller.
+    static void _releaseRetired(ContextSlot& slot);
+
+    /// \returns a string that changes when the default server files change.
+    static std::string _getServerFilesVersion();
+
+    /// \brief Answer client verification errors reported by the Poco SSLManager.
+    void _onClientVerificationError(const void* pSender, Poco::Net::VerificationErrorArgs& args);
+
+    /// \brief Answer server verification errors reported by the Poco SSLManager.
+    void _onServerVerificationError(const void* pSender, Poco::Net::VerificationErrorArgs& args);
+
+    /// \brief Answer a verification error from the cache or the listeners.
+    /// \param pSender The sender of the error.
+    /// \param args The verification error.
+    /// \param event The listeners to notify if no decision is cached.
+    /// \param server True if the error was reported by a Server Context.
+    void _onVerificationError(const void* pSender,
+                              Poco::Net::VerificationErrorArgs& args,
+                              Poco::BasicEvent<Poco::Net::VerificationErrorArgs>& event,
+                              bool server);
+
+    /// \brief An asynchronous verification handler and its settings.
+    struct AsyncVerification
+    {
+        AsyncVerificationHandler handler;
+        std::chrono::milliseconds timeout;
+        bool ignoreErrorOnTimeout;
+
+        /// \brief The listener that registered the handler, if any.
+        const void* listener;
+    };
+
+    /// \brief Set or remove an asynchronous verification handler.
+    /// \param current The handler to replace.
+    /// \param handler The handler, or nullptr to remove it.
+    /// \param timeout The maximum time a handshake waits for a decision.
+    /// \param ignoreErrorOnTimeout The decision used when the timeout passes.
+    /// \param listener The listener that registered the handler, if any.
+    static void _setVerificationHandler(std::shared_ptr<AsyncVerification>& current,
+                                        AsyncVerificationHandler handler,
+                                        std::chrono::milliseconds timeout,
+                                        bool ignoreErrorOnTimeout,
+                                        const void* listener = nullptr);
 
-    /// \brief True iff ofSSLManager initialized its own Server Context.
-    bool _serverContextInitialized = false;
+    /// \brief Remove an asynchronous verification handler set by a listener.
+    /// \param current The handler to remove.
+    /// \param listener The listener that registered the handler.
+    static void _unsetVerificationHandler(std::shared_ptr<AsyncVerification>& current,
+                                          const void* listener);
+
+    /// \brief Get a decision from an asynchronous verification handler.
+    /// \param key The verification cache key, or "" if it can't be cached.
+    /// \param args The verification error.
+    /// \param verification The handler and its settings.
+    /// \returns true to ignore the error.
+    bool _decideAsync(const std::string& key,
+                      const Poco::Net::VerificationErrorArgs& args,
+                      const AsyncVerification& verification);
+
+    /// \brief Cache pending decisions as they arrive until stopped.
+    ///
+    /// Futures can't notify when they become ready, so pending decisions are
+    /// polled every PENDING_VERIFICATION_POLL_INTERVAL.  The thread sleeps
+    /// while there are none.
+    void _cachePendingVerifications();
+
+    /// \brief Count passphrase requests reported by the Poco SSLManager.
+    void _onPrivateKeyPassphraseRequired(const void* pSender, std::string& passphrase);
+
+    /// \brief Check the server files periodically until stopped.
+    void _watchServerFiles();
+
+    /// \brief The default Client Context.
+    ///
+    /// Read without locking by getDefaultClientContext().
+    ContextSlot _clientContext;
+
+    /// \brief The default Server Context.
+    ///
+    /// Read without locking by getDefaultServerContext().
+    ContextSlot _serverContext;
+
+    /// \brief True iff the default Server Context was built by ofSSLManager.
+    bool _serverContextIsDefault = false;
+
+    /// \brief The version of the server files last loaded.
+    std::string _serverFilesVersion;
+
+    /// \brief The build of the default Client Context.
+    ContextBuild _clientContextBuild;
+
+    /// \brief The build of the default Server Context.
+    ContextBuild _serverContextBuild;
+
+    /// \brief The mutex serializing Client Context initialization.
+    std::mutex _clientContextMutex;
+
+    /// \brief The mutex serializing Server Context initialization.
+    std::mutex _serverContextMutex;
+
+    /// \brief True iff client session caching is enabled.
+    std::atomic<bool> _clientSessionCacheEnabled;
+
+    /// \brief The performance profile of the default Contexts.
+    std::atomic<PerformanceProfile> _performanceProfile;
+
+    /// \brief True iff default Contexts use kernel TLS offload.
+    std::atomic<bool> _kernelTLSEnabled;
+
+    /// \brief True iff default Contexts use the low memory mode.
+    std::atomic<bool> _lowMemoryModeEnabled;
+
+    /// \brief The maximum fragment length used in low memory mode.
+    std::atomic<std::size_t> _lowMemoryFragmentLength;
+
+    /// \brief True iff default Server Contexts accept early data.
+    std::atomic<bool> _earlyDataEnabled;
+
+    /// \brief The maximum amount of early data a server accepts.
+    std::atomic<uint32_t> _maxEarlyData;
+
+    /// \brief True iff default Server Contexts staple OCSP responses.
+    std::atomic<bool> _ocspStaplingEnabled;
+
+    /// \brief The number of replicas of the default Server Context.
+    std::atomic<std::size_t> _serverContextShardCount;
+
+    /// \brief Changes whenever the threads' shards must be refreshed.
+    std::atomic<uint64_t> _serverShardGeneration;
+
+    /// \brief The replicas of the default Server Context, if sharded.
+    ///
+    /// The first replica is the default Server Context itself.  Threads
+    /// only keep pointers to the replicas, which are released when the
+    /// generation changes.
+    std::vector<Poco::Net::Context::Ptr> _serverShards;
+
+    /// \brief The client session cache.
+    ofSSLSessionCache _clientSessionCache;
+
+    /// \brief The maximum number of cached server sessions.
+    std::size_t _serverSessionCacheSize = DEFAULT_SERVER_SESSION_CACHE_SIZE;
+
+    /// \brief The server session timeout.
+    std::chrono::seconds _serverSessionTimeout = DEFAULT_SERVER_SESSION_TIMEOUT;
+
+    /// \brief The server session ticket keys.
+    ofSSLSessionTicketKeys _serverSessionTicketKeys;
+
+    /// \brief The server certificates selected by SNI.
+    ofSSLCertificateStore _serverCertificateStore;
+
+    /// \brief The OCSP responses stapled by server Contexts.
+    ofSSLOCSPStapler _ocspStapler;
+
+    /// \brief The trust store shared by the default Contexts.
+    ofSSLTrustStore::Ptr _trustStore;
+
+    /// \brief The mutex protecting the trust store.
+    std::mutex _trustStoreMutex;
+
+    /// \brief The result of warmUp(), if it was called.
+    std::shared_future<void> _warmUp;
+
+    /// \brief True while warmUp() is building the default Contexts.
+    std::atomic<bool> _warmUpPending;
+
+    /// \brief The total time getters spent waiting for warmUp().
+    std::atomic<uint64_t> _warmUpWaitMicroseconds;
+
+    /// \brief The number of getter calls that waited for warmUp().
+    std::atomic<uint64_t> _warmUpWaitCount;
+
+    /// \brief The mutex protecting the warm up future.
+    std::mutex _warmUpMutex;
+
+    /// \brief The interval between checks for changed server files.
+    std::chrono::milliseconds _serverReloadInterval = std::chrono::milliseconds(0);
+
+    /// \brief True when the server file watcher should exit.
+    bool _serverReloadStopping = false;
+
+    /// \brief The server file watcher thread, started when first enabled.
+    std::thread _serverReloadThread;
+
+    /// \brief Notifies the server file watcher of changed settings.
+    std::condition_variable _serverReloadCondition;
+
+    /// \brief The mutex protecting the server file watcher settings.
+    std::mutex _serverReloadMutex;
+
+    std::atomic<uint64_t> _serverReloadCount;
+    std::atomic<uint64_t> _serverReloadFailureCount;
+    std::atomic<uint64_t> _lastServerReloadMicroseconds;
+
+    /// \brief The handshake and Context metrics.
+    ofSSLMetrics _metrics;
+
+    /// \brief The cache of verification decisions.
+    ofSSLVerificationCache _verificationCache;
+
+    /// \brief The cache of decrypted private keys.
+    ofSSLPrivateKeyCache _privateKeyCache;
+
+    /// \brief The pool of client connections.
+    ofSSLConnectionPool _clientConnectionPool;
+
+    /// \brief The window used to reject replayed early data.
+    ofSSLAntiReplayWindow _earlyDataReplayWindow;
+
+    /// \brief The verifier of certificate batches.
+    ofSSLCertificateVerifier _certificateVerifier;
+
+    /// \brief The listeners for client verification errors.
+    Poco::BasicEvent<Poco::Net::VerificationErrorArgs> _clientVerificationError;
+
+    /// \brief The listeners for server verification errors.
+    Poco::BasicEvent<Poco::Net::VerificationErrorArgs> _serverVerificationError;
+
+    /// \brief The asynchronous client verification handler, if any.
+    std::shared_ptr<AsyncVerification> _clientAsyncVerification;
+
+    /// \brief The asynchronous server verification handler, if any.
+    std::shared_ptr<AsyncVerification> _serverAsyncVerification;
+
+    /// \brief The decisions not yet cached, by verification cache key.
+    std::map<std::string, std::shared_future<bool>> _pendingVerifications;
+
+    /// \brief The mutex protecting the asynchronous handlers and decisions.
+    std::mutex _asyncVerificationMutex;
+
+    /// \brief True when the pending decision thread should exit.
+    bool _pendingVerificationsStopping = false;
+
+    /// \brief The thread caching pending decisions, started when first needed.
+    std::thread _pendingVerificationThread;
+
+    /// \brief Notifies the pending decision thread of new decisions.
+    std::condition_variable _pendingVerificationCondition;
+
+    /// \brief The interval between checks for pending decisions.
+    static const std::chrono::milliseconds PENDING_VERIFICATION_POLL_INTERVAL;
+
+    std::atomic<uint64_t> _asyncVerificationCount;
+    std::atomic<uint64_t> _asyncVerificationTimeoutCount;
 
 };
 
@@ -251,62 +1445,124 @@ private:
 template <class ListenerClass>
 void ofSSLManager::registerAllEvents(ListenerClass* listener)
 {
-    ofSSLManager::instance();
+    ofSSLManager& sslManager = ofSSLManager::instance();
     Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
-    manager.ServerVerificationError      += Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
-    manager.ClientVerificationError      += Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
+    sslManager._serverVerificationError  += Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
+    sslManager._clientVerificationError  += Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
     manager.PrivateKeyPassphraseRequired += Poco::delegate(listener, &ListenerClass::onSSLPrivateKeyPassphraseRequired);
+
+    // A new listener may decide differently.
+    sslManager._verificationCache.clear();
 }
 
 
 template <class ListenerClass>
 void ofSSLManager::unregisterAllEvents(ListenerClass* listener)
 {
-    ofSSLManager::instance();
+    ofSSLManager& sslManager = ofSSLManager::instance();
     Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
-    manager.ServerVerificationError      -= Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
-    manager.ClientVerificationError      -= Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
+    sslManager._serverVerificationError  -= Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
+    sslManager._clientVerificationError  -= Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
     manager.PrivateKeyPassphraseRequired -= Poco::delegate(listener, &ListenerClass::onSSLPrivateKeyPassphraseRequired);
+
+    // Decisions made by the listener must not outlive it.
+    sslManager._verificationCache.clear();
 }
 
 
 template <class ListenerClass>
 void ofSSLManager::registerClientEvents(ListenerClass* listener)
 {
-    ofSSLManager::instance();
+    ofSSLManager& sslManager = ofSSLManager::instance();
     Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
-    manager.ClientVerificationError      += Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
+    sslManager._clientVerificationError  += Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
     manager.PrivateKeyPassphraseRequired += Poco::delegate(listener, &ListenerClass::onSSLPrivateKeyPassphraseRequired);
+
+    sslManager._verificationCache.clear();
 }
 
 
 template <class ListenerClass>
 void ofSSLManager::unregisterClientEvents(ListenerClass* listener)
 {
-    ofSSLManager::instance();
+    ofSSLManager& sslManager = ofSSLManager::instance();
     Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
-    manager.ClientVerificationError      -= Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
+    sslManager._clientVerificationError  -= Poco::delegate(listener, &ListenerClass::onSSLClientVerificationError);
     manager.PrivateKeyPassphraseRequired -= Poco::delegate(listener, &ListenerClass::onSSLPrivateKeyPassphraseRequired);
+
+    sslManager._verificationCache.clear();
 }
 
 
 template <class ListenerClass>
 void ofSSLManager::registerServerEvents(ListenerClass* listener)
 {
-    ofSSLManager::instance();
+    ofSSLManager& sslManager = ofSSLManager::instance();
     Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
-    manager.ServerVerificationError      += Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
+    sslManager._serverVerificationError  += Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
     manager.PrivateKeyPassphraseRequired += Poco::delegate(listener, &ListenerClass::onSSLPrivateKeyPassphraseRequired);
+
+    sslManager._verificationCache.clear();
 }
 
 
 template <class ListenerClass>
 void ofSSLManager::unregisterServerEvents(ListenerClass* listener)
 {
-    ofSSLManager::instance();
+    ofSSLManager& sslManager = ofSSLManager::instance();
     Poco::Net::SSLManager& manager = Poco::Net::SSLManager::instance();
-    manager.ServerVerificationError      -= Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
+    sslManager._serverVerificationError  -= Poco::delegate(listener, &ListenerClass::onSSLServerVerificationError);
     manager.PrivateKeyPassphraseRequired -= Poco::delegate(listener, &ListenerClass::onSSLPrivateKeyPassphraseRequired);
+
+    sslManager._verificationCache.clear();
+}
+
+
+template <class ListenerClass>
+void ofSSLManager::registerAsyncClientEvents(ListenerClass* listener,
+                                             std::chrono::milliseconds timeout,
+                                             bool ignoreErrorOnTimeout)
+{
+    AsyncVerificationHandler handler = [listener](const Poco::Net::VerificationErrorArgs& args) {
+        return listener->onSSLClientVerificationErrorAsync(args);
+    };
+
+    _setVerificationHandler(instance()._clientAsyncVerification,
+                            handler,
+                            timeout,
+                            ignoreErrorOnTimeout,
+                            listener);
+}
+
+
+template <class ListenerClass>
+void ofSSLManager::unregisterAsyncClientEvents(ListenerClass* listener)
+{
+    _unsetVerificationHandler(instance()._clientAsyncVerification, listener);
+}
+
+
+template <class ListenerClass>
+void ofSSLManager::registerAsyncServerEvents(ListenerClass* listener,
+                                             std::chrono::milliseconds timeout,
+                                             bool ignoreErrorOnTimeout)
+{
+    AsyncVerificationHandler handler = [listener](const Poco::Net::VerificationErrorArgs& args) {
+        return listener->onSSLServerVerificationErrorAsync(args);
+    };
+
+    _setVerificationHandler(instance()._serverAsyncVerification,
+                            handler,
+                            timeout,
+                            ignoreErrorOnTimeout,
+                            listener);
+}
+
+
+template <class ListenerClass>
+void ofSSLManager::unregisterAsyncServerEvents(ListenerClass* listener)
+{
+    _unsetVerificationHandler(instance()._serverAsyncVerification, listener);
 }
 
 
@@ -0,0 +1,412 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLMetrics.h"
+#include <cmath>
+#include "ofSSLKernelTLS.h"
+
+
+ofSSLLatencyHistogram::ofSSLLatencyHistogram():
+    _count(0),
+    _totalMicroseconds(0)
+{
+    for (auto& bucket: _buckets)
+        bucket = 0;
+}
+
+
+void ofSSLLatencyHistogram::record(std::chrono::microseconds latency)
+{
+    uint64_t microseconds = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+
+    // The bucket is the number of significant bits.
+    std::size_t bucket = 0;
+
+    while (bucket < BUCKET_COUNT - 1 && (microseconds >> bucket) != 0)
+        ++bucket;
+
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _totalMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+}
+
+
+ofSSLLatencyHistogram::Snapshot ofSSLLatencyHistogram::snapshot() const
+{
+    Snapshot snapshot;
+
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+        snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+
+    snapshot.count = _count.load(std::memory_order_relaxed);
+    snapshot.totalMicroseconds = _totalMicroseconds.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+
+void ofSSLLatencyHistogram::reset()
+{
+    for (auto& bucket: _buckets)
+        bucket = 0;
+
+    _count = 0;
+    _totalMicroseconds = 0;
+}
+
+
+std::chrono::microseconds ofSSLLatencyHistogram::Snapshot::mean() const
+{
+    if (count == 0)
+        return std::chrono::microseconds(0);
+
+    return std::chrono::microseconds(totalMicroseconds / count);
+}
+
+
+std::chrono::microseconds ofSSLLatencyHistogram::Snapshot::percentile(double p) const
+{
+    uint64_t total = 0;
+
+    for (auto bucket: buckets)
+        total += bucket;
+
+    if (total == 0)
+        return std::chrono::microseconds(0);
+
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * total)));
+    uint64_t cumulative = 0;
+
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        cumulative += buckets[i];
+
+        if (cumulative >= target)
+            return std::chrono::microseconds(uint64_t(1) << i);
+    }
+
+    return std::chrono::microseconds(uint64_t(1) << (BUCKET_COUNT - 1));
+}
+
+
+ofSSLMetrics::ofSSLMetrics():
+    _fullHandshakes(0),
+    _resumedHandshakes(0),
+    _failedHandshakes(0),
+    _kernelTLSSendConnections(0),
+    _kernelTLSReceiveConnections(0),
+    _openConnections(0),
+    _earlyDataAccepted(0),
+    _earlyDataRejected(0),
+    _earlyDataBytesReceived(0),
+    _passphraseRequests(0),
+    _contextBuilds(0),
+    _tracing(false)
+{
+}
+
+
+void ofSSLMetrics::attach(Poco::Net::Context::Ptr pContext)
+{
+    SSL_CTX* pSSLContext = pContext->sslContext();
+    SSL_CTX_set_ex_data(pSSLContext, _contextIndex(), this);
+    SSL_CTX_set_info_callback(pSSLContext, &ofSSLMetrics::_infoCallback);
+}
+
+
+void ofSSLMetrics::recordContextBuild(std::chrono::microseconds latency)
+{
+    _contextBuilds.fetch_add(1, std::memory_order_relaxed);
+    _contextBuildLatency.record(latency);
+}
+
+
+void ofSSLMetrics::recordVerificationFailure(int errorNumber, int depth)
+{
+    std::unique_lock<std::mutex> lock(_verificationFailuresMutex);
+    ++_verificationFailures[std::make_pair(errorNumber, depth)];
+}
+
+
+void ofSSLMetrics::recordPassphraseRequest()
+{
+    _passphraseRequests.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void ofSSLMetrics::recordEarlyData(std::size_t bytes)
+{
+    _earlyDataBytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+
+void ofSSLMetrics::setTraceHandler(TraceHandler handler)
+{
+    std::unique_lock<std::mutex> lock(_traceHandlerMutex);
+
+    if (handler)
+        _traceHandler = std::make_shared<TraceHandler>(handler);
+    else
+        _traceHandler = nullptr;
+
+    _tracing = _traceHandler != nullptr;
+}
+
+
+bool ofSSLMetrics::isTracing() const
+{
+    return _tracing;
+}
+
+
+ofSSLMetricsSnapshot ofSSLMetrics::snapshot() const
+{
+    ofSSLMetricsSnapshot snapshot;
+
+    snapshot.fullHandshakes = _fullHandshakes;
+    snapshot.resumedHandshakes = _resumedHandshakes;
+    snapshot.failedHandshakes = _failedHandshakes;
+    snapshot.fullHandshakeLatency = _fullHandshakeLatency.snapshot();
+    snapshot.resumedHandshakeLatency = _resumedHandshakeLatency.snapshot();
+
+    {
+        std::unique_lock<std::mutex> lock(_verificationFailuresMutex);
+        snapshot.verificationFailures = _verificationFailures;
+    }
+
+    snapshot.kernelTLSSendConnections = _kernelTLSSendConnections;
+    snapshot.kernelTLSReceiveConnections = _kernelTLSReceiveConnections;
+    snapshot.openConnections = _openConnections;
+    snapshot.earlyDataAccepted = _earlyDataAccepted;
+    snapshot.earlyDataRejected = _earlyDataRejected;
+    snapshot.earlyDataBytesReceived = _earlyDataBytesReceived;
+    snapshot.passphraseRequests = _passphraseRequests;
+    snapshot.contextBuilds = _contextBuilds;
+    snapshot.contextBuildLatency = _contextBuildLatency.snapshot();
+
+    return snapshot;
+}
+
+
+void ofSSLMetrics::reset()
+{
+    _fullHandshakes = 0;
+    _resumedHandshakes = 0;
+    _failedHandshakes = 0;
+    _fullHandshakeLatency.reset();
+    _resumedHandshakeLatency.reset();
+
+    {
+        std::unique_lock<std::mutex> lock(_verificationFailuresMutex);
+        _verificationFailures.clear();
+    }
+
+    _kernelTLSSendConnections = 0;
+    _kernelTLSReceiveConnections = 0;
+    _earlyDataAccepted = 0;
+    _earlyDataRejected = 0;
+    _earlyDataBytesReceived = 0;
+    _passphraseRequests = 0;
+    _contextBuilds = 0;
+    _contextBuildLatency.reset();
+}
+
+
+const SSL* ofSSLMetrics::findConnection(int fd) const
+{
+    std::unique_lock<std::mutex> lock(_connectionsMutex);
+
+    auto iter = _connections.find(fd);
+
+    if (iter == _connections.end())
+        return nullptr;
+
+    return iter->second;
+}
+
+
+void ofSSLMetrics::_finish(const SSL* ssl, HandshakeState& state, bool failed, int alert)
+{
+    state.finished = true;
+
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - state.start);
+
+    SSL* pSSL = const_cast<SSL*>(ssl);
+    bool resumed = !failed && SSL_session_reused(pSSL);
+
+    if (failed)
+    {
+        _failedHandshakes.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (resumed)
+    {
+        _resumedHandshakes.fetch_add(1, std::memory_order_relaxed);
+        _resumedHandshakeLatency.record(latency);
+    }
+    else
+    {
+        _fullHandshakes.fetch_add(1, std::memory_order_relaxed);
+        _fullHandshakeLatency.record(latency);
+    }
+
+    bool kernelTLSSend = !failed && ofSSLKernelTLS::isSendOffloaded(ssl);
+    bool kernelTLSReceive = !failed && ofSSLKernelTLS::isReceiveOffloaded(ssl);
+
+    if (kernelTLSSend)
+        _kernelTLSSendConnections.fetch_add(1, std::memory_order_relaxed);
+
+    if (kernelTLSReceive)
+        _kernelTLSReceiveConnections.fetch_add(1, std::memory_order_relaxed);
+
+    bool earlyDataAccepted = false;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (!failed)
+    {
+        int earlyDataStatus = SSL_get_early_data_status(ssl);
+
+        earlyDataAccepted = earlyDataStatus == SSL_EARLY_DATA_ACCEPTED;
+
+        if (earlyDataAccepted)
+            _earlyDataAccepted.fetch_add(1, std::memory_order_relaxed);
+        else if (earlyDataStatus == SSL_EARLY_DATA_REJECTED)
+            _earlyDataRejected.fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+
+    if (!_tracing.load(std::memory_order_relaxed))
+        return;
+
+    std::shared_ptr<TraceHandler> handler;
+
+    {
+        std::unique_lock<std::mutex> lock(_traceHandlerMutex);
+        handler = _traceHandler;
+    }
+
+    if (handler == nullptr)
+        return;
+
+    ofSSLHandshakeTrace trace;
+    trace.server = SSL_is_server(pSSL) == 1;
+    trace.resumed = resumed;
+    trace.failed = failed;
+    trace.latency = latency;
+    trace.kernelTLSSend = kernelTLSSend;
+    trace.kernelTLSReceive = kernelTLSReceive;
+    trace.earlyDataAccepted = earlyDataAccepted;
+    trace.protocol = SSL_get_version(ssl);
+
+    if (failed)
+        trace.alert = SSL_alert_desc_string_long(alert);
+
+    const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+
+    if (cipher != nullptr)
+        trace.cipher = SSL_CIPHER_get_name(cipher);
+
+    const char* serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+    if (serverName != nullptr)
+        trace.serverName = serverName;
+
+    (*handler)(trace);
+}
+
+
+int ofSSLMetrics::_contextIndex()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+
+int ofSSLMetrics::_stateIndex()
+{
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &ofSSLMetrics::_freeState);
+    return index;
+}
+
+
+void ofSSLMetrics::_freeState(void* parent, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+{
+    HandshakeState* state = static_cast<HandshakeState*>(ptr);
+
+    if (state == nullptr)
+        return;
+
+    state->metrics->_openConnections.fetch_sub(1, std::memory_order_relaxed);
+
+    if (state->fd >= 0)
+    {
+        std::unique_lock<std::mutex> lock(state->metrics->_connectionsMutex);
+
+        // The socket may already be used by a new connection.
+        auto iter = state->metrics->_connections.find(state->fd);
+
+        if (iter != state->metrics->_connections.end() && iter->second == parent)
+            state->metrics->_connections.erase(iter);
+    }
+
+    delete state;
+}
+
+
+void ofSSLMetrics::_infoCallback(const SSL* ssl, int where, int ret)
+{
+    if ((where & (SSL_CB_HANDSHAKE_START | SSL_CB_HANDSHAKE_DONE | SSL_CB_ALERT)) == 0)
+        return;
+
+    ofSSLMetrics* metrics = static_cast<ofSSLMetrics*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), _contextIndex()));
+
+    if (metrics == nullptr)
+        return;
+
+    HandshakeState* state = static_cast<HandshakeState*>(SSL_get_ex_data(ssl, _stateIndex()));
+
+    if (where & SSL_CB_HANDSHAKE_START)
+    {
+        // Only the first handshake of a connection is measured.  TLS 1.3
+        // post-handshake messages (e.g. session tickets) also start and end
+        // a "handshake".
+        if (state == nullptr)
+        {
+            state = new HandshakeState();
+            state->metrics = metrics;
+            state->start = std::chrono::steady_clock::now();
+            SSL_set_ex_data(const_cast<SSL*>(ssl), _stateIndex(), state);
+            metrics->_openConnections.fetch_add(1, std::memory_order_relaxed);
+
+            state->fd = SSL_get_fd(ssl);
+
+            if (state->fd >= 0)
+            {
+                std::unique_lock<std::mutex> lock(metrics->_connectionsMutex);
+                metrics->_connections[state->fd] = ssl;
+            }
+        }
+
+        return;
+    }
+
+    if (state == nullptr || state->finished)
+        return;
+
+    if (where & SSL_CB_HANDSHAKE_DONE)
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        // With early data, the handshake is also reported done while early
+        // data can be sent or received, before it is complete.
+        if (SSL_get_state(ssl) == TLS_ST_EARLY_DATA)
+            return;
+#endif
+
+        metrics->_finish(ssl, *state, false, 0);
+    }
+    else if ((ret >> 8) == SSL3_AL_FATAL)
+        metrics->_finish(ssl, *state, true, ret & 0xff);
+}
@@ -0,0 +1,380 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <openssl/ssl.h>
+#include "Poco/Net/Context.h"
+
+
+/// \brief A lock-free latency histogram with power of two buckets.
+///
+/// Bucket i counts latencies of less than 2^i microseconds (and at least
+/// 2^(i - 1) microseconds).  The last bucket counts everything longer.
+class ofSSLLatencyHistogram
+{
+public:
+    enum
+    {
+        /// \brief The number of buckets, covering up to about 35 minutes.
+        BUCKET_COUNT = 32
+    };
+
+    /// \brief A copy of a histogram at a point in time.
+    struct Snapshot
+    {
+        /// \brief The number of latencies recorded.
+        uint64_t count = 0;
+
+        /// \brief The sum of the latencies recorded in microseconds.
+        uint64_t totalMicroseconds = 0;
+
+        /// \brief The number of latencies in each bucket.
+        std::array<uint64_t, BUCKET_COUNT> buckets = {};
+
+        /// \returns the mean latency.
+        std::chrono::microseconds mean() const;
+
+        /// \brief Estimate a percentile.
+        /// \param p The percentile, from 0 to 1.
+        /// \returns the upper bound of the bucket containing the percentile.
+        std::chrono::microseconds percentile(double p) const;
+    };
+
+    /// \brief Create an empty histogram.
+    ofSSLLatencyHistogram();
+
+    /// \brief Record a latency.
+    /// \param latency The latency to record.
+    void record(std::chrono::microseconds latency);
+
+    /// \returns a copy of the histogram.
+    Snapshot snapshot() const;
+
+    /// \brief Remove all recorded latencies.
+    void reset();
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _totalMicroseconds;
+
+};
+
+
+/// \brief A description of one handshake, passed to trace handlers.
+struct ofSSLHandshakeTrace
+{
+    /// \brief True for the server side of the connection.
+    bool server = false;
+
+    /// \brief True if the session was resumed.
+    bool resumed = false;
+
+    /// \brief True if the handshake failed with a fatal alert.
+    bool failed = false;
+
+    /// \brief The alert description if the handshake failed.
+    std::string alert;
+
+    /// \brief The time from the start to the end of the handshake.
+    std::chrono::microseconds latency = std::chrono::microseconds(0);
+
+    /// \brief The negotiated protocol version, e.g. "TLSv1.3".
+    std::string protocol;
+
+    /// \brief The negotiated cipher suite.
+    std::string cipher;
+
+    /// \brief The host name requested by the client (SNI), if any.
+    std::string serverName;
+
+    /// \brief True if the kernel encrypts data sent on the connection.
+    bool kernelTLSSend = false;
+
+    /// \brief True if the kernel decrypts data received on the connection.
+    bool kernelTLSReceive = false;
+
+    /// \brief True if early (0-RTT) data was sent and accepted.
+    bool earlyDataAccepted = false;
+};
+
+
+/// \brief A copy of the TLS metrics at a point in time.
+///
+/// Returned by ofSSLManager::getMetricsSnapshot(), which also copies the
+/// counters kept by the session cache, session ticket keys, verification
+/// cache, private key cache, certificate store, OCSP stapler, server
+/// reloading and the pooled allocator.
+struct ofSSLMetricsSnapshot
+{
+    /// \brief The number of completed handshakes that were not resumed.
+    uint64_t fullHandshakes = 0;
+
+    /// \brief The number of completed handshakes that resumed a session.
+    uint64_t resumedHandshakes = 0;
+
+    /// \brief The number of handshakes that ended with a fatal alert.
+    uint64_t failedHandshakes = 0;
+
+    /// \brief The latency of full handshakes.
+    ofSSLLatencyHistogram::Snapshot fullHandshakeLatency;
+
+    /// \brief The latency of resumed handshakes.
+    ofSSLLatencyHistogram::Snapshot resumedHandshakeLatency;
+
+    /// \brief The number of verification failures by error number and depth.
+    std::map<std::pair<int, int>, uint64_t> verificationFailures;
+
+    /// \brief The number of private key passphrase requests.
+    uint64_t passphraseRequests = 0;
+
+    /// \brief The number of Contexts built by ofSSLManager.
+    uint64_t contextBuilds = 0;
+
+    /// \brief The time taken to build Contexts.
+    ofSSLLatencyHistogram::Snapshot contextBuildLatency;
+
+    /// \brief The number of connections sending with kernel TLS.
+    uint64_t kernelTLSSendConnections = 0;
+
+    /// \brief The number of connections receiving with kernel TLS.
+    uint64_t kernelTLSReceiveConnections = 0;
+
+    /// \brief The number of connections that have started a handshake and
+    ///        have not been freed.
+    uint64_t openConnections = 0;
+
+    /// \brief The number of handshakes that accepted early (0-RTT) data.
+    uint64_t earlyDataAccepted = 0;
+
+    /// \brief The number of handshakes that rejected early data, which was
+    ///        then sent again after the handshake.
+    uint64_t earlyDataRejected = 0;
+
+    /// \brief The number of early data bytes received by servers.
+    uint64_t earlyDataBytesReceived = 0;
+
+    /// \brief The number of early data attempts rejected as replays.
+    uint64_t earlyDataReplays = 0;
+
+    /// \brief An upper bound of the OpenSSL memory per open connection, if
+    ///        ofSSLAllocator is installed.
+    ///
+    /// This is all memory in ofSSLAllocator::CATEGORY_SSL divided by the
+    /// number of open connections.  It includes memory shared by all
+    /// connections, like SSL_CTXs and session caches, so it overstates the
+    /// memory of each connection, especially when few are open.  See
+    /// ofSSLManager::estimateConnectionBufferSize() for a single connection.
+    uint64_t connectionBytesUpperBound = 0;
+
+    uint64_t clientSessionCacheHits = 0;
+    uint64_t clientSessionCacheMisses = 0;
+    uint64_t clientSessionCacheEvictions = 0;
+    uint64_t clientSessionCacheExpirations = 0;
+
+    uint64_t ticketsIssued = 0;
+    uint64_t ticketsAccepted = 0;
+    uint64_t ticketsRenewed = 0;
+    uint64_t ticketsRejected = 0;
+    uint64_t ticketKeyRotations = 0;
+
+    uint64_t verificationCacheHits = 0;
+    uint64_t verificationCacheMisses = 0;
+
+    uint64_t privateKeyCacheHits = 0;
+    uint64_t privateKeyCacheMisses = 0;
+
+    uint64_t connectionPoolHits = 0;
+    uint64_t connectionPoolMisses = 0;
+    uint64_t connectionPoolHealthCheckFailures = 0;
+    uint64_t connectionPoolExpirations = 0;
+
+    /// \brief The results of ofSSLManager::verifyCertificates().
+    uint64_t certificatesVerified = 0;
+    uint64_t certificatesFailed = 0;
+    uint64_t certificatesUnreadable = 0;
+
+    /// \brief The handshakes that asked for an OCSP response, and the
+    ///        fetched responses (see ofSSLManager::getOCSPStapler()).
+    uint64_t ocspStapled = 0;
+    uint64_t ocspNotStapled = 0;
+    uint64_t ocspFetches = 0;
+    uint64_t ocspFetchFailures = 0;
+
+    /// \brief The certificates with and without an unexpired OCSP response.
+    std::size_t ocspFreshResponses = 0;
+    std::size_t ocspStaleResponses = 0;
+
+    /// \brief The memory used by OpenSSL, if ofSSLAllocator is installed.
+    uint64_t allocatorBytesInUse = 0;
+    uint64_t allocatorPeakBytesInUse = 0;
+    uint64_t allocatorPooledBytes = 0;
+
+    uint64_t certificateStoreHits = 0;
+    uint64_t certificateStoreMisses = 0;
+    uint64_t certificateStoreEvictions = 0;
+    uint64_t certificateStoreLoadFailures = 0;
+
+    uint64_t serverReloads = 0;
+    uint64_t serverReloadFailures = 0;
+    std::chrono::microseconds lastServerReloadTime = std::chrono::microseconds(0);
+    std::size_t serverContextsInUse = 0;
+
+    uint64_t warmUpWaitCount = 0;
+    std::chrono::microseconds warmUpWaitTime = std::chrono::microseconds(0);
+};
+
+
+/// \brief Counters and latency histograms for handshakes and Contexts.
+///
+/// Handshakes are observed with an OpenSSL info callback installed on each
+/// Context ofSSLManager creates.  Counting costs a few relaxed atomic
+/// increments per handshake.  A trace handler can be set to receive a
+/// description of every handshake.  When no trace handler is set, tracing
+/// costs a single atomic load per handshake.
+///
+/// All methods are thread-safe.
+class ofSSLMetrics
+{
+public:
+    /// \brief A function that receives a description of each handshake.
+    typedef std::function<void(const ofSSLHandshakeTrace&)> TraceHandler;
+
+    /// \brief Create empty metrics.
+    ofSSLMetrics();
+
+    /// \brief Observe the handshakes of a Context.
+    /// \param pContext The Context to observe.
+    /// \note This replaces any info callback set on the Context, and these
+    ///       metrics must outlive the Context.
+    void attach(Poco::Net::Context::Ptr pContext);
+
+    /// \brief Record the time taken to build a Context.
+    /// \param latency The build time.
+    void recordContextBuild(std::chrono::microseconds latency);
+
+    /// \brief Record a certificate verification failure.
+    /// \param errorNumber The OpenSSL X509_V_ERR_* error number.
+    /// \param depth The depth of the certificate in the chain.
+    void recordVerificationFailure(int errorNumber, int depth);
+
+    /// \brief Record a private key passphrase request.
+    void recordPassphraseRequest();
+
+    /// \brief Record early data received by a server.
+    /// \param bytes The number of bytes received.
+    void recordEarlyData(std::size_t bytes);
+
+    /// \brief Set a function to call after every handshake.
+    ///
+    /// The handler is called on the thread performing the handshake and
+    /// should return quickly.
+    ///
+    /// \param handler The trace handler, or nullptr to disable tracing.
+    void setTraceHandler(TraceHandler handler);
+
+    /// \returns true iff a trace handler is set.
+    bool isTracing() const;
+
+    /// \returns a copy of the handshake, verification, passphrase and
+    ///          Context build metrics.
+    ofSSLMetricsSnapshot snapshot() const;
+
+    /// \brief Find the open connection using a socket.
+    ///
+    /// Connections of attached Contexts are found from the start of their
+    /// handshake until they are freed.
+    ///
+    /// \param fd The socket of the connection.
+    /// \returns the connection, or nullptr if it is not found.  It is only
+    ///          valid while the connection is open.
+    const SSL* findConnection(int fd) const;
+
+    /// \brief Reset all metrics.
+    void reset();
+
+private:
+    /// \brief The handshake state kept for each SSL connection.
+    struct HandshakeState
+    {
+        ofSSLMetrics* metrics = nullptr;
+        std::chrono::steady_clock::time_point start;
+        bool finished = false;
+
+        /// \brief The socket of the connection, or -1.
+        int fd = -1;
+    };
+
+    /// \brief Record the end of a handshake.
+    void _finish(const SSL* ssl, HandshakeState& state, bool failed, int alert);
+
+    /// \brief Get the SSL_CTX ex_data index used to find the metrics.
+    static int _contextIndex();
+
+    /// \brief Get the SSL ex_data index used to keep the handshake state.
+    static int _stateIndex();
+
+    static void _freeState(void* parent,
+                           void* ptr,
+                           CRYPTO_EX_DATA* ad,
+                           int index,
+                           long argl,
+                           void* argp);
+
+    static void _infoCallback(const SSL* ssl, int where, int ret);
+
+    std::atomic<uint64_t> _fullHandshakes;
+    std::atomic<uint64_t> _resumedHandshakes;
+    std::atomic<uint64_t> _failedHandshakes;
+    ofSSLLatencyHistogram _fullHandshakeLatency;
+    ofSSLLatencyHistogram _resumedHandshakeLatency;
+
+    std::map<std::pair<int, int>, uint64_t> _verificationFailures;
+
+    /// \brief The mutex protecting the verification failures.
+    mutable std::mutex _verificationFailuresMutex;
+
+    std::atomic<uint64_t> _kernelTLSSendConnections;
+    std::atomic<uint64_t> _kernelTLSReceiveConnections;
+
+    std::atomic<uint64_t> _openConnections;
+
+    /// \brief The open connections by socket.
+    std::map<int, const SSL*> _connections;
+
+    /// \brief The mutex protecting the open connections.
+    mutable std::mutex _connectionsMutex;
+
+    std::atomic<uint64_t> _earlyDataAccepted;
+    std::atomic<uint64_t> _earlyDataRejected;
+    std::atomic<uint64_t> _earlyDataBytesReceived;
+
+    std::atomic<uint64_t> _passphraseRequests;
+    std::atomic<uint64_t> _contextBuilds;
+    ofSSLLatencyHistogram _contextBuildLatency;
+
+    /// \brief True iff a trace handler is set.
+    std::atomic<bool> _tracing;
+
+    std::shared_ptr<TraceHandler> _traceHandler;
+
+    /// \brief The mutex protecting the trace handler.
+    mutable std::mutex _traceHandlerMutex;
+
+};
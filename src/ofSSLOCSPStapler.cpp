@@ -0,0 +1,762 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLOCSPStapler.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ocsp.h>
+#include "Poco/Exception.h"
+#include "Poco/StreamCopier.h"
+#include "Poco/Timespan.h"
+#include "Poco/URI.h"
+#include "Poco/Net/HTTPClientSession.h"
+#include "Poco/Net/HTTPRequest.h"
+#include "Poco/Net/HTTPResponse.h"
+#include "ofLog.h"
+
+
+const std::chrono::seconds ofSSLOCSPStapler::DEFAULT_RETRY_INTERVAL = std::chrono::seconds(60);
+const std::chrono::seconds ofSSLOCSPStapler::DEFAULT_MAXIMUM_AGE = std::chrono::hours(1);
+const std::chrono::seconds ofSSLOCSPStapler::DEFAULT_TIMEOUT = std::chrono::seconds(10);
+
+
+namespace
+{
+
+
+/// \brief The clock difference allowed between the server and the responder.
+const long MAXIMUM_CLOCK_SKEW = 300;
+
+
+/// \brief Convert an OpenSSL time to the system clock.
+std::chrono::system_clock::time_point toTimePoint(const ASN1_TIME* pTime)
+{
+    // The difference from now avoids converting the calendar time.
+    int days = 0;
+    int seconds = 0;
+
+    ASN1_TIME_diff(&days, &seconds, nullptr, pTime);
+
+    return std::chrono::time_point_cast<std::chrono::system_clock::duration>(std::chrono::system_clock::now()
+         + std::chrono::hours(24) * days
+         + std::chrono::seconds(seconds));
+}
+
+
+/// \returns the hex SHA-256 fingerprint of a certificate.
+std::string fingerprint(const X509* pCertificate)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+
+    if (X509_digest(pCertificate, EVP_sha256(), digest, &length) != 1)
+        return "";
+
+    static const char* hex = "0123456789abcdef";
+
+    std::string key;
+
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        key += hex[digest[i] >> 4];
+        key += hex[digest[i] & 0x0f];
+    }
+
+    return key;
+}
+
+
+/// \returns the issuer of the certificate of a Context, with a reference
+///          the caller must free, or nullptr.
+X509* findIssuer(SSL_CTX* pSSLContext, X509* pCertificate)
+{
+    STACK_OF(X509)* pChain = nullptr;
+    SSL_CTX_get0_chain_certs(pSSLContext, &pChain);
+
+    for (int i = 0; pChain != nullptr && i < sk_X509_num(pChain); ++i)
+    {
+        X509* pCandidate = sk_X509_value(pChain, i);
+
+        if (X509_check_issued(pCandidate, pCertificate) == X509_V_OK)
+        {
+            X509_up_ref(pCandidate);
+            return pCandidate;
+        }
+    }
+
+    // The certificate file may contain only the certificate.
+    X509* pIssuer = nullptr;
+    X509_STORE_CTX* pStoreContext = X509_STORE_CTX_new();
+
+    if (pStoreContext != nullptr
+     && X509_STORE_CTX_init(pStoreContext, SSL_CTX_get_cert_store(pSSLContext), pCertificate, nullptr) == 1)
+    {
+        if (X509_STORE_CTX_get1_issuer(&pIssuer, pStoreContext, pCertificate) != 1)
+            pIssuer = nullptr;
+    }
+
+    X509_STORE_CTX_free(pStoreContext);
+    ERR_clear_error();
+
+    return pIssuer;
+}
+
+
+}
+
+
+ofSSLOCSPStapler::Entry::Entry(X509* pCertificate_, X509* pIssuer_):
+    pCertificate(pCertificate_),
+    pIssuer(pIssuer_)
+{
+    X509_up_ref(pCertificate);
+    X509_up_ref(pIssuer);
+}
+
+
+ofSSLOCSPStapler::Entry::~Entry()
+{
+    X509_free(pCertificate);
+    X509_free(pIssuer);
+}
+
+
+ofSSLOCSPStapler::ofSSLOCSPStapler():
+    _stapled(0),
+    _notStapled(0),
+    _fetches(0),
+    _fetchFailures(0)
+{
+}
+
+
+ofSSLOCSPStapler::~ofSSLOCSPStapler()
+{
+    _stop();
+}
+
+
+bool ofSSLOCSPStapler::attach(Poco::Net::Context::Ptr pContext)
+{
+    if (pContext.isNull() || !pContext->isForServerUse())
+    {
+        ofLogWarning("ofSSLOCSPStapler::attach") << "OCSP responses can only be stapled by a server Context.";
+        return false;
+    }
+
+    SSL_CTX* pSSLContext = pContext->sslContext();
+    X509* pCertificate = SSL_CTX_get0_certificate(pSSLContext);
+
+    if (pCertificate == nullptr || X509_check_issued(pCertificate, pCertificate) == X509_V_OK)
+    {
+        ofLogVerbose("ofSSLOCSPStapler::attach") << "The certificate is missing or self-signed.";
+        return false;
+    }
+
+    std::string responderURL;
+    STACK_OF(OPENSSL_STRING)* pURLs = X509_get1_ocsp(pCertificate);
+
+    if (pURLs != nullptr && sk_OPENSSL_STRING_num(pURLs) > 0)
+        responderURL = sk_OPENSSL_STRING_value(pURLs, 0);
+
+    X509_email_free(pURLs);
+
+    if (responderURL.empty() && getResponderURL().empty())
+    {
+        ofLogVerbose("ofSSLOCSPStapler::attach") << "The certificate names no OCSP responder.";
+        return false;
+    }
+
+    X509* pIssuer = findIssuer(pSSLContext, pCertificate);
+
+    if (pIssuer == nullptr)
+    {
+        ofLogWarning("ofSSLOCSPStapler::attach") << "Unable to find the issuer of the certificate.";
+        return false;
+    }
+
+    std::string key = fingerprint(pCertificate);
+
+    std::shared_ptr<Entry> entry;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto iter = _entries.find(key);
+
+        if (iter != _entries.end())
+            entry = iter->second.lock();
+    }
+
+    if (!entry)
+    {
+        entry = std::make_shared<Entry>(pCertificate, pIssuer);
+        entry->fingerprint = key;
+        entry->responderURL = responderURL;
+        entry->refreshAt = Clock::now();
+
+        // A saved response is stapled until it is refreshed.
+        std::string path = _cacheFile(*entry);
+
+        if (!path.empty() && std::filesystem::exists(path))
+        {
+            std::ifstream file(path, std::ios::binary);
+            std::stringstream data;
+            data << file.rdbuf();
+
+            std::shared_ptr<const Response> response = _verify(*entry, data.str());
+
+            if (response)
+            {
+                std::atomic_store(&entry->response, response);
+                entry->refreshAt = _refreshTime(*response);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto iter = _entries.find(key);
+        std::shared_ptr<Entry> existing = iter != _entries.end() ? iter->second.lock() : nullptr;
+
+        // Another Context with the certificate may have been attached.
+        if (existing)
+            entry = existing;
+        else
+            _entries[key] = entry;
+    }
+
+    X509_free(pIssuer);
+
+    delete static_cast<std::shared_ptr<Entry>*>(SSL_CTX_get_ex_data(pSSLContext, _contextIndex()));
+    SSL_CTX_set_ex_data(pSSLContext, _contextIndex(), new std::shared_ptr<Entry>(entry));
+    SSL_CTX_set_tlsext_status_cb(pSSLContext, &ofSSLOCSPStapler::_statusCallback);
+    SSL_CTX_set_tlsext_status_arg(pSSLContext, this);
+
+    _start();
+    _condition.notify_all();
+
+    return true;
+}
+
+
+void ofSSLOCSPStapler::refresh()
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _refreshAll = true;
+    }
+
+    _condition.notify_all();
+}
+
+
+void ofSSLOCSPStapler::clear()
+{
+    _stop();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (auto& entry: _entries)
+    {
+        std::shared_ptr<Entry> pEntry = entry.second.lock();
+
+        if (pEntry)
+            std::atomic_store(&pEntry->response, std::shared_ptr<const Response>());
+    }
+
+    _entries.clear();
+}
+
+
+std::size_t ofSSLOCSPStapler::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    return std::count_if(_entries.begin(), _entries.end(), [](const std::pair<const std::string, std::weak_ptr<Entry>>& entry) {
+        return !entry.second.expired();
+    });
+}
+
+
+void ofSSLOCSPStapler::setResponderURL(const std::string& url)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _responderURL = url;
+}
+
+
+std::string ofSSLOCSPStapler::getResponderURL() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _responderURL;
+}
+
+
+void ofSSLOCSPStapler::setCacheDirectory(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cacheDirectory = path;
+}
+
+
+std::string ofSSLOCSPStapler::getCacheDirectory() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _cacheDirectory;
+}
+
+
+void ofSSLOCSPStapler::setRetryInterval(std::chrono::seconds interval)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _retryInterval = interval;
+}
+
+
+std::chrono::seconds ofSSLOCSPStapler::getRetryInterval() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _retryInterval;
+}
+
+
+void ofSSLOCSPStapler::setMaximumAge(std::chrono::seconds maximumAge)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _maximumAge = maximumAge;
+}
+
+
+std::chrono::seconds ofSSLOCSPStapler::getMaximumAge() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _maximumAge;
+}
+
+
+void ofSSLOCSPStapler::setTimeout(std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _timeout = timeout;
+}
+
+
+std::chrono::seconds ofSSLOCSPStapler::getTimeout() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _timeout;
+}
+
+
+std::size_t ofSSLOCSPStapler::getFreshCount() const
+{
+    auto now = std::chrono::system_clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    std::size_t count = 0;
+
+    for (const auto& entry: _entries)
+    {
+        std::shared_ptr<Entry> pEntry = entry.second.lock();
+
+        if (!pEntry)
+            continue;
+
+        std::shared_ptr<const Response> response = std::atomic_load(&pEntry->response);
+
+        if (response && response->expires > now)
+            ++count;
+    }
+
+    return count;
+}
+
+
+std::size_t ofSSLOCSPStapler::getStaleCount() const
+{
+    std::size_t count = size();
+    std::size_t freshCount = getFreshCount();
+    return count > freshCount ? count - freshCount : 0;
+}
+
+
+uint64_t ofSSLOCSPStapler::getStapled() const
+{
+    return _stapled;
+}
+
+
+uint64_t ofSSLOCSPStapler::getNotStapled() const
+{
+    return _notStapled;
+}
+
+
+uint64_t ofSSLOCSPStapler::getFetches() const
+{
+    return _fetches;
+}
+
+
+uint64_t ofSSLOCSPStapler::getFetchFailures() const
+{
+    return _fetchFailures;
+}
+
+
+void ofSSLOCSPStapler::resetCounters()
+{
+    _stapled = 0;
+    _notStapled = 0;
+    _fetches = 0;
+    _fetchFailures = 0;
+}
+
+
+bool ofSSLOCSPStapler::_fetch(Entry& entry)
+{
+    std::string url;
+    std::chrono::seconds timeout;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        url = _responderURL.empty() ? entry.responderURL : _responderURL;
+        timeout = _timeout;
+    }
+
+    std::string request;
+    OCSP_REQUEST* pRequest = OCSP_REQUEST_new();
+    OCSP_CERTID* pID = OCSP_cert_to_id(nullptr, entry.pCertificate, entry.pIssuer);
+
+    if (pRequest != nullptr && pID != nullptr && OCSP_request_add0_id(pRequest, pID) != nullptr)
+    {
+        pID = nullptr;
+
+        int length = i2d_OCSP_REQUEST(pRequest, nullptr);
+
+        if (length > 0)
+        {
+            request.resize(static_cast<std::size_t>(length));
+            unsigned char* pData = reinterpret_cast<unsigned char*>(&request[0]);
+            i2d_OCSP_REQUEST(pRequest, &pData);
+        }
+    }
+
+    OCSP_CERTID_free(pID);
+    OCSP_REQUEST_free(pRequest);
+    ERR_clear_error();
+
+    if (request.empty())
+    {
+        ofLogError("ofSSLOCSPStapler::_fetch") << "Unable to create an OCSP request.";
+        ++_fetchFailures;
+        return false;
+    }
+
+    std::string data;
+
+    try
+    {
+        Poco::URI uri(url);
+
+        if (uri.getScheme() != "http")
+            throw Poco::InvalidArgumentException("Unsupported OCSP responder", url);
+
+        Poco::Net::HTTPClientSession session(uri.getHost(), uri.getPort());
+        session.setTimeout(Poco::Timespan(static_cast<long>(timeout.count()), 0));
+
+        std::string path = uri.getPathAndQuery();
+
+        Poco::Net::HTTPRequest httpRequest(Poco::Net::HTTPRequest::HTTP_POST,
+                                           path.empty() ? "/" : path,
+                                           Poco::Net::HTTPMessage::HTTP_1_1);
+        httpRequest.setContentType("application/ocsp-request");
+        httpRequest.setContentLength(static_cast<std::streamsize>(request.size()));
+
+        session.sendRequest(httpRequest).write(request.data(), static_cast<std::streamsize>(request.size()));
+
+        Poco::Net::HTTPResponse httpResponse;
+        std::istream& stream = session.receiveResponse(httpResponse);
+
+        if (httpResponse.getStatus() != Poco::Net::HTTPResponse::HTTP_OK)
+            throw Poco::IOException("OCSP responder returned " + std::to_string(httpResponse.getStatus()), url);
+
+        Poco::StreamCopier::copyToString(stream, data);
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ofLogError("ofSSLOCSPStapler::_fetch") << exc.displayText();
+        ++_fetchFailures;
+        return false;
+    }
+
+    std::shared_ptr<const Response> response = _verify(entry, data);
+
+    if (!response)
+    {
+        ofLogError("ofSSLOCSPStapler::_fetch") << "Invalid OCSP response from " << url;
+        ++_fetchFailures;
+        return false;
+    }
+
+    std::atomic_store(&entry.response, response);
+    ++_fetches;
+
+    std::string path = _cacheFile(entry);
+
+    if (!path.empty())
+    {
+        // Replace the saved response atomically, so that a server starting
+        // at the same time never reads a partial response.
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+        std::string temporaryPath = path + ".tmp";
+
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        }
+
+        std::filesystem::rename(temporaryPath, path, error);
+
+        if (error)
+            ofLogWarning("ofSSLOCSPStapler::_fetch") << "Unable to save " << path << ": " << error.message();
+    }
+
+    return true;
+}
+
+
+std::shared_ptr<const ofSSLOCSPStapler::Response> ofSSLOCSPStapler::_verify(const Entry& entry,
+                                                                            const std::string& data) const
+{
+    std::shared_ptr<Response> response;
+
+    const unsigned char* pData = reinterpret_cast<const unsigned char*>(data.data());
+    OCSP_RESPONSE* pResponse = d2i_OCSP_RESPONSE(nullptr, &pData, static_cast<long>(data.size()));
+    OCSP_BASICRESP* pBasic = nullptr;
+
+    if (pResponse != nullptr && OCSP_response_status(pResponse) == OCSP_RESPONSE_STATUS_SUCCESSFUL)
+        pBasic = OCSP_response_get1_basic(pResponse);
+
+    // The response must be signed by the issuer, or by a responder the
+    // issuer delegated to.
+    X509_STORE* pStore = X509_STORE_new();
+    STACK_OF(X509)* pIssuers = sk_X509_new_null();
+    OCSP_CERTID* pID = OCSP_cert_to_id(nullptr, entry.pCertificate, entry.pIssuer);
+
+    int status = V_OCSP_CERTSTATUS_UNKNOWN;
+    int reason = 0;
+    ASN1_GENERALIZEDTIME* pRevoked = nullptr;
+    ASN1_GENERALIZEDTIME* pThisUpdate = nullptr;
+    ASN1_GENERALIZEDTIME* pNextUpdate = nullptr;
+
+    if (pBasic != nullptr
+     && pStore != nullptr
+     && pIssuers != nullptr
+     && pID != nullptr
+     && X509_STORE_add_cert(pStore, entry.pIssuer) == 1
+     && X509_STORE_set_flags(pStore, X509_V_FLAG_PARTIAL_CHAIN) == 1
+     && sk_X509_push(pIssuers, entry.pIssuer) > 0
+     && OCSP_basic_verify(pBasic, pIssuers, pStore, 0) == 1
+     && OCSP_resp_find_status(pBasic, pID, &status, &reason, &pRevoked, &pThisUpdate, &pNextUpdate) == 1
+     && OCSP_check_validity(pThisUpdate, pNextUpdate, MAXIMUM_CLOCK_SKEW, -1) == 1)
+    {
+        response = std::make_shared<Response>();
+        response->data = data;
+        response->produced = toTimePoint(pThisUpdate);
+
+        if (pNextUpdate != nullptr)
+            response->expires = toTimePoint(pNextUpdate);
+        else
+            response->expires = response->produced + getMaximumAge();
+
+        if (response->expires <= std::chrono::system_clock::now())
+            response.reset();
+        else if (status == V_OCSP_CERTSTATUS_REVOKED)
+            ofLogWarning("ofSSLOCSPStapler::_verify") << "The certificate has been revoked.";
+    }
+
+    OCSP_CERTID_free(pID);
+    sk_X509_free(pIssuers);
+    X509_STORE_free(pStore);
+    OCSP_BASICRESP_free(pBasic);
+    OCSP_RESPONSE_free(pResponse);
+    ERR_clear_error();
+
+    return response;
+}
+
+
+ofSSLOCSPStapler::Clock::time_point ofSSLOCSPStapler::_refreshTime(const Response& response) const
+{
+    auto now = std::chrono::system_clock::now();
+
+    // Refresh when half of the validity has passed, but not more often
+    // than the retry interval, in case the responder caches its responses.
+    auto refreshAt = std::max(response.produced + (response.expires - response.produced) / 2,
+                              now + getRetryInterval());
+
+    return Clock::now() + std::chrono::duration_cast<Clock::duration>(refreshAt - now);
+}
+
+
+std::string ofSSLOCSPStapler::_cacheFile(const Entry& entry) const
+{
+    std::string directory = getCacheDirectory();
+
+    if (directory.empty() || entry.fingerprint.empty())
+        return "";
+
+    return (std::filesystem::path(directory) / (entry.fingerprint + ".der")).string();
+}
+
+
+void ofSSLOCSPStapler::_start()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Nothing is started while clear() is stopping the thread.
+    if (!_thread.joinable() && !_stopping)
+        _thread = std::thread([this]() { _run(); });
+}
+
+
+void ofSSLOCSPStapler::_stop()
+{
+    std::thread thread;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stopping = true;
+        thread.swap(_thread);
+    }
+
+    _condition.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stopping = false;
+}
+
+
+void ofSSLOCSPStapler::_run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!_stopping)
+    {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = Clock::time_point::max();
+        std::vector<std::shared_ptr<Entry>> due;
+
+        auto iter = _entries.begin();
+
+        while (iter != _entries.end())
+        {
+            std::shared_ptr<Entry> entry = iter->second.lock();
+
+            // The last Context using the certificate was freed.
+            if (!entry)
+            {
+                iter = _entries.erase(iter);
+                continue;
+            }
+
+            if (_refreshAll || entry->refreshAt <= now)
+                due.push_back(entry);
+            else
+                next = std::min(next, entry->refreshAt);
+
+            ++iter;
+        }
+
+        _refreshAll = false;
+
+        if (due.empty())
+        {
+            if (next == Clock::time_point::max())
+                _condition.wait(lock);
+            else
+                _condition.wait_until(lock, next);
+
+            continue;
+        }
+
+        for (auto& entry: due)
+        {
+            if (_stopping)
+                break;
+
+            lock.unlock();
+
+            bool fetched = _fetch(*entry);
+            std::shared_ptr<const Response> response = std::atomic_load(&entry->response);
+            Clock::time_point refreshAt = fetched ? _refreshTime(*response) : Clock::now() + getRetryInterval();
+
+            lock.lock();
+
+            entry->refreshAt = refreshAt;
+        }
+    }
+}
+
+
+int ofSSLOCSPStapler::_statusCallback(SSL* ssl, void* arg)
+{
+    ofSSLOCSPStapler* stapler = static_cast<ofSSLOCSPStapler*>(arg);
+
+    // After SNI, this is the Context of the requested host.
+    std::shared_ptr<Entry>* pEntry = static_cast<std::shared_ptr<Entry>*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), _contextIndex()));
+
+    std::shared_ptr<const Response> response;
+
+    if (pEntry != nullptr)
+        response = std::atomic_load(&(*pEntry)->response);
+
+    if (!response || response->expires <= std::chrono::system_clock::now())
+    {
+        ++stapler->_notStapled;
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    // OpenSSL frees the stapled response with the connection.
+    unsigned char* pData = static_cast<unsigned char*>(OPENSSL_malloc(response->data.size()));
+
+    if (pData == nullptr)
+    {
+        ++stapler->_notStapled;
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    std::memcpy(pData, response->data.data(), response->data.size());
+    SSL_set_tlsext_status_ocsp_resp(ssl, pData, static_cast<long>(response->data.size()));
+
+    ++stapler->_stapled;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+
+int ofSSLOCSPStapler::_contextIndex()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, &ofSSLOCSPStapler::_freeEntry);
+    return index;
+}
+
+
+void ofSSLOCSPStapler::_freeEntry(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+{
+    delete static_cast<std::shared_ptr<Entry>*>(ptr);
+}
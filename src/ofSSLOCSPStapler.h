@@ -0,0 +1,269 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include "Poco/Net/Context.h"
+
+
+/// \brief Staples OCSP responses to the certificates of server Contexts.
+///
+/// A client that checks whether a server certificate has been revoked asks
+/// the OCSP responder of the certificate authority, which costs it an extra
+/// round trip on every new connection.  With stapling, the server sends a
+/// recent, signed response from the responder with its certificate, and the
+/// client doesn't need to ask.
+///
+/// For each attached Context, the response for its certificate is fetched
+/// from the responder named in the certificate (or the responder set with
+/// setResponderURL()) on a background thread.  Responses are refreshed when
+/// half of their validity has passed, so that a fresh response is always
+/// available.  Handshakes only read the cached response and never wait for
+/// the responder.  A client gets no stapled response while none is cached or
+/// the cached response has expired.
+///
+/// Responses are verified against the issuer of the certificate before they
+/// are cached.  When a cache directory is set, responses are also saved to
+/// disk, so that a restarted server staples immediately.
+///
+/// Contexts with the same certificate share one response.  Responses are
+/// forgotten when the last Context using them is freed.
+///
+/// All methods are thread-safe.
+class ofSSLOCSPStapler
+{
+public:
+    /// \brief The default time between attempts to fetch a response after
+    ///        an attempt failed.
+    static const std::chrono::seconds DEFAULT_RETRY_INTERVAL;
+
+    /// \brief The default time a response without a next update time is
+    ///        stapled.
+    static const std::chrono::seconds DEFAULT_MAXIMUM_AGE;
+
+    /// \brief The default timeout of requests to the responder.
+    static const std::chrono::seconds DEFAULT_TIMEOUT;
+
+    /// \brief Create a stapler without responses.
+    ofSSLOCSPStapler();
+
+    /// \brief Stop the background thread.
+    ~ofSSLOCSPStapler();
+
+    /// \brief Staple responses to the certificate of the given Context.
+    ///
+    /// The issuer of the certificate is found in the certificate chain of the
+    /// Context or in its trusted certificates.  Certificates that are
+    /// self-signed, or that have no issuer or responder, are not stapled.
+    ///
+    /// \param pContext The server Context.
+    /// \returns true iff responses will be stapled to the certificate.
+    /// \note This stapler must outlive the Context.
+    bool attach(Poco::Net::Context::Ptr pContext);
+
+    /// \brief Fetch new responses for all certificates now.
+    void refresh();
+
+    /// \brief Forget all responses and stop the background thread.
+    ///
+    /// Responses are no longer stapled to the attached Contexts.  Responses
+    /// saved to disk are kept.
+    void clear();
+
+    /// \returns the number of certificates responses are stapled to.
+    std::size_t size() const;
+
+    /// \brief Set the responder used for all certificates.
+    ///
+    /// This is useful for a responder behind a proxy or for testing.  The
+    /// responder must be an http URL.
+    ///
+    /// \param url The responder URL, or an empty string to use the responder
+    ///        named in each certificate.
+    /// \note This should be set before Contexts are attached.
+    void setResponderURL(const std::string& url);
+
+    /// \returns the responder used for all certificates, or an empty string
+    ///          if the responder named in each certificate is used.
+    std::string getResponderURL() const;
+
+    /// \brief Set the directory responses are saved to.
+    /// \param path The absolute path of the directory, or an empty string to
+    ///        keep responses in memory only.
+    /// \note This should be set before Contexts are attached.
+    void setCacheDirectory(const std::string& path);
+
+    /// \returns the directory responses are saved to, or an empty string.
+    std::string getCacheDirectory() const;
+
+    /// \brief Set the time between attempts after an attempt failed.
+    /// \param interval The retry interval.
+    void setRetryInterval(std::chrono::seconds interval);
+
+    /// \returns the time between attempts after an attempt failed.
+    std::chrono::seconds getRetryInterval() const;
+
+    /// \brief Set the time a response without a next update time is stapled.
+    /// \param maximumAge The maximum age.
+    void setMaximumAge(std::chrono::seconds maximumAge);
+
+    /// \returns the time a response without a next update time is stapled.
+    std::chrono::seconds getMaximumAge() const;
+
+    /// \brief Set the timeout of requests to the responder.
+    /// \param timeout The timeout.
+    void setTimeout(std::chrono::seconds timeout);
+
+    /// \returns the timeout of requests to the responder.
+    std::chrono::seconds getTimeout() const;
+
+    /// \returns the number of certificates with a response that has not
+    ///          expired.
+    std::size_t getFreshCount() const;
+
+    /// \returns the number of certificates without a response or with a
+    ///          response that has expired.
+    std::size_t getStaleCount() const;
+
+    /// \returns the number of handshakes a response was stapled to.
+    uint64_t getStapled() const;
+
+    /// \returns the number of handshakes that asked for a response and got
+    ///          none.
+    uint64_t getNotStapled() const;
+
+    /// \returns the number of responses fetched and cached.
+    uint64_t getFetches() const;
+
+    /// \returns the number of failed attempts to fetch a response.
+    uint64_t getFetchFailures() const;
+
+    /// \brief Reset the stapled, not stapled, fetch and fetch failure
+    ///        counters.
+    void resetCounters();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    /// \brief A verified response.
+    struct Response
+    {
+        /// \brief The DER encoded response.
+        std::string data;
+
+        /// \brief The time the response was produced.
+        std::chrono::system_clock::time_point produced;
+
+        /// \brief The time the response expires.
+        std::chrono::system_clock::time_point expires;
+    };
+
+    /// \brief A certificate that responses are stapled to.
+    struct Entry
+    {
+        Entry(X509* pCertificate, X509* pIssuer);
+        ~Entry();
+
+        /// \brief The SHA-256 fingerprint of the certificate.
+        std::string fingerprint;
+
+        /// \brief The responder named in the certificate, if any.
+        std::string responderURL;
+
+        X509* pCertificate = nullptr;
+        X509* pIssuer = nullptr;
+
+        /// \brief The current response, or nullptr.
+        ///
+        /// Read and replaced with std::atomic_load and std::atomic_store.
+        std::shared_ptr<const Response> response;
+
+        /// \brief The time the next response is due.
+        Clock::time_point refreshAt;
+    };
+
+    /// \brief Fetch, verify, cache and save a response.
+    /// \returns true iff a response was cached.
+    bool _fetch(Entry& entry);
+
+    /// \brief Verify a DER encoded response for a certificate.
+    /// \returns the response, or nullptr if it is invalid or expired.
+    std::shared_ptr<const Response> _verify(const Entry& entry,
+                                            const std::string& data) const;
+
+    /// \returns the time the response after the given one is due.
+    Clock::time_point _refreshTime(const Response& response) const;
+
+    /// \returns the path a response is saved to, or an empty string.
+    std::string _cacheFile(const Entry& entry) const;
+
+    /// \brief Start the background thread if it is not running.
+    void _start();
+
+    /// \brief Stop the background thread.
+    void _stop();
+
+    /// \brief Fetch responses when they are due until stopped.
+    void _run();
+
+    /// \brief Staple the cached response to a handshake.
+    static int _statusCallback(SSL* ssl, void* arg);
+
+    /// \returns the SSL_CTX ex_data index of the Context's entry.
+    static int _contextIndex();
+
+    /// \brief Free the entry of a Context.
+    static void _freeEntry(void* parent,
+                           void* ptr,
+                           CRYPTO_EX_DATA* ad,
+                           int index,
+                           long argl,
+                           void* argp);
+
+    /// \brief The certificates, by fingerprint.  Each is owned by the
+    ///        Contexts using it.
+    std::map<std::string, std::weak_ptr<Entry>> _entries;
+
+    std::string _responderURL;
+    std::string _cacheDirectory;
+    std::chrono::seconds _retryInterval = DEFAULT_RETRY_INTERVAL;
+    std::chrono::seconds _maximumAge = DEFAULT_MAXIMUM_AGE;
+    std::chrono::seconds _timeout = DEFAULT_TIMEOUT;
+
+    std::atomic<uint64_t> _stapled;
+    std::atomic<uint64_t> _notStapled;
+    std::atomic<uint64_t> _fetches;
+    std::atomic<uint64_t> _fetchFailures;
+
+    /// \brief The background thread.
+    std::thread _thread;
+
+    /// \brief True while the background thread should stop.
+    bool _stopping = false;
+
+    /// \brief True when all responses should be fetched now.
+    bool _refreshAll = false;
+
+    /// \brief Wakes the background thread.
+    std::condition_variable _condition;
+
+    /// \brief The mutex protecting the entries, settings and thread.
+    mutable std::mutex _mutex;
+
+};
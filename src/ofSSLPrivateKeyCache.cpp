@@ -0,0 +1,388 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLPrivateKeyCache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include "Poco/Net/SSLException.h"
+#include "ofLog.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+const std::chrono::seconds ofSSLPrivateKeyCache::DEFAULT_TIME_TO_LIVE = std::chrono::seconds(0);
+
+
+ofSSLPrivateKeyCache::SecureBuffer::SecureBuffer(std::size_t size):
+    _size(size)
+{
+    // Whole pages are allocated so that locking and zeroing do not touch
+    // other allocations.
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    std::size_t pageSize = info.dwPageSize;
+#else
+    std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+
+    _capacity = std::max<std::size_t>(1, (size + pageSize - 1) / pageSize) * pageSize;
+
+#if defined(_WIN32)
+    _data = static_cast<unsigned char*>(VirtualAlloc(nullptr, _capacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+    if (_data == nullptr)
+        throw std::bad_alloc();
+
+    _locked = VirtualLock(_data, _capacity) != 0;
+#else
+    void* data = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (data == MAP_FAILED)
+        throw std::bad_alloc();
+
+    _data = static_cast<unsigned char*>(data);
+    _locked = mlock(_data, _capacity) == 0;
+
+#if defined(MADV_DONTDUMP)
+    // Keep the key material out of core dumps.
+    madvise(_data, _capacity, MADV_DONTDUMP);
+#endif
+#endif
+
+    if (!_locked)
+    {
+        ofLogWarning("ofSSLPrivateKeyCache::SecureBuffer") << "Unable to lock memory, cached key material may be swapped to disk.";
+    }
+}
+
+
+ofSSLPrivateKeyCache::SecureBuffer::~SecureBuffer()
+{
+    OPENSSL_cleanse(_data, _capacity);
+
+#if defined(_WIN32)
+    if (_locked)
+        VirtualUnlock(_data, _capacity);
+
+    VirtualFree(_data, 0, MEM_RELEASE);
+#else
+    if (_locked)
+        munlock(_data, _capacity);
+
+    munmap(_data, _capacity);
+#endif
+}
+
+
+unsigned char* ofSSLPrivateKeyCache::SecureBuffer::data()
+{
+    return _data;
+}
+
+
+std::size_t ofSSLPrivateKeyCache::SecureBuffer::size() const
+{
+    return _size;
+}
+
+
+ofSSLPrivateKeyCache::ofSSLPrivateKeyCache(std::chrono::seconds timeToLive):
+    _timeToLive(timeToLive),
+    _hits(0),
+    _misses(0),
+    _passphraseHits(0)
+{
+}
+
+
+EVP_PKEY* ofSSLPrivateKeyCache::load(const std::string& privateKeyFile,
+                                     PassphraseHandler passphraseHandler)
+{
+    std::string version = _version(privateKeyFile);
+
+    Clock::time_point now = Clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _purge(now);
+
+    auto iter = _entries.find(privateKeyFile);
+
+    if (iter != _entries.end() && iter->second.version == version)
+    {
+        const unsigned char* data = iter->second.key->data();
+        EVP_PKEY* pKey = d2i_AutoPrivateKey(nullptr, &data, static_cast<long>(iter->second.key->size()));
+
+        if (pKey != nullptr)
+        {
+            ++_hits;
+            return pKey;
+        }
+    }
+
+    ++_misses;
+
+    std::string pem;
+
+    {
+        std::ifstream stream(privateKeyFile, std::ios::binary);
+        pem.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    PassphraseRequest request;
+    request.cache = this;
+    request.handler = &passphraseHandler;
+    request.lock = &lock;
+
+    EVP_PKEY* pKey = _decrypt(pem, request);
+
+    if (pKey == nullptr && request.usedCachedPassphrase && request.exception == nullptr)
+    {
+        // The key was encrypted with another passphrase, so ask again.
+        _passphrase.reset();
+        pKey = _decrypt(pem, request);
+    }
+
+    // An unencrypted key file holds key material too.
+    OPENSSL_cleanse(&pem[0], pem.size());
+
+    if (request.exception != nullptr)
+    {
+        _passphrase.reset();
+        ERR_clear_error();
+        std::rethrow_exception(request.exception);
+    }
+
+    if (pKey == nullptr)
+    {
+        // Don't keep a passphrase that didn't work.
+        _passphrase.reset();
+        ERR_clear_error();
+        throw Poco::Net::SSLContextException("Error loading private key from file", privateKeyFile);
+    }
+
+    if (_timeToLive.count() > 0)
+    {
+        int size = i2d_PrivateKey(pKey, nullptr);
+
+        if (size > 0)
+        {
+            Entry& entry = _entries[privateKeyFile];
+            entry.version = version;
+            entry.key.reset(new SecureBuffer(static_cast<std::size_t>(size)));
+            entry.expires = now + _timeToLive;
+
+            unsigned char* data = entry.key->data();
+            i2d_PrivateKey(pKey, &data);
+        }
+    }
+
+    return pKey;
+}
+
+
+void ofSSLPrivateKeyCache::purge()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _purge(Clock::now());
+}
+
+
+void ofSSLPrivateKeyCache::clear()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _entries.clear();
+    _passphrase.reset();
+}
+
+
+std::size_t ofSSLPrivateKeyCache::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+
+bool ofSSLPrivateKeyCache::isEnabled() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _timeToLive.count() > 0;
+}
+
+
+void ofSSLPrivateKeyCache::setTimeToLive(std::chrono::seconds timeToLive)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _timeToLive = timeToLive;
+
+    if (_timeToLive.count() <= 0)
+    {
+        _entries.clear();
+        _passphrase.reset();
+    }
+}
+
+
+std::chrono::seconds ofSSLPrivateKeyCache::getTimeToLive() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _timeToLive;
+}
+
+
+uint64_t ofSSLPrivateKeyCache::getHits() const
+{
+    return _hits;
+}
+
+
+uint64_t ofSSLPrivateKeyCache::getMisses() const
+{
+    return _misses;
+}
+
+
+uint64_t ofSSLPrivateKeyCache::getPassphraseHits() const
+{
+    return _passphraseHits;
+}
+
+
+void ofSSLPrivateKeyCache::resetCounters()
+{
+    _hits = 0;
+    _misses = 0;
+    _passphraseHits = 0;
+}
+
+
+EVP_PKEY* ofSSLPrivateKeyCache::_decrypt(const std::string& pem,
+                                         PassphraseRequest& request)
+{
+    BIO* pBIO = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+
+    if (pBIO == nullptr)
+        return nullptr;
+
+    EVP_PKEY* pKey = PEM_read_bio_PrivateKey(pBIO, nullptr, &ofSSLPrivateKeyCache::_passphraseCallback, &request);
+
+    BIO_free(pBIO);
+
+    return pKey;
+}
+
+
+void ofSSLPrivateKeyCache::_purge(Clock::time_point now)
+{
+    for (auto iter = _entries.begin(); iter != _entries.end();)
+    {
+        if (iter->second.expires <= now)
+            iter = _entries.erase(iter);
+        else
+            ++iter;
+    }
+
+    if (_passphrase != nullptr && _passphraseExpires <= now)
+        _passphrase.reset();
+}
+
+
+std::string ofSSLPrivateKeyCache::_version(const std::string& path)
+{
+    std::error_code error;
+
+    auto size = std::filesystem::file_size(path, error);
+    auto modified = std::filesystem::last_write_time(path, error);
+
+    std::stringstream version;
+    version << size << " " << modified.time_since_epoch().count();
+    return version.str();
+}
+
+
+int ofSSLPrivateKeyCache::_passphraseCallback(char* buffer, int size, int, void* userData)
+{
+    PassphraseRequest* request = static_cast<PassphraseRequest*>(userData);
+    ofSSLPrivateKeyCache* cache = request->cache;
+
+    // Keys loaded while another thread asks for the passphrase wait for its
+    // answer, so that Contexts built at the same time ask only once.  A
+    // handler that loads a key itself is not kept waiting for itself.
+    cache->_passphraseAnswered.wait(*request->lock, [cache]() {
+        return cache->_askingThread == std::thread::id()
+            || cache->_askingThread == std::this_thread::get_id();
+    });
+
+    // The cached passphrase is tried once per decryption.
+    if (cache->_passphrase != nullptr && !request->usedCachedPassphrase)
+    {
+        request->usedCachedPassphrase = true;
+        ++cache->_passphraseHits;
+
+        int length = std::min<int>(size, static_cast<int>(cache->_passphrase->size()));
+        std::memcpy(buffer, cache->_passphrase->data(), length);
+        return length;
+    }
+
+    request->usedCachedPassphrase = false;
+    cache->_passphrase.reset();
+
+    std::string passphrase;
+    std::thread::id askingThread = cache->_askingThread;
+
+    // The handler is called without the lock, so that it can use the cache.
+    cache->_askingThread = std::this_thread::get_id();
+    request->lock->unlock();
+
+    try
+    {
+        passphrase = (*request->handler)();
+    }
+    catch (...)
+    {
+        request->lock->lock();
+        cache->_askingThread = askingThread;
+        cache->_passphraseAnswered.notify_all();
+
+        // Exceptions must not unwind through OpenSSL, so decryption fails
+        // and load() rethrows.
+        request->exception = std::current_exception();
+        return -1;
+    }
+
+    request->lock->lock();
+    cache->_askingThread = askingThread;
+    cache->_passphraseAnswered.notify_all();
+
+    if (cache->_timeToLive.count() > 0 && !passphrase.empty())
+    {
+        cache->_passphrase.reset(new SecureBuffer(passphrase.size()));
+        cache->_passphraseExpires = Clock::now() + cache->_timeToLive;
+        std::memcpy(cache->_passphrase->data(), passphrase.data(), passphrase.size());
+    }
+
+    int length = std::min<int>(size, static_cast<int>(passphrase.size()));
+    std::memcpy(buffer, passphrase.data(), length);
+
+    OPENSSL_cleanse(&passphrase[0], passphrase.size());
+
+    return length;
+}
@@ -0,0 +1,191 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <openssl/evp.h>
+
+
+/// \brief An expiring cache of decrypted private keys and their passphrase.
+///
+/// Loading an encrypted private key asks for its passphrase (e.g. through
+/// Poco's PrivateKeyPassphraseRequired event) and runs a slow key derivation
+/// every time a Context is built.  When a time to live is set, the decrypted
+/// key and the passphrase are kept in locked (non-swappable) memory that is
+/// zeroed when it is released, so that Contexts rebuilt for reloading,
+/// sharding or host names do not ask again or decrypt the file again.
+///
+/// A cached key is reused while its file is unchanged.  A changed file is
+/// decrypted with the cached passphrase, and the passphrase is only asked
+/// for again if that fails.  Everything expires after the time to live,
+/// measured from when it was cached.  Expired material is zeroed by the
+/// next load() or purge().
+///
+/// The cache is disabled (the time to live is 0) by default.
+///
+/// All methods are thread-safe.
+class ofSSLPrivateKeyCache
+{
+public:
+    /// \brief A function that returns the passphrase of a private key.
+    typedef std::function<std::string()> PassphraseHandler;
+
+    /// \brief The default time to live, which disables the cache.
+    static const std::chrono::seconds DEFAULT_TIME_TO_LIVE;
+
+    /// \brief Create a private key cache.
+    /// \param timeToLive The maximum time a key or passphrase is kept.
+    ofSSLPrivateKeyCache(std::chrono::seconds timeToLive = DEFAULT_TIME_TO_LIVE);
+
+    /// \brief Load a private key, using the cache when possible.
+    /// \param privateKeyFile The PEM private key file.
+    /// \param passphraseHandler Called when a passphrase is needed and none
+    ///        is cached.
+    /// \returns A new reference to the key, to be freed with EVP_PKEY_free().
+    /// \throws Poco::Net::SSLContextException if the key can't be loaded.
+    /// \throws the exception thrown by the passphrase handler, if any.
+    /// \note The passphrase handler is called without locking the cache, so
+    ///       it may use the cache.  Loads that need a passphrase while another
+    ///       thread asks for one wait for its answer.
+    EVP_PKEY* load(const std::string& privateKeyFile,
+                   PassphraseHandler passphraseHandler);
+
+    /// \brief Zero and remove the expired keys and passphrase.
+    void purge();
+
+    /// \brief Zero and remove all cached keys and the passphrase.
+    void clear();
+
+    /// \returns the number of cached keys, including expired keys that have
+    ///          not yet been removed.
+    std::size_t size() const;
+
+    /// \returns true iff the time to live is greater than 0.
+    bool isEnabled() const;
+
+    /// \brief Set the maximum time a key or passphrase is kept.
+    ///
+    /// The new time to live applies to keys and passphrases cached after
+    /// this call.  Setting a time to live of 0 disables the cache and clears
+    /// it.
+    ///
+    /// \param timeToLive The time to live.
+    void setTimeToLive(std::chrono::seconds timeToLive);
+
+    /// \returns the maximum time a key or passphrase is kept.
+    std::chrono::seconds getTimeToLive() const;
+
+    /// \returns the number of loads that used a cached key.
+    uint64_t getHits() const;
+
+    /// \returns the number of loads that decrypted the key file.
+    uint64_t getMisses() const;
+
+    /// \returns the number of loads that used the cached passphrase.
+    uint64_t getPassphraseHits() const;
+
+    /// \brief Reset the hit and miss counters.
+    void resetCounters();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    /// \brief Memory that is locked into RAM and zeroed when released.
+    class SecureBuffer
+    {
+    public:
+        SecureBuffer(std::size_t size);
+        ~SecureBuffer();
+
+        SecureBuffer(const SecureBuffer&) = delete;
+        SecureBuffer& operator = (const SecureBuffer&) = delete;
+
+        unsigned char* data();
+        std::size_t size() const;
+
+    private:
+        unsigned char* _data = nullptr;
+        std::size_t _size = 0;
+        std::size_t _capacity = 0;
+        bool _locked = false;
+
+    };
+
+    struct Entry
+    {
+        /// \brief The size and modification time of the key file.
+        std::string version;
+
+        /// \brief The decrypted key, DER encoded.
+        std::unique_ptr<SecureBuffer> key;
+
+        Clock::time_point expires;
+    };
+
+    /// \brief The state passed to the OpenSSL passphrase callback.
+    struct PassphraseRequest
+    {
+        ofSSLPrivateKeyCache* cache = nullptr;
+        PassphraseHandler* handler = nullptr;
+        std::unique_lock<std::mutex>* lock = nullptr;
+        bool usedCachedPassphrase = false;
+
+        /// \brief The exception thrown by the handler, rethrown by load()
+        ///        so that it doesn't unwind through OpenSSL.
+        std::exception_ptr exception;
+    };
+
+    /// \brief Decrypt a PEM private key.
+    /// \note The mutex must be held by the caller.
+    EVP_PKEY* _decrypt(const std::string& pem, PassphraseRequest& request);
+
+    /// \brief Zero and remove the expired keys and passphrase.
+    /// \note The mutex must be held by the caller.
+    void _purge(Clock::time_point now);
+
+    /// \returns the size and modification time of a file.
+    static std::string _version(const std::string& path);
+
+    static int _passphraseCallback(char* buffer, int size, int flag, void* userData);
+
+    /// \brief The cached keys by file path.
+    std::map<std::string, Entry> _entries;
+
+    /// \brief The cached passphrase, or nullptr.
+    std::unique_ptr<SecureBuffer> _passphrase;
+
+    Clock::time_point _passphraseExpires;
+
+    /// \brief The thread asking for the passphrase, if any.
+    std::thread::id _askingThread;
+
+    /// \brief Notifies loads waiting for the passphrase.
+    std::condition_variable _passphraseAnswered;
+
+    /// \brief The maximum time a key or passphrase is kept.
+    std::chrono::seconds _timeToLive = DEFAULT_TIME_TO_LIVE;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _passphraseHits;
+
+    /// \brief The mutex protecting the entries, passphrase and settings.
+    mutable std::mutex _mutex;
+
+};
@@ -0,0 +1,225 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLSessionCache.h"
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <openssl/ssl.h>
+
+
+const std::size_t ofSSLSessionCache::DEFAULT_MAXIMUM_SIZE = 256;
+const std::chrono::seconds ofSSLSessionCache::DEFAULT_TIME_TO_LIVE = std::chrono::seconds(300);
+
+
+ofSSLSessionCache::ofSSLSessionCache(std::size_t maximumSize,
+                                     std::chrono::seconds timeToLive):
+    _maximumSize(maximumSize),
+    _timeToLive(timeToLive),
+    _hits(0),
+    _misses(0),
+    _evictions(0),
+    _expirations(0)
+{
+}
+
+
+Poco::Net::Session::Ptr ofSSLSessionCache::get(const std::string& host,
+                                               uint16_t port)
+{
+    std::string key = makeKey(host, port);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _index.find(key);
+
+    if (iter == _index.end())
+    {
+        ++_misses;
+        return nullptr;
+    }
+
+    if (iter->second->expires <= Clock::now())
+    {
+        _entries.erase(iter->second);
+        _index.erase(iter);
+        ++_expirations;
+        ++_misses;
+        return nullptr;
+    }
+
+    // Move the entry to the front of the list.
+    _entries.splice(_entries.begin(), _entries, iter->second);
+    ++_hits;
+    return _entries.front().session;
+}
+
+
+void ofSSLSessionCache::put(const std::string& host,
+                            uint16_t port,
+                            Poco::Net::Session::Ptr session)
+{
+    if (session.isNull() || session->sslSession() == nullptr)
+        return;
+
+    SSL_SESSION* pSession = session->sslSession();
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (!SSL_SESSION_is_resumable(pSession))
+        return;
+#endif
+
+    Clock::time_point now = Clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_maximumSize == 0)
+        return;
+
+    // Do not keep the session longer than the server allows.
+    std::chrono::seconds timeToLive = _timeToLive;
+    long remaining = SSL_SESSION_get_time(pSession)
+                   + SSL_SESSION_get_timeout(pSession)
+                   - static_cast<long>(std::time(nullptr));
+
+    timeToLive = std::min(timeToLive, std::chrono::seconds(std::max(remaining, 0L)));
+
+    if (timeToLive.count() <= 0)
+        return;
+
+    Entry entry;
+    entry.key = makeKey(host, port);
+    entry.session = session;
+    entry.expires = now + timeToLive;
+
+    auto iter = _index.find(entry.key);
+
+    if (iter != _index.end())
+    {
+        _entries.erase(iter->second);
+        _index.erase(iter);
+    }
+
+    _entries.push_front(entry);
+    _index[_entries.front().key] = _entries.begin();
+
+    _trim();
+}
+
+
+void ofSSLSessionCache::remove(const std::string& host, uint16_t port)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _index.find(makeKey(host, port));
+
+    if (iter != _index.end())
+    {
+        _entries.erase(iter->second);
+        _index.erase(iter);
+    }
+}
+
+
+void ofSSLSessionCache::clear()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _index.clear();
+    _entries.clear();
+}
+
+
+std::size_t ofSSLSessionCache::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+
+void ofSSLSessionCache::setMaximumSize(std::size_t maximumSize)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _maximumSize = maximumSize;
+    _trim();
+}
+
+
+std::size_t ofSSLSessionCache::getMaximumSize() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _maximumSize;
+}
+
+
+void ofSSLSessionCache::setTimeToLive(std::chrono::seconds timeToLive)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _timeToLive = timeToLive;
+}
+
+
+std::chrono::seconds ofSSLSessionCache::getTimeToLive() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _timeToLive;
+}
+
+
+uint64_t ofSSLSessionCache::getHits() const
+{
+    return _hits;
+}
+
+
+uint64_t ofSSLSessionCache::getMisses() const
+{
+    return _misses;
+}
+
+
+uint64_t ofSSLSessionCache::getEvictions() const
+{
+    return _evictions;
+}
+
+
+uint64_t ofSSLSessionCache::getExpirations() const
+{
+    return _expirations;
+}
+
+
+void ofSSLSessionCache::resetCounters()
+{
+    _hits = 0;
+    _misses = 0;
+    _evictions = 0;
+    _expirations = 0;
+}
+
+
+std::string ofSSLSessionCache::makeKey(const std::string& host, uint16_t port)
+{
+    std::string key = host;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    key += ":";
+    key += std::to_string(port);
+    return key;
+}
+
+
+void ofSSLSessionCache::_trim()
+{
+    while (_entries.size() > _maximumSize)
+    {
+        _index.erase(_entries.back().key);
+        _entries.pop_back();
+        ++_evictions;
+    }
+}
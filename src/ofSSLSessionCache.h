@@ -0,0 +1,164 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Poco/Net/Session.h"
+
+
+/// \brief A bounded, expiring cache of client SSL sessions.
+///
+/// Sessions are keyed by host and port so that repeated connections to the
+/// same server can resume a previous session instead of performing a full
+/// handshake.  When the cache is full, the least recently used session is
+/// evicted.  Sessions are discarded once their time to live (or the lifetime
+/// granted by the server, whichever is shorter) has passed.
+///
+/// A typical client uses the cache like this:
+///
+/// ~~~{.cpp}
+///     Poco::Net::HTTPSClientSession session(host,
+///                                           port,
+///                                           ofSSLManager::getDefaultClientContext(),
+///                                           ofSSLManager::getClientSession(host, port));
+///     // ... send a request and receive the response ...
+///     ofSSLManager::setClientSession(host, port, session.sslSession());
+/// ~~~
+///
+/// All methods are thread-safe.
+class ofSSLSessionCache
+{
+public:
+    /// \brief The default maximum number of cached sessions.
+    static const std::size_t DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The default time to live for a cached session.
+    static const std::chrono::seconds DEFAULT_TIME_TO_LIVE;
+
+    /// \brief Create a session cache.
+    /// \param maximumSize The maximum number of cached sessions.
+    /// \param timeToLive The maximum time a session is kept.
+    ofSSLSessionCache(std::size_t maximumSize = DEFAULT_MAXIMUM_SIZE,
+                      std::chrono::seconds timeToLive = DEFAULT_TIME_TO_LIVE);
+
+    /// \brief Get the cached session for the given host and port.
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \returns The cached session or nullptr if none is available.
+    Poco::Net::Session::Ptr get(const std::string& host, uint16_t port);
+
+    /// \brief Cache a session for the given host and port.
+    ///
+    /// Null and non-resumable sessions are ignored.  An existing session for
+    /// the same host and port is replaced.
+    ///
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \param session The session to cache.
+    void put(const std::string& host,
+             uint16_t port,
+             Poco::Net::Session::Ptr session);
+
+    /// \brief Remove the cached session for the given host and port.
+    /// \param host The server host name.
+    /// \param port The server port.
+    void remove(const std::string& host, uint16_t port);
+
+    /// \brief Remove all cached sessions.
+    void clear();
+
+    /// \returns the number of cached sessions, including expired sessions
+    ///          that have not yet been removed.
+    std::size_t size() const;
+
+    /// \brief Set the maximum number of cached sessions.
+    ///
+    /// If the cache holds more sessions than the new maximum, the least
+    /// recently used sessions are evicted.
+    ///
+    /// \param maximumSize The maximum number of cached sessions.
+    void setMaximumSize(std::size_t maximumSize);
+
+    /// \returns the maximum number of cached sessions.
+    std::size_t getMaximumSize() const;
+
+    /// \brief Set the maximum time a session is kept.
+    ///
+    /// The new time to live applies to sessions cached after this call.
+    ///
+    /// \param timeToLive The time to live.
+    void setTimeToLive(std::chrono::seconds timeToLive);
+
+    /// \returns the maximum time a session is kept.
+    std::chrono::seconds getTimeToLive() const;
+
+    /// \returns the number of lookups that returned a session.
+    uint64_t getHits() const;
+
+    /// \returns the number of lookups that did not return a session.
+    uint64_t getMisses() const;
+
+    /// \returns the number of sessions evicted to respect the maximum size.
+    uint64_t getEvictions() const;
+
+    /// \returns the number of sessions discarded because they expired.
+    uint64_t getExpirations() const;
+
+    /// \brief Reset the hit, miss, eviction and expiration counters.
+    void resetCounters();
+
+    /// \brief Make a cache key from a host and port.
+    /// \param host The server host name.
+    /// \param port The server port.
+    /// \returns A key in the form "host:port" with the host in lower case.
+    static std::string makeKey(const std::string& host, uint16_t port);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        std::string key;
+        Poco::Net::Session::Ptr session;
+        Clock::time_point expires;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    /// \brief Evict least recently used sessions until size <= maximumSize.
+    /// \note The mutex must be held by the caller.
+    void _trim();
+
+    /// \brief The cached sessions, most recently used first.
+    EntryList _entries;
+
+    /// \brief An index of the cached sessions by key.
+    std::unordered_map<std::string, EntryList::iterator> _index;
+
+    /// \brief The maximum number of cached sessions.
+    std::size_t _maximumSize = DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The maximum time a session is kept.
+    std::chrono::seconds _timeToLive = DEFAULT_TIME_TO_LIVE;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _evictions;
+    std::atomic<uint64_t> _expirations;
+
+    /// \brief The mutex protecting the entries and settings.
+    mutable std::mutex _mutex;
+
+};
@@ -0,0 +1,604 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLSessionTicketKeys.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
+#include "Poco/File.h"
+#include "Poco/NamedMutex.h"
+#include "ofLog.h"
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+
+namespace
+{
+
+
+std::string toHex(const unsigned char* data, std::size_t size)
+{
+    static const char* digits = "0123456789abcdef";
+    std::string result;
+    result.reserve(size * 2);
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        result += digits[data[i] >> 4];
+        result += digits[data[i] & 0x0F];
+    }
+
+    return result;
+}
+
+
+bool fromHex(const std::string& hex, unsigned char* data, std::size_t size)
+{
+    if (hex.size() != size * 2)
+        return false;
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        int value = 0;
+
+        for (std::size_t j = 0; j < 2; ++j)
+        {
+            char c = hex[i * 2 + j];
+            value <<= 4;
+
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+
+        data[i] = static_cast<unsigned char>(value);
+    }
+
+    return true;
+}
+
+
+int64_t now()
+{
+    return static_cast<int64_t>(std::time(nullptr));
+}
+
+
+}
+
+
+const std::chrono::seconds ofSSLSessionTicketKeys::DEFAULT_ROTATION_INTERVAL = std::chrono::hours(1);
+const std::chrono::seconds ofSSLSessionTicketKeys::DEFAULT_KEY_LIFETIME = std::chrono::hours(12);
+
+
+ofSSLSessionTicketKeys::ofSSLSessionTicketKeys():
+    _sharedKeyFileModified(0),
+    _nextRefresh(0),
+    _ticketsIssued(0),
+    _ticketsAccepted(0),
+    _ticketsRenewed(0),
+    _ticketsRejected(0),
+    _rotations(0)
+{
+}
+
+
+void ofSSLSessionTicketKeys::attach(Poco::Net::Context::Ptr pContext)
+{
+    if (pContext.isNull() || !pContext->isForServerUse())
+    {
+        ofLogWarning("ofSSLSessionTicketKeys::attach") << "Session ticket keys can only be attached to a server Context.";
+        return;
+    }
+
+    SSL_CTX* pSSLContext = pContext->sslContext();
+    SSL_CTX_set_ex_data(pSSLContext, _contextIndex(), this);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(pSSLContext, &ofSSLSessionTicketKeys::_ticketKeyCallback);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(pSSLContext, &ofSSLSessionTicketKeys::_ticketKeyCallback);
+#endif
+}
+
+
+void ofSSLSessionTicketKeys::setSharedKeyFile(const std::string& path)
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sharedKeyFile = path;
+        _sharedKeyFileModified = 0;
+        _keys.clear();
+    }
+
+    _refresh(true);
+}
+
+
+std::string ofSSLSessionTicketKeys::getSharedKeyFile() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _sharedKeyFile;
+}
+
+
+bool ofSSLSessionTicketKeys::isShared(SSL_CTX* pSSLContext)
+{
+    ofSSLSessionTicketKeys* keys = static_cast<ofSSLSessionTicketKeys*>(SSL_CTX_get_ex_data(pSSLContext, _contextIndex()));
+    return keys != nullptr && !keys->getSharedKeyFile().empty();
+}
+
+
+void ofSSLSessionTicketKeys::setRotationInterval(std::chrono::seconds interval)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _rotationInterval = interval;
+    _nextRefresh = 0;
+}
+
+
+std::chrono::seconds ofSSLSessionTicketKeys::getRotationInterval() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _rotationInterval;
+}
+
+
+void ofSSLSessionTicketKeys::setKeyLifetime(std::chrono::seconds lifetime)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _keyLifetime = lifetime;
+    _nextRefresh = 0;
+}
+
+
+std::chrono::seconds ofSSLSessionTicketKeys::getKeyLifetime() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _keyLifetime;
+}
+
+
+void ofSSLSessionTicketKeys::rotate()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_sharedKeyFile.empty())
+    {
+        _generate(now());
+        _prune(now());
+        return;
+    }
+
+    try
+    {
+        Poco::NamedMutex fileMutex("ofSSLSessionTicketKeys" + std::to_string(std::hash<std::string>()(_sharedKeyFile)));
+        Poco::NamedMutex::ScopedLock fileLock(fileMutex);
+        _load();
+        _generate(now());
+        _prune(now());
+        _save();
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ofLogError("ofSSLSessionTicketKeys::rotate") << exc.displayText();
+    }
+}
+
+
+std::size_t ofSSLSessionTicketKeys::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _keys.size();
+}
+
+
+uint64_t ofSSLSessionTicketKeys::getTicketsIssued() const
+{
+    return _ticketsIssued;
+}
+
+
+uint64_t ofSSLSessionTicketKeys::getTicketsAccepted() const
+{
+    return _ticketsAccepted;
+}
+
+
+uint64_t ofSSLSessionTicketKeys::getTicketsRenewed() const
+{
+    return _ticketsRenewed;
+}
+
+
+uint64_t ofSSLSessionTicketKeys::getTicketsRejected() const
+{
+    return _ticketsRejected;
+}
+
+
+uint64_t ofSSLSessionTicketKeys::getRotations() const
+{
+    return _rotations;
+}
+
+
+void ofSSLSessionTicketKeys::_refresh(bool force)
+{
+    int64_t time = now();
+
+    // Check at most once per second.
+    if (!force && time < _nextRefresh)
+        return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _nextRefresh = time + 1;
+
+    try
+    {
+        if (_sharedKeyFile.empty())
+        {
+            if (_needsRotation(time))
+                _generate(time);
+        }
+        else
+        {
+            _load();
+
+            if (_needsRotation(time))
+            {
+                Poco::NamedMutex fileMutex("ofSSLSessionTicketKeys" + std::to_string(std::hash<std::string>()(_sharedKeyFile)));
+                Poco::NamedMutex::ScopedLock fileLock(fileMutex);
+
+                // Another process may have rotated while we were waiting.
+                _load();
+
+                if (_needsRotation(time))
+                {
+                    _generate(time);
+                    _prune(time);
+                    _save();
+                }
+            }
+        }
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ofLogError("ofSSLSessionTicketKeys::_refresh") << exc.displayText();
+
+        // Never leave the server without a key to issue tickets with.
+        if (_keys.empty())
+            _generate(time);
+    }
+
+    _prune(time);
+}
+
+
+void ofSSLSessionTicketKeys::_generate(int64_t time)
+{
+    Key key;
+    key.created = time;
+
+    if (RAND_bytes(key.name, NAME_LENGTH) != 1
+    ||  RAND_bytes(key.hmacKey, HMAC_KEY_LENGTH) != 1
+    ||  RAND_bytes(key.aesKey, AES_KEY_LENGTH) != 1)
+    {
+        OPENSSL_cleanse(&key, sizeof(key));
+        ofLogError("ofSSLSessionTicketKeys::_generate") << "Unable to generate random key material.";
+        return;
+    }
+
+    _keys.insert(_keys.begin(), key);
+    OPENSSL_cleanse(&key, sizeof(key));
+    ++_rotations;
+}
+
+
+void ofSSLSessionTicketKeys::_prune(int64_t time)
+{
+    // Always keep the newest key.
+    while (_keys.size() > 1 && _keys.back().created + _keyLifetime.count() <= time)
+    {
+        OPENSSL_cleanse(&_keys.back(), sizeof(Key));
+        _keys.pop_back();
+    }
+}
+
+
+bool ofSSLSessionTicketKeys::_needsRotation(int64_t time) const
+{
+    return _keys.empty() || _keys.front().created + _rotationInterval.count() <= time;
+}
+
+
+void ofSSLSessionTicketKeys::_load()
+{
+    Poco::File file(_sharedKeyFile);
+
+    if (!file.exists())
+        return;
+
+    Poco::Timestamp modified = file.getLastModified();
+
+    if (modified == _sharedKeyFileModified)
+        return;
+
+    std::ifstream stream(_sharedKeyFile);
+
+    if (!stream)
+    {
+        ofLogError("ofSSLSessionTicketKeys::_load") << "Unable to read " << _sharedKeyFile;
+        return;
+    }
+
+    std::vector<Key> keys;
+    std::string line;
+
+    while (std::getline(stream, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        std::string name;
+        std::string hmacKey;
+        std::string aesKey;
+        Key key;
+
+        if ((fields >> key.created >> name >> hmacKey >> aesKey)
+        &&  fromHex(name, key.name, NAME_LENGTH)
+        &&  fromHex(hmacKey, key.hmacKey, HMAC_KEY_LENGTH)
+        &&  fromHex(aesKey, key.aesKey, AES_KEY_LENGTH))
+        {
+            keys.push_back(key);
+        }
+        else
+        {
+            ofLogWarning("ofSSLSessionTicketKeys::_load") << "Ignoring malformed key in " << _sharedKeyFile;
+        }
+
+        OPENSSL_cleanse(&key, sizeof(key));
+        OPENSSL_cleanse(&line[0], line.size());
+    }
+
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+        return a.created > b.created;
+    });
+
+    for (auto& key: _keys)
+        OPENSSL_cleanse(&key, sizeof(Key));
+
+    _keys.swap(keys);
+    _sharedKeyFileModified = modified;
+}
+
+
+void ofSSLSessionTicketKeys::_save()
+{
+    std::string temporaryPath = _sharedKeyFile + ".tmp";
+
+    std::string data = "# ofxSSLManager session ticket keys: created name hmac aes\n";
+
+    for (const auto& key: _keys)
+    {
+        data += std::to_string(key.created) + " ";
+        data += toHex(key.name, NAME_LENGTH) + " ";
+        data += toHex(key.hmacKey, HMAC_KEY_LENGTH) + " ";
+        data += toHex(key.aesKey, AES_KEY_LENGTH) + "\n";
+    }
+    bool written = false;
+
+#if !defined(_WIN32)
+    // The file is created with owner-only permissions so that the keys are
+    // never readable by other users.  O_EXCL and O_NOFOLLOW refuse a file or
+    // link that someone else put in its place.  A file left behind by a
+    // process that died while saving is removed first; the named mutex
+    // ensures no other process is writing it.
+    ::unlink(temporaryPath.c_str());
+
+    int fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    if (fd >= 0)
+    {
+        std::size_t offset = 0;
+
+        while (offset < data.size())
+        {
+            ssize_t result = ::write(fd, data.data() + offset, data.size() - offset);
+
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            if (result <= 0)
+                break;
+
+            offset += static_cast<std::size_t>(result);
+        }
+
+        written = offset == data.size() && ::fsync(fd) == 0;
+
+        if (::close(fd) != 0)
+            written = false;
+
+        if (!written)
+            ::unlink(temporaryPath.c_str());
+    }
+#else
+    {
+        std::ofstream stream(temporaryPath, std::ios::trunc | std::ios::binary);
+        stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+        stream.flush();
+        written = static_cast<bool>(stream);
+    }
+#endif
+
+    OPENSSL_cleanse(&data[0], data.size());
+
+    if (!written)
+    {
+        ofLogError("ofSSLSessionTicketKeys::_save") << "Unable to write " << temporaryPath;
+        return;
+    }
+
+#if !defined(_WIN32)
+    if (::rename(temporaryPath.c_str(), _sharedKeyFile.c_str()) != 0)
+    {
+        ofLogError("ofSSLSessionTicketKeys::_save") << "Unable to replace " << _sharedKeyFile;
+        ::unlink(temporaryPath.c_str());
+        return;
+    }
+#else
+    Poco::File(temporaryPath).renameTo(_sharedKeyFile);
+#endif
+
+    _sharedKeyFileModified = Poco::File(_sharedKeyFile).getLastModified();
+}
+
+
+bool ofSSLSessionTicketKeys::_encryptionKey(Key& key)
+{
+    _refresh(false);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_keys.empty())
+        return false;
+
+    key = _keys.front();
+    return true;
+}
+
+
+bool ofSSLSessionTicketKeys::_decryptionKey(const unsigned char* name,
+                                            Key& key,
+                                            bool& isNewest)
+{
+    _refresh(false);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (std::size_t i = 0; i < _keys.size(); ++i)
+    {
+        if (std::memcmp(_keys[i].name, name, NAME_LENGTH) == 0)
+        {
+            key = _keys[i];
+            isNewest = (i == 0);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int ofSSLSessionTicketKeys::_contextIndex()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int ofSSLSessionTicketKeys::_ticketKeyCallback(SSL* ssl,
+                                               unsigned char* name,
+                                               unsigned char* iv,
+                                               EVP_CIPHER_CTX* cipherContext,
+                                               EVP_MAC_CTX* macContext,
+                                               int encrypt)
+#else
+int ofSSLSessionTicketKeys::_ticketKeyCallback(SSL* ssl,
+                                               unsigned char* name,
+                                               unsigned char* iv,
+                                               EVP_CIPHER_CTX* cipherContext,
+                                               HMAC_CTX* hmacContext,
+                                               int encrypt)
+#endif
+{
+    ofSSLSessionTicketKeys* keys = static_cast<ofSSLSessionTicketKeys*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), _contextIndex()));
+
+    if (keys == nullptr)
+        return -1;
+
+    Key key;
+    bool isNewest = true;
+    int result = 1;
+
+    if (encrypt)
+    {
+        if (!keys->_encryptionKey(key))
+            return -1;
+
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+        {
+            OPENSSL_cleanse(&key, sizeof(key));
+            return -1;
+        }
+
+        std::memcpy(name, key.name, NAME_LENGTH);
+
+        if (EVP_EncryptInit_ex(cipherContext, EVP_aes_256_cbc(), nullptr, key.aesKey, iv) != 1)
+            result = -1;
+
+        ++keys->_ticketsIssued;
+    }
+    else
+    {
+        if (!keys->_decryptionKey(name, key, isNewest))
+        {
+            // Unknown key, fall back to a full handshake.
+            ++keys->_ticketsRejected;
+            return 0;
+        }
+
+        if (EVP_DecryptInit_ex(cipherContext, EVP_aes_256_cbc(), nullptr, key.aesKey, iv) != 1)
+            result = -1;
+
+        ++keys->_ticketsAccepted;
+
+        if (!isNewest)
+        {
+            // Ask OpenSSL to issue a new ticket with the newest key.
+            ++keys->_ticketsRenewed;
+            result = 2;
+        }
+    }
+
+    if (result != -1)
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        OSSL_PARAM params[3];
+        params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey, HMAC_KEY_LENGTH);
+        params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+        params[2] = OSSL_PARAM_construct_end();
+
+        if (EVP_MAC_CTX_set_params(macContext, params) != 1)
+            result = -1;
+#else
+        if (HMAC_Init_ex(hmacContext, key.hmacKey, HMAC_KEY_LENGTH, EVP_sha256(), nullptr) != 1)
+            result = -1;
+#endif
+    }
+
+    OPENSSL_cleanse(&key, sizeof(key));
+    return result;
+}
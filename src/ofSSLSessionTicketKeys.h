@@ -0,0 +1,206 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+#include "Poco/Timestamp.h"
+#include "Poco/Net/Context.h"
+
+
+/// \brief A set of rotating session ticket keys for server contexts.
+///
+/// Session tickets allow a client to resume a session with any server that
+/// holds the key that encrypted the ticket.  Keys are rotated on a schedule.
+/// The newest key encrypts new tickets, while older keys are kept for the
+/// key lifetime so that tickets issued before a rotation can still be
+/// decrypted (and are renewed with the newest key).
+///
+/// By default keys are generated in-process.  When several processes serve
+/// the same port, set a shared key file so that a ticket issued by one
+/// process can be decrypted by all of them.  Each process reloads the file
+/// when it changes and the first process to notice that the newest key is due
+/// for rotation generates a new key and rewrites the file.  Writes are
+/// serialized with a named mutex and the file is replaced atomically.
+///
+/// All methods are thread-safe.
+class ofSSLSessionTicketKeys
+{
+public:
+    /// \brief The default interval between key rotations.
+    static const std::chrono::seconds DEFAULT_ROTATION_INTERVAL;
+
+    /// \brief The default time a key can be used to decrypt tickets.
+    static const std::chrono::seconds DEFAULT_KEY_LIFETIME;
+
+    /// \brief Create an empty set of session ticket keys.
+    ///
+    /// The first key is generated (or loaded) when it is first needed.
+    ofSSLSessionTicketKeys();
+
+    /// \brief Use session ticket keys from this set in the given Context.
+    /// \param pContext The server Context.
+    /// \note This set must outlive the Context.
+    void attach(Poco::Net::Context::Ptr pContext);
+
+    /// \brief Share keys with other processes via a key file.
+    ///
+    /// The file contains secret key material and is created with owner-only
+    /// permissions where supported.  An empty path disables sharing.
+    ///
+    /// \param path The absolute path of the key file.
+    void setSharedKeyFile(const std::string& path);
+
+    /// \returns the shared key file path or an empty string if none.
+    std::string getSharedKeyFile() const;
+
+    /// \brief Find out if a Context shares its keys with other processes.
+    /// \param pSSLContext The SSL_CTX of the Context.
+    /// \returns true iff keys attached to the Context use a shared key file.
+    static bool isShared(SSL_CTX* pSSLContext);
+
+    /// \brief Set the interval between key rotations.
+    /// \param interval The rotation interval.
+    void setRotationInterval(std::chrono::seconds interval);
+
+    /// \returns the interval between key rotations.
+    std::chrono::seconds getRotationInterval() const;
+
+    /// \brief Set the time a key can be used to decrypt tickets.
+    ///
+    /// The lifetime should be longer than the rotation interval plus the
+    /// server session timeout.
+    ///
+    /// \param lifetime The key lifetime.
+    void setKeyLifetime(std::chrono::seconds lifetime);
+
+    /// \returns the time a key can be used to decrypt tickets.
+    std::chrono::seconds getKeyLifetime() const;
+
+    /// \brief Generate a new key immediately.
+    void rotate();
+
+    /// \returns the number of keys that can currently decrypt tickets.
+    std::size_t size() const;
+
+    /// \returns the number of tickets encrypted.
+    uint64_t getTicketsIssued() const;
+
+    /// \returns the number of tickets decrypted.
+    uint64_t getTicketsAccepted() const;
+
+    /// \returns the number of tickets decrypted with an older key and renewed.
+    uint64_t getTicketsRenewed() const;
+
+    /// \returns the number of tickets rejected because the key was unknown.
+    uint64_t getTicketsRejected() const;
+
+    /// \returns the number of keys generated by this process.
+    uint64_t getRotations() const;
+
+private:
+    enum
+    {
+        NAME_LENGTH = 16,
+        HMAC_KEY_LENGTH = 32,
+        AES_KEY_LENGTH = 32
+    };
+
+    struct Key
+    {
+        /// \brief The creation time in seconds since the epoch.
+        int64_t created = 0;
+        unsigned char name[NAME_LENGTH];
+        unsigned char hmacKey[HMAC_KEY_LENGTH];
+        unsigned char aesKey[AES_KEY_LENGTH];
+    };
+
+    /// \brief Load, rotate and prune keys if they are due.
+    /// \param force True to check immediately.
+    void _refresh(bool force);
+
+    /// \brief Generate a key and add it as the newest key.
+    /// \note The mutex must be held by the caller.
+    void _generate(int64_t now);
+
+    /// \brief Remove keys older than the key lifetime.
+    /// \note The mutex must be held by the caller.
+    void _prune(int64_t now);
+
+    /// \returns true iff the newest key is due for rotation.
+    /// \note The mutex must be held by the caller.
+    bool _needsRotation(int64_t now) const;
+
+    /// \brief Read the shared key file if it has changed.
+    /// \note The mutex must be held by the caller.
+    void _load();
+
+    /// \brief Atomically replace the shared key file.
+    /// \note The mutex must be held by the caller.
+    void _save();
+
+    /// \brief Get the key used to encrypt new tickets.
+    bool _encryptionKey(Key& key);
+
+    /// \brief Find the key with the given name.
+    /// \param name The key name from the ticket.
+    /// \param key The key found.
+    /// \param isNewest Set to true iff the key is the newest key.
+    /// \returns true iff a key was found.
+    bool _decryptionKey(const unsigned char* name, Key& key, bool& isNewest);
+
+    /// \brief Get the SSL_CTX ex_data index used to find the keys.
+    static int _contextIndex();
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int _ticketKeyCallback(SSL* ssl,
+                                  unsigned char* name,
+                                  unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipherContext,
+                                  EVP_MAC_CTX* macContext,
+                                  int encrypt);
+#else
+    static int _ticketKeyCallback(SSL* ssl,
+                                  unsigned char* name,
+                                  unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipherContext,
+                                  HMAC_CTX* hmacContext,
+                                  int encrypt);
+#endif
+
+    /// \brief The keys, newest first.
+    std::vector<Key> _keys;
+
+    std::string _sharedKeyFile;
+
+    /// \brief The modification time of the shared key file when last read.
+    Poco::Timestamp _sharedKeyFileModified;
+
+    std::chrono::seconds _rotationInterval = DEFAULT_ROTATION_INTERVAL;
+    std::chrono::seconds _keyLifetime = DEFAULT_KEY_LIFETIME;
+
+    /// \brief The time (seconds since the epoch) of the next refresh check.
+    std::atomic<int64_t> _nextRefresh;
+
+    std::atomic<uint64_t> _ticketsIssued;
+    std::atomic<uint64_t> _ticketsAccepted;
+    std::atomic<uint64_t> _ticketsRenewed;
+    std::atomic<uint64_t> _ticketsRejected;
+    std::atomic<uint64_t> _rotations;
+
+    mutable std::mutex _mutex;
+
+};
@@ -0,0 +1,500 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLTrustStore.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include "Poco/File.h"
+#include "Poco/SharedMemory.h"
+#include "ofLog.h"
+
+
+namespace
+{
+
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef const X509_NAME LookupName;
+#else
+typedef X509_NAME LookupName;
+#endif
+
+
+const char BINARY_MAGIC[] = { 'O', 'F', 'C', 'A' };
+const std::string DIRECTORY_SOURCE_FILE = ".source";
+const uint32_t BINARY_VERSION = 1;
+const std::size_t BINARY_HEADER_SIZE = 12;
+const std::size_t BINARY_ENTRY_SIZE = 12;
+
+
+/// \brief Describe the size and modification time of a bundle.
+std::string describeSource(const std::string& bundlePath)
+{
+    std::error_code error;
+    auto size = std::filesystem::file_size(bundlePath, error);
+    auto modified = std::filesystem::last_write_time(bundlePath, error);
+
+    if (error)
+        return "";
+
+    return std::to_string(size) + " " + std::to_string(modified.time_since_epoch().count());
+}
+
+
+/// \returns true iff the file name has the form "hhhhhhhh.n".
+bool isHashedFileName(const std::string& name)
+{
+    if (name.size() < 10 || name[8] != '.')
+        return false;
+
+    for (std::size_t i = 0; i < name.size(); ++i)
+    {
+        if (i == 8)
+            continue;
+
+        if (i < 8 ? !std::isxdigit(static_cast<unsigned char>(name[i]))
+                  : !std::isdigit(static_cast<unsigned char>(name[i])))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+uint32_t readUInt32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0])
+         | static_cast<uint32_t>(p[1]) << 8
+         | static_cast<uint32_t>(p[2]) << 16
+         | static_cast<uint32_t>(p[3]) << 24;
+}
+
+
+struct BinaryEntry
+{
+    uint32_t hash = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    bool parsed = false;
+};
+
+
+struct BinaryBundle
+{
+    Poco::SharedMemory memory;
+    std::vector<BinaryEntry> entries;
+};
+
+
+/// \brief The binary bundles loaded into one X509_STORE.
+///
+/// The index is owned by the X509_STORE (via its ex_data) because the store
+/// can outlive the ofSSLTrustStore that created it.
+struct BinaryIndex
+{
+    /// \brief Decode and add all certificates with the given subject name.
+    void parse(X509_STORE* pStore, LookupName* pName)
+    {
+        uint32_t hash = static_cast<uint32_t>(X509_NAME_hash(const_cast<X509_NAME*>(pName)));
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (auto& bundle: bundles)
+        {
+            auto iter = std::lower_bound(bundle.entries.begin(), bundle.entries.end(), hash, [](const BinaryEntry& entry, uint32_t value) {
+                return entry.hash < value;
+            });
+
+            for (; iter != bundle.entries.end() && iter->hash == hash; ++iter)
+            {
+                if (iter->parsed)
+                    continue;
+
+                iter->parsed = true;
+
+                const unsigned char* pData = reinterpret_cast<const unsigned char*>(bundle.memory.begin()) + iter->offset;
+                X509* pCertificate = d2i_X509(nullptr, &pData, static_cast<long>(iter->length));
+
+                if (pCertificate == nullptr)
+                {
+                    ERR_clear_error();
+                    continue;
+                }
+
+                // Entries with a colliding hash are trusted CAs too.
+                X509_STORE_add_cert(pStore, pCertificate);
+                X509_free(pCertificate);
+            }
+        }
+
+        ERR_clear_error();
+    }
+
+    std::vector<BinaryBundle> bundles;
+    std::mutex mutex;
+};
+
+
+void freeBinaryIndex(void*, void* pData, CRYPTO_EX_DATA*, int, long, void*)
+{
+    delete static_cast<BinaryIndex*>(pData);
+}
+
+
+int binaryIndexIndex()
+{
+    static const int index = X509_STORE_get_ex_new_index(0, nullptr, nullptr, nullptr, &freeBinaryIndex);
+    return index;
+}
+
+
+BinaryIndex* getBinaryIndex(X509_STORE_CTX* pContext)
+{
+    return static_cast<BinaryIndex*>(X509_STORE_get_ex_data(X509_STORE_CTX_get0_store(pContext), binaryIndexIndex()));
+}
+
+
+/// \brief Decode the issuers of a certificate before looking them up.
+int getIssuer(X509** ppIssuer, X509_STORE_CTX* pContext, X509* pCertificate)
+{
+    BinaryIndex* pIndex = getBinaryIndex(pContext);
+
+    if (pIndex != nullptr)
+        pIndex->parse(X509_STORE_CTX_get0_store(pContext), X509_get_issuer_name(pCertificate));
+
+    return X509_STORE_CTX_get1_issuer(ppIssuer, pContext, pCertificate);
+}
+
+
+/// \brief Decode the certificates with a subject name before looking them up.
+STACK_OF(X509)* lookupCertificates(X509_STORE_CTX* pContext, LookupName* pName)
+{
+    BinaryIndex* pIndex = getBinaryIndex(pContext);
+
+    if (pIndex != nullptr)
+        pIndex->parse(X509_STORE_CTX_get0_store(pContext), pName);
+
+    return X509_STORE_CTX_get1_certs(pContext, pName);
+}
+
+
+}
+
+
+ofSSLTrustStore::ofSSLTrustStore():
+    _pStore(X509_STORE_new()),
+    _size(0)
+{
+}
+
+
+ofSSLTrustStore::~ofSSLTrustStore()
+{
+    X509_STORE_free(_pStore);
+}
+
+
+std::size_t ofSSLTrustStore::loadPEM(const std::string& path)
+{
+    BIO* pBIO = BIO_new_file(path.c_str(), "r");
+
+    if (pBIO == nullptr)
+    {
+        ofLogError("ofSSLTrustStore::loadPEM") << "Unable to open " << path;
+        ERR_clear_error();
+        return 0;
+    }
+
+    STACK_OF(X509_INFO)* pInfos = PEM_X509_INFO_read_bio(pBIO, nullptr, nullptr, nullptr);
+    BIO_free(pBIO);
+
+    if (pInfos == nullptr)
+    {
+        ofLogError("ofSSLTrustStore::loadPEM") << "Unable to parse " << path;
+        ERR_clear_error();
+        return 0;
+    }
+
+    std::size_t count = 0;
+
+    for (int i = 0; i < sk_X509_INFO_num(pInfos); ++i)
+    {
+        X509_INFO* pInfo = sk_X509_INFO_value(pInfos, i);
+
+        // Duplicates are ignored by OpenSSL.
+        if (pInfo->x509 != nullptr && X509_STORE_add_cert(_pStore, pInfo->x509) == 1)
+            ++count;
+
+        if (pInfo->crl != nullptr)
+            X509_STORE_add_crl(_pStore, pInfo->crl);
+    }
+
+    sk_X509_INFO_pop_free(pInfos, X509_INFO_free);
+    ERR_clear_error();
+
+    _size += count;
+
+    ofLogVerbose("ofSSLTrustStore::loadPEM") << "Loaded " << count << " certificates from " << path;
+
+    return count;
+}
+
+
+std::size_t ofSSLTrustStore::loadBinary(const std::string& path)
+{
+    BinaryBundle bundle;
+
+    try
+    {
+        bundle.memory = Poco::SharedMemory(Poco::File(path), Poco::SharedMemory::AM_READ);
+    }
+    catch (const Poco::Exception& exc)
+    {
+        ofLogError("ofSSLTrustStore::loadBinary") << "Unable to map " << path << ": " << exc.displayText();
+        return 0;
+    }
+
+    const unsigned char* pData = reinterpret_cast<const unsigned char*>(bundle.memory.begin());
+    std::size_t size = static_cast<std::size_t>(bundle.memory.end() - bundle.memory.begin());
+
+    if (size < BINARY_HEADER_SIZE
+    ||  std::memcmp(pData, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0
+    ||  readUInt32(pData + 4) != BINARY_VERSION)
+    {
+        ofLogError("ofSSLTrustStore::loadBinary") << "Invalid binary bundle: " << path;
+        return 0;
+    }
+
+    std::size_t count = readUInt32(pData + 8);
+    std::size_t indexEnd = BINARY_HEADER_SIZE + count * BINARY_ENTRY_SIZE;
+
+    if (count > (size - BINARY_HEADER_SIZE) / BINARY_ENTRY_SIZE)
+    {
+        ofLogError("ofSSLTrustStore::loadBinary") << "Truncated binary bundle: " << path;
+        return 0;
+    }
+
+    bundle.entries.reserve(count);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const unsigned char* pEntry = pData + BINARY_HEADER_SIZE + i * BINARY_ENTRY_SIZE;
+
+        BinaryEntry entry;
+        entry.hash = readUInt32(pEntry);
+        entry.offset = readUInt32(pEntry + 4);
+        entry.length = readUInt32(pEntry + 8);
+
+        if (entry.offset < indexEnd
+        ||  entry.offset > size
+        ||  entry.length > size - entry.offset)
+        {
+            ofLogError("ofSSLTrustStore::loadBinary") << "Invalid certificate entry " << i << " in " << path;
+            return 0;
+        }
+
+        bundle.entries.push_back(entry);
+    }
+
+    std::stable_sort(bundle.entries.begin(), bundle.entries.end(), [](const BinaryEntry& a, const BinaryEntry& b) {
+        return a.hash < b.hash;
+    });
+
+    BinaryIndex* pIndex = static_cast<BinaryIndex*>(X509_STORE_get_ex_data(_pStore, binaryIndexIndex()));
+
+    if (pIndex == nullptr)
+    {
+        pIndex = new BinaryIndex();
+        X509_STORE_set_ex_data(_pStore, binaryIndexIndex(), pIndex);
+        X509_STORE_set_get_issuer(_pStore, &getIssuer);
+        X509_STORE_set_lookup_certs(_pStore, &lookupCertificates);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(pIndex->mutex);
+        pIndex->bundles.push_back(bundle);
+    }
+
+    _size += count;
+
+    ofLogVerbose("ofSSLTrustStore::loadBinary") << "Mapped " << count << " certificates from " << path;
+
+    return count;
+}
+
+
+std::size_t ofSSLTrustStore::loadDirectory(const std::string& path)
+{
+    std::size_t count = 0;
+    std::error_code error;
+
+    for (const auto& entry: std::filesystem::directory_iterator(path, error))
+    {
+        if (isHashedFileName(entry.path().filename().string()))
+            ++count;
+    }
+
+    if (error)
+    {
+        ofLogError("ofSSLTrustStore::loadDirectory") << "Unable to read " << path << ": " << error.message();
+        return 0;
+    }
+
+    X509_LOOKUP* pLookup = X509_STORE_add_lookup(_pStore, X509_LOOKUP_hash_dir());
+
+    if (pLookup == nullptr || X509_LOOKUP_add_dir(pLookup, path.c_str(), X509_FILETYPE_PEM) != 1)
+    {
+        ofLogError("ofSSLTrustStore::loadDirectory") << "Unable to add " << path;
+        ERR_clear_error();
+        return 0;
+    }
+
+    _size += count;
+
+    ofLogVerbose("ofSSLTrustStore::loadDirectory") << "Added " << count << " certificates from " << path;
+
+    return count;
+}
+
+
+void ofSSLTrustStore::attach(Poco::Net::Context::Ptr pContext) const
+{
+    if (pContext.isNull())
+        return;
+
+    // SSL_CTX_set_cert_store takes ownership of a reference.
+    X509_STORE_up_ref(_pStore);
+    SSL_CTX_set_cert_store(pContext->sslContext(), _pStore);
+}
+
+
+std::size_t ofSSLTrustStore::size() const
+{
+    return _size;
+}
+
+
+std::size_t ofSSLTrustStore::getParsedCount() const
+{
+    std::size_t count = 0;
+
+    X509_STORE_lock(_pStore);
+
+    STACK_OF(X509_OBJECT)* pObjects = X509_STORE_get0_objects(_pStore);
+
+    for (int i = 0; i < sk_X509_OBJECT_num(pObjects); ++i)
+    {
+        if (X509_OBJECT_get_type(sk_X509_OBJECT_value(pObjects, i)) == X509_LU_X509)
+            ++count;
+    }
+
+    X509_STORE_unlock(_pStore);
+
+    return count;
+}
+
+
+X509_STORE* ofSSLTrustStore::store() const
+{
+    return _pStore;
+}
+
+
+std::size_t ofSSLTrustStore::createDirectory(const std::string& bundlePath,
+                                             const std::string& directoryPath)
+{
+    BIO* pBIO = BIO_new_file(bundlePath.c_str(), "r");
+
+    if (pBIO == nullptr)
+    {
+        ofLogError("ofSSLTrustStore::createDirectory") << "Unable to open " << bundlePath;
+        ERR_clear_error();
+        return 0;
+    }
+
+    STACK_OF(X509_INFO)* pInfos = PEM_X509_INFO_read_bio(pBIO, nullptr, nullptr, nullptr);
+    BIO_free(pBIO);
+
+    if (pInfos == nullptr)
+    {
+        ofLogError("ofSSLTrustStore::createDirectory") << "Unable to parse " << bundlePath;
+        ERR_clear_error();
+        return 0;
+    }
+
+    // Write to a temporary directory, then replace the directory.
+    std::string temporaryPath = directoryPath + ".tmp";
+    std::error_code error;
+    std::filesystem::remove_all(temporaryPath, error);
+    std::filesystem::create_directories(temporaryPath, error);
+
+    std::map<uint32_t, int> hashCounts;
+    std::size_t count = 0;
+
+    for (int i = 0; i < sk_X509_INFO_num(pInfos); ++i)
+    {
+        X509* pCertificate = sk_X509_INFO_value(pInfos, i)->x509;
+
+        if (pCertificate == nullptr)
+            continue;
+
+        uint32_t hash = static_cast<uint32_t>(X509_NAME_hash(X509_get_subject_name(pCertificate)));
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%08x.%d", hash, hashCounts[hash]++);
+
+        std::string filePath = (std::filesystem::path(temporaryPath) / name).string();
+        BIO* pFile = BIO_new_file(filePath.c_str(), "w");
+
+        if (pFile != nullptr && PEM_write_bio_X509(pFile, pCertificate) == 1)
+            ++count;
+        else
+            ofLogError("ofSSLTrustStore::createDirectory") << "Unable to write " << filePath;
+
+        BIO_free(pFile);
+    }
+
+    sk_X509_INFO_pop_free(pInfos, X509_INFO_free);
+    ERR_clear_error();
+
+    std::ofstream((std::filesystem::path(temporaryPath) / DIRECTORY_SOURCE_FILE).string()) << describeSource(bundlePath);
+
+    std::filesystem::remove_all(directoryPath, error);
+    std::filesystem::rename(temporaryPath, directoryPath, error);
+
+    if (error)
+    {
+        ofLogError("ofSSLTrustStore::createDirectory") << "Unable to create " << directoryPath << ": " << error.message();
+        return 0;
+    }
+
+    ofLogVerbose("ofSSLTrustStore::createDirectory") << "Wrote " << count << " certificates to " << directoryPath;
+
+    return count;
+}
+
+
+bool ofSSLTrustStore::isDirectoryCurrent(const std::string& bundlePath,
+                                         const std::string& directoryPath)
+{
+    std::ifstream stream((std::filesystem::path(directoryPath) / DIRECTORY_SOURCE_FILE).string());
+    std::string source;
+    std::getline(stream, source);
+    return stream && !source.empty() && source == describeSource(bundlePath);
+}
@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <string>
+#include <openssl/x509.h>
+#include "Poco/AutoPtr.h"
+#include "Poco/RefCountedObject.h"
+#include "Poco/Net/Context.h"
+
+
+/// \brief A parsed set of trusted certificates shared by many Contexts.
+///
+/// Each Poco::Net::Context created with a CA location parses the CA bundle
+/// and keeps its own copy of every certificate.  An ofSSLTrustStore parses a
+/// bundle once into a single OpenSSL X509_STORE that any number of Contexts
+/// can use.  The X509_STORE is reference counted, so it lives as long as the
+/// last Context or ofSSLTrustStore that uses it.
+///
+/// To use a trust store with a custom Context, create the Context with an
+/// empty CA location and attach the store:
+///
+/// ~~~{.cpp}
+///     Poco::Net::Context::Ptr pContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "");
+///     ofSSLManager::getTrustStore()->attach(pContext);
+/// ~~~
+///
+/// Certificates can be loaded from a PEM bundle or from a binary bundle.  A
+/// binary bundle is created from a PEM bundle with `shared/data/ssl.sh`.  It
+/// is memory mapped and its certificates are only decoded when they are
+/// needed to build a certificate chain, which makes loading it much faster
+/// than parsing a PEM bundle.  The binary bundle format (all integers are
+/// unsigned, 32-bit and little endian) is:
+///
+/// ~~~
+///     magic "OFCA" | version (1) | count
+///     count x (subject name hash | DER offset | DER length), sorted by hash
+///     count x DER encoded certificate
+/// ~~~
+///
+/// where the subject name hash is OpenSSL's X509_NAME_hash(), as printed by
+/// `openssl x509 -noout -subject_hash`.
+///
+/// Certificates can also be loaded from a hashed certificate directory, as
+/// created by `c_rehash` or ofSSLTrustStore::createDirectory().  OpenSSL then
+/// reads only the files of the issuers it needs.
+///
+/// \note Certificates added to one attached Context (e.g. with
+///       Poco::Net::Context::addCertificateAuthority()) are added to the
+///       shared store and are trusted by all attached Contexts.
+class ofSSLTrustStore: public Poco::RefCountedObject
+{
+public:
+    typedef Poco::AutoPtr<ofSSLTrustStore> Ptr;
+
+    /// \brief Create an empty trust store.
+    ofSSLTrustStore();
+
+    /// \brief Add the certificates and CRLs in a PEM bundle.
+    /// \param path The path of the PEM bundle.
+    /// \returns The number of certificates added.
+    std::size_t loadPEM(const std::string& path);
+
+    /// \brief Add the certificates in a binary bundle.
+    ///
+    /// The bundle is memory mapped and certificates are decoded lazily.
+    ///
+    /// \param path The path of the binary bundle.
+    /// \returns The number of certificates in the bundle or 0 if the bundle
+    ///          could not be read.
+    std::size_t loadBinary(const std::string& path);
+
+    /// \brief Add the certificates in a hashed certificate directory.
+    ///
+    /// Certificates are read by OpenSSL only when they are needed.
+    ///
+    /// \param path The path of the hashed certificate directory.
+    /// \returns The number of certificate files in the directory.
+    std::size_t loadDirectory(const std::string& path);
+
+    /// \brief Make the given Context use this trust store.
+    ///
+    /// Any certificates previously loaded by the Context are released.
+    ///
+    /// \param pContext The Context to attach to.
+    void attach(Poco::Net::Context::Ptr pContext) const;
+
+    /// \returns the number of certificates available in the trust store,
+    ///          including certificates that have not been decoded yet.
+    std::size_t size() const;
+
+    /// \returns the number of certificates that have been decoded and added
+    ///          to the underlying OpenSSL store.
+    std::size_t getParsedCount() const;
+
+    /// \returns the underlying OpenSSL store.
+    X509_STORE* store() const;
+
+    /// \brief Create a hashed certificate directory from a PEM bundle.
+    ///
+    /// Each certificate is written to a file named after its subject name
+    /// hash, as `c_rehash` does.  The directory also records the size and
+    /// modification time of the bundle so that a stale directory can be
+    /// detected with isDirectoryCurrent().  An existing directory is
+    /// replaced.
+    ///
+    /// \param bundlePath The path of the PEM bundle.
+    /// \param directoryPath The path of the directory to create.
+    /// \returns The number of certificates written.
+    static std::size_t createDirectory(const std::string& bundlePath,
+                                       const std::string& directoryPath);
+
+    /// \brief Determine if a hashed directory was created from a bundle.
+    /// \param bundlePath The path of the PEM bundle.
+    /// \param directoryPath The path of the hashed certificate directory.
+    /// \returns true iff the directory was created by createDirectory()
+    ///          from the current version of the bundle.
+    static bool isDirectoryCurrent(const std::string& bundlePath,
+                                   const std::string& directoryPath);
+
+protected:
+    /// \brief Destroys the ofSSLTrustStore.
+    ~ofSSLTrustStore();
+
+private:
+    ofSSLTrustStore(const ofSSLTrustStore&) = delete;
+    ofSSLTrustStore& operator = (const ofSSLTrustStore&) = delete;
+
+    /// \brief The OpenSSL store.
+    X509_STORE* _pStore = nullptr;
+
+    /// \brief The number of certificates available.
+    std::atomic<std::size_t> _size;
+
+};
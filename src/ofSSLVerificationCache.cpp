@@ -0,0 +1,203 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofSSLVerificationCache.h"
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+
+const std::size_t ofSSLVerificationCache::DEFAULT_MAXIMUM_SIZE = 1024;
+const std::chrono::seconds ofSSLVerificationCache::DEFAULT_TIME_TO_LIVE = std::chrono::seconds(300);
+
+
+ofSSLVerificationCache::ofSSLVerificationCache(std::size_t maximumSize,
+                                               std::chrono::seconds timeToLive):
+    _maximumSize(maximumSize),
+    _timeToLive(timeToLive),
+    _hits(0),
+    _misses(0),
+    _evictions(0),
+    _expirations(0)
+{
+}
+
+
+bool ofSSLVerificationCache::get(const std::string& key, bool& ignoreError)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _index.find(key);
+
+    if (iter == _index.end())
+    {
+        ++_misses;
+        return false;
+    }
+
+    if (iter->second->expires <= Clock::now())
+    {
+        _entries.erase(iter->second);
+        _index.erase(iter);
+        ++_expirations;
+        ++_misses;
+        return false;
+    }
+
+    // Move the entry to the front of the list.
+    _entries.splice(_entries.begin(), _entries, iter->second);
+    ++_hits;
+    ignoreError = _entries.front().ignoreError;
+    return true;
+}
+
+
+void ofSSLVerificationCache::put(const std::string& key, bool ignoreError)
+{
+    if (key.empty())
+        return;
+
+    Clock::time_point now = Clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_maximumSize == 0 || _timeToLive.count() <= 0)
+        return;
+
+    Entry entry;
+    entry.key = key;
+    entry.ignoreError = ignoreError;
+    entry.expires = now + _timeToLive;
+
+    auto iter = _index.find(entry.key);
+
+    if (iter != _index.end())
+    {
+        _entries.erase(iter->second);
+        _index.erase(iter);
+    }
+
+    _entries.push_front(entry);
+    _index[_entries.front().key] = _entries.begin();
+
+    _trim();
+}
+
+
+void ofSSLVerificationCache::clear()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _index.clear();
+    _entries.clear();
+}
+
+
+std::size_t ofSSLVerificationCache::size() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+
+void ofSSLVerificationCache::setMaximumSize(std::size_t maximumSize)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _maximumSize = maximumSize;
+    _trim();
+}
+
+
+std::size_t ofSSLVerificationCache::getMaximumSize() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _maximumSize;
+}
+
+
+void ofSSLVerificationCache::setTimeToLive(std::chrono::seconds timeToLive)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _timeToLive = timeToLive;
+}
+
+
+std::chrono::seconds ofSSLVerificationCache::getTimeToLive() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _timeToLive;
+}
+
+
+uint64_t ofSSLVerificationCache::getHits() const
+{
+    return _hits;
+}
+
+
+uint64_t ofSSLVerificationCache::getMisses() const
+{
+    return _misses;
+}
+
+
+uint64_t ofSSLVerificationCache::getEvictions() const
+{
+    return _evictions;
+}
+
+
+uint64_t ofSSLVerificationCache::getExpirations() const
+{
+    return _expirations;
+}
+
+
+void ofSSLVerificationCache::resetCounters()
+{
+    _hits = 0;
+    _misses = 0;
+    _evictions = 0;
+    _expirations = 0;
+}
+
+
+std::string ofSSLVerificationCache::makeKey(const Poco::Net::VerificationErrorArgs& args,
+                                            bool server)
+{
+    const X509* pCertificate = args.certificate().certificate();
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+
+    // Without a fingerprint the decision cannot be cached safely.
+    if (pCertificate == nullptr || X509_digest(pCertificate, EVP_sha256(), digest, &length) != 1)
+        return "";
+
+    static const char* hex = "0123456789abcdef";
+
+    std::string key = server ? "s:" : "c:";
+
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        key += hex[digest[i] >> 4];
+        key += hex[digest[i] & 0x0f];
+    }
+
+    key += ":";
+    key += std::to_string(args.errorNumber());
+    return key;
+}
+
+
+void ofSSLVerificationCache::_trim()
+{
+    while (_entries.size() > _maximumSize)
+    {
+        _index.erase(_entries.back().key);
+        _entries.pop_back();
+        ++_evictions;
+    }
+}
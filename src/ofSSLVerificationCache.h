@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Poco/Net/VerificationErrorArgs.h"
+
+
+/// \brief A bounded, expiring cache of certificate verification decisions.
+///
+/// When a certificate fails verification, the listeners registered with
+/// ofSSLManager::registerAllEvents() decide whether to ignore the error.
+/// The decision is cached by the SHA-256 fingerprint of the certificate and
+/// the error number, so that repeated connections to the same host do not
+/// call the listeners again until the decision expires.  When the cache is
+/// full, the least recently used decision is evicted.
+///
+/// Set the maximum size to 0 to call the listeners for every error.
+///
+/// All methods are thread-safe.
+class ofSSLVerificationCache
+{
+public:
+    /// \brief The default maximum number of cached decisions.
+    static const std::size_t DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The default time to live for a cached decision.
+    static const std::chrono::seconds DEFAULT_TIME_TO_LIVE;
+
+    /// \brief Create a verification cache.
+    /// \param maximumSize The maximum number of cached decisions.
+    /// \param timeToLive The maximum time a decision is kept.
+    ofSSLVerificationCache(std::size_t maximumSize = DEFAULT_MAXIMUM_SIZE,
+                           std::chrono::seconds timeToLive = DEFAULT_TIME_TO_LIVE);
+
+    /// \brief Get the cached decision for a key.
+    /// \param key The key made by makeKey().
+    /// \param ignoreError Set to the cached decision if one is available.
+    /// \returns true iff a decision is cached.
+    bool get(const std::string& key, bool& ignoreError);
+
+    /// \brief Cache a decision for a key.
+    /// \param key The key made by makeKey().
+    /// \param ignoreError True if the error should be ignored.
+    void put(const std::string& key, bool ignoreError);
+
+    /// \brief Remove all cached decisions.
+    void clear();
+
+    /// \returns the number of cached decisions, including expired decisions
+    ///          that have not yet been removed.
+    std::size_t size() const;
+
+    /// \brief Set the maximum number of cached decisions.
+    ///
+    /// If the cache holds more decisions than the new maximum, the least
+    /// recently used decisions are evicted.
+    ///
+    /// \param maximumSize The maximum number of cached decisions.
+    void setMaximumSize(std::size_t maximumSize);
+
+    /// \returns the maximum number of cached decisions.
+    std::size_t getMaximumSize() const;
+
+    /// \brief Set the maximum time a decision is kept.
+    ///
+    /// The new time to live applies to decisions cached after this call.
+    ///
+    /// \param timeToLive The time to live.
+    void setTimeToLive(std::chrono::seconds timeToLive);
+
+    /// \returns the maximum time a decision is kept.
+    std::chrono::seconds getTimeToLive() const;
+
+    /// \returns the number of lookups that returned a decision.
+    uint64_t getHits() const;
+
+    /// \returns the number of lookups that did not return a decision.
+    uint64_t getMisses() const;
+
+    /// \returns the number of decisions evicted to respect the maximum size.
+    uint64_t getEvictions() const;
+
+    /// \returns the number of decisions discarded because they expired.
+    uint64_t getExpirations() const;
+
+    /// \brief Reset the hit, miss, eviction and expiration counters.
+    void resetCounters();
+
+    /// \brief Make a cache key from a verification error.
+    /// \param args The verification error.
+    /// \param server True if the error was reported by a Server Context.
+    /// \returns A key made from the side, the SHA-256 fingerprint of the
+    ///          certificate and the error number.
+    static std::string makeKey(const Poco::Net::VerificationErrorArgs& args,
+                               bool server);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        std::string key;
+        bool ignoreError;
+        Clock::time_point expires;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    /// \brief Evict least recently used decisions until size <= maximumSize.
+    /// \note The mutex must be held by the caller.
+    void _trim();
+
+    /// \brief The cached decisions, most recently used first.
+    EntryList _entries;
+
+    /// \brief An index of the cached decisions by key.
+    std::unordered_map<std::string, EntryList::iterator> _index;
+
+    /// \brief The maximum number of cached decisions.
+    std::size_t _maximumSize = DEFAULT_MAXIMUM_SIZE;
+
+    /// \brief The maximum time a decision is kept.
+    std::chrono::seconds _timeToLive = DEFAULT_TIME_TO_LIVE;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _evictions;
+    std::atomic<uint64_t> _expirations;
+
+    /// \brief The mutex protecting the entries and settings.
+    mutable std::mutex _mutex;
+
+};